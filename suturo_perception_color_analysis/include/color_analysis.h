@@ -8,6 +8,7 @@
 #include <boost/signals2/mutex.hpp>
 
 #include "suturo_perception_utils.h"
+#include "metrics_registry.h"
 #include "capability.h"
 #include "perceived_object.h"
 
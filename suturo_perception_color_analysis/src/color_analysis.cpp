@@ -14,7 +14,7 @@ ColorAnalysis::ColorAnalysis(PerceivedObject &obj) : Capability(obj)
 void
 ColorAnalysis::allInOne(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in)
 {
-  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  suturo_perception_utils::ScopedTimer timer("color_analysis/allInOne");
 
   if(cloud_in->points.size() == 0) 
   {
@@ -73,15 +73,12 @@ ColorAnalysis::allInOne(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in)
   averageColorHSVQuality.h = average_h;
   averageColorHSVQuality.s = average_s;
   averageColorHSVQuality.v = average_v;
-
-  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(s, e, "allInOne()");
 }
 
 uint32_t
 ColorAnalysis::getAverageColor(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in)
 {
-  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  suturo_perception_utils::ScopedTimer timer("color_analysis/getAverageColor");
 
   if(cloud_in->points.size() == 0) return 0;
 
@@ -99,9 +96,6 @@ ColorAnalysis::getAverageColor(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr clou
     average_b += (double)b / (double)cloud_in->points.size();
   }
 
-  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(s, e, "getAverageColor()");
-
   return ((uint32_t)average_r << 16 | (uint32_t)average_g << 8 | (uint32_t)average_b);
 
 }
@@ -115,7 +109,7 @@ ColorAnalysis::getAverageColorHSV(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr c
 HSVColor
 ColorAnalysis::getAverageColorHSVQuality(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in)
 {
-  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  suturo_perception_utils::ScopedTimer timer("color_analysis/getAverageColorHSVQuality");
 
   HSVColor fail_ret;
   fail_ret.h = -1;
@@ -144,16 +138,13 @@ ColorAnalysis::getAverageColorHSVQuality(const pcl::PointCloud<pcl::PointXYZRGB>
 
   avg_col.h = (uint32_t) avg_col_h;
 
-  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(s, e, "getAverageColorHSVQuality()");
-
   return avg_col;
 }
 
 std::vector<uint32_t> *
 ColorAnalysis::getHistogramHue(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in)
 {
-  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  suturo_perception_utils::ScopedTimer timer("color_analysis/getHistogramHue");
 
   std::vector<uint32_t> *ret = new std::vector<uint32_t>(120); // 360 / 3 = 120
   uint32_t excluded_point_cnt = 0;
@@ -181,8 +172,6 @@ ColorAnalysis::getHistogramHue(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr clou
 
   histogramQuality = (uint8_t) (100.0 - ((100.0 / (double) cloud_in->points.size()) * (double) excluded_point_cnt));
 
-  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(s, e, "getHistogramHue()");
 
   return ret;
 }
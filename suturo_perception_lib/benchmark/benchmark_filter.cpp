@@ -0,0 +1,100 @@
+/**
+ * Microbenchmark for the preprocessing of a point cloud.
+ * Compares the chain of filterZAxis, removeNans and a pcl::VoxelGrid
+ * against the same chain with the hash based downsample and
+ * the fused PointCloudOperations::filterAndDownsample.
+ *
+ * Usage: benchmark_filter [file.pcd] [iterations]
+ */
+#include "point_cloud_operations.h"
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_types.h>
+#include <pcl/filters/voxel_grid.h>
+#include <boost/lexical_cast.hpp>
+#include "boost/date_time/posix_time/posix_time.hpp"
+
+using namespace suturo_perception_lib;
+
+const float Z_MIN = 0.0;
+const float Z_MAX = 1.5;
+const float LEAF_SIZE = 0.01;
+
+int main(int argc, char **argv)
+{
+  std::string file = "box1.pcd";
+  int iterations = 50;
+  if (argc > 1)
+    file = argv[1];
+  if (argc > 2)
+    iterations = boost::lexical_cast<int>(argv[2]);
+
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in (new pcl::PointCloud<pcl::PointXYZRGB>);
+  if (pcl::io::loadPCDFile<pcl::PointXYZRGB>(file, *cloud_in) == -1)
+  {
+    std::cerr << "Couldn't read file " << file << std::endl;
+    return 1;
+  }
+  std::cout << "Cloud: " << cloud_in->width << " x " << cloud_in->height << ", "
+    << iterations << " iterations" << std::endl;
+
+  // three stage chain with the pcl::VoxelGrid
+  size_t chain_points = 0;
+  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered (new pcl::PointCloud<pcl::PointXYZRGB>),
+                                        cloud_nanles (new pcl::PointCloud<pcl::PointXYZRGB>),
+                                        cloud_downsampled (new pcl::PointCloud<pcl::PointXYZRGB>);
+    pcl::PassThrough<pcl::PointXYZRGB> pass(true);
+    PointCloudOperations::filterZAxis(cloud_in, cloud_filtered, pass, Z_MIN, Z_MAX);
+    PointCloudOperations::removeNans(cloud_filtered, cloud_nanles);
+    pcl::VoxelGrid<pcl::PointXYZRGB> vg;
+    vg.setInputCloud(cloud_nanles);
+    vg.setLeafSize(LEAF_SIZE, LEAF_SIZE, LEAF_SIZE);
+    vg.filter(*cloud_downsampled);
+    chain_points = cloud_downsampled->points.size();
+  }
+  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
+  double chain_ms = (e - s).total_microseconds() / 1000.0 / iterations;
+
+  // the same chain with the hash based downsample
+  size_t hash_points = 0;
+  s = boost::posix_time::microsec_clock::local_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered (new pcl::PointCloud<pcl::PointXYZRGB>),
+                                        cloud_nanles (new pcl::PointCloud<pcl::PointXYZRGB>),
+                                        cloud_downsampled (new pcl::PointCloud<pcl::PointXYZRGB>);
+    pcl::PassThrough<pcl::PointXYZRGB> pass(true);
+    PointCloudOperations::filterZAxis(cloud_in, cloud_filtered, pass, Z_MIN, Z_MAX);
+    PointCloudOperations::removeNans(cloud_filtered, cloud_nanles);
+    PointCloudOperations::downsample(cloud_nanles, cloud_downsampled, LEAF_SIZE);
+    hash_points = cloud_downsampled->points.size();
+  }
+  e = boost::posix_time::microsec_clock::local_time();
+  double hash_ms = (e - s).total_microseconds() / 1000.0 / iterations;
+
+  // fused kernel
+  size_t fused_points = 0;
+  s = boost::posix_time::microsec_clock::local_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered (new pcl::PointCloud<pcl::PointXYZRGB>),
+                                        cloud_downsampled (new pcl::PointCloud<pcl::PointXYZRGB>);
+    std::vector<int> removed_indices_filtered;
+    PointCloudOperations::filterAndDownsample(cloud_in, cloud_filtered, removed_indices_filtered,
+        cloud_downsampled, Z_MIN, Z_MAX, LEAF_SIZE);
+    fused_points = cloud_downsampled->points.size();
+  }
+  e = boost::posix_time::microsec_clock::local_time();
+  double fused_ms = (e - s).total_microseconds() / 1000.0 / iterations;
+
+  std::cout << "filterZAxis + removeNans + pcl::VoxelGrid: " << chain_ms << " ms, "
+    << chain_points << " points" << std::endl;
+  std::cout << "filterZAxis + removeNans + downsample:     " << hash_ms << " ms, "
+    << hash_points << " points (speedup " << chain_ms / hash_ms << ")" << std::endl;
+  std::cout << "filterAndDownsample:                       " << fused_ms << " ms, "
+    << fused_points << " points (speedup " << chain_ms / fused_ms << ")" << std::endl;
+  return 0;
+}
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
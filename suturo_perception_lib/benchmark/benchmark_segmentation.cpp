@@ -0,0 +1,375 @@
+/**
+ * Benchmark of the whole segmentation pipeline over a corpus of recorded frames.
+ * Every pcd file is processed warmup + iterations times with
+ * SuturoPerception::processCloudWithProjections. The same SuturoPerception
+ * is used for all runs of a file, so the workspace is warm like in the node.
+ * rand() is reseeded before every run. The plane RANSAC seeds itself
+ * with a constant, so every run sees the same random samples.
+ *
+ * Reports min, median, p99 and mean of every stage of the pipeline
+ * (SuturoPerception::getLastStageTimings), of the whole frame and of the
+ * buffer allocations per frame. The statistics can be written as CSV or JSON
+ * to compare commits and parameter sets offline.
+ *
+ * Usage: benchmark_segmentation <file.pcd|directory> [options]
+ *   -n <iterations>    measured runs per file (default 20)
+ *   -w <warmup>        runs per file, that are not measured (default 1)
+ *   -s <seed>          seed of rand() (default 42)
+ *   -p <name>=<value>  set a parameter of SuturoPerception (names like in
+ *                      the dynamic reconfigure config, bools as 0 or 1). Can be repeated.
+ *                      planeNormalPrior takes the expected table normal as x,y,z
+ *   -l <label>         label of this benchmark in the output, e.g. the commit
+ *   --csv <file>       write the statistics as CSV
+ *   --json <file>      write the statistics as JSON
+ *   --metrics <file>   write a snapshot of the MetricsRegistry of the measured runs as JSON.
+ *                      It has the timers of the single functions of the pipeline as well
+ */
+#include "suturo_perception.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_types.h>
+#include <boost/lexical_cast.hpp>
+#include "boost/date_time/posix_time/posix_time.hpp"
+
+using namespace suturo_perception_lib;
+using suturo_perception_utils::MetricsRegistry;
+
+namespace
+{
+  struct Statistics
+  {
+    std::string file;
+    std::string stage;
+    std::string unit;
+    int runs;
+    double min;
+    double median;
+    double p99;
+    double mean;
+  };
+
+  Statistics computeStatistics(const std::string &file, const std::string &stage, const std::string &unit,
+      std::vector<double> samples)
+  {
+    Statistics stats;
+    stats.file = file;
+    stats.stage = stage;
+    stats.unit = unit;
+    stats.runs = samples.size();
+    stats.min = stats.median = stats.p99 = stats.mean = 0;
+    if (samples.empty())
+      return stats;
+
+    std::sort(samples.begin(), samples.end());
+    const int n = samples.size();
+    stats.min = samples[0];
+    stats.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    // nearest rank
+    stats.p99 = samples[std::max(0, (int) ceil(0.99 * n) - 1)];
+    double sum = 0;
+    for (int i = 0; i < n; i++)
+      sum += samples[i];
+    stats.mean = sum / n;
+    return stats;
+  }
+
+  // Set the parameter name of sp to value. Returns false, if there is no such parameter
+  bool setParameter(SuturoPerception &sp, const std::string &name, const std::string &value)
+  {
+    if (name == "planeNormalPrior")
+    {
+      Eigen::Vector3f normal;
+      if (sscanf(value.c_str(), "%f,%f,%f", &normal[0], &normal[1], &normal[2]) != 3)
+        return false;
+      sp.setPlaneNormalPrior(normal);
+      return true;
+    }
+
+#define PARAM(key, setter, type) \
+    if (name == key) { sp.setter(boost::lexical_cast<type>(value)); return true; }
+
+    PARAM("zAxisFilterMin", setZAxisFilterMin, float)
+    PARAM("zAxisFilterMax", setZAxisFilterMax, float)
+    PARAM("downsampleLeafSize", setDownsampleLeafSize, float)
+    PARAM("planeMaxIterations", setPlaneMaxIterations, int)
+    PARAM("planeDistanceThreshold", setPlaneDistanceThreshold, double)
+    PARAM("planeRansacConfidence", setPlaneRansacConfidence, double)
+    PARAM("planeRansacGuided", setPlaneRansacGuided, bool)
+    PARAM("planeRansacThreads", setPlaneRansacThreads, int)
+    PARAM("planeNormalTolerance", setPlaneNormalTolerance, double)
+    PARAM("ecClusterTolerance", setEcClusterTolerance, double)
+    PARAM("ecMinClusterSize", setEcMinClusterSize, int)
+    PARAM("ecMaxClusterSize", setEcMaxClusterSize, int)
+    PARAM("prismZMin", setPrismZMin, float)
+    PARAM("prismZMax", setPrismZMax, float)
+    PARAM("ecObjClusterTolerance", setEcObjClusterTolerance, double)
+    PARAM("ecObjMinClusterSize", setEcObjMinClusterSize, int)
+    PARAM("ecObjMaxClusterSize", setEcObjMaxClusterSize, int)
+    PARAM("organizedSegmentation", setOrganizedSegmentation, bool)
+    PARAM("planeTracking", setPlaneTracking, bool)
+    PARAM("planeTrackingMinInlierRatio", setPlaneTrackingMinInlierRatio, double)
+    PARAM("organizedPlaneMinInliers", setOrganizedPlaneMinInliers, int)
+    PARAM("organizedPlaneAngularThreshold", setOrganizedPlaneAngularThreshold, double)
+    PARAM("rasterObjectClustering", setRasterObjectClustering, bool)
+    PARAM("coarsePlaneFitting", setCoarsePlaneFitting, bool)
+    PARAM("coarsePlaneLeafSize", setCoarsePlaneLeafSize, double)
+    PARAM("autoROI", setAutoROI, bool)
+    PARAM("autoROIMargin", setAutoROIMargin, double)
+    PARAM("autoROIPixelMargin", setAutoROIPixelMargin, int)
+    PARAM("sceneChangeGating", setSceneChangeGating, bool)
+    PARAM("sceneChangeMaxFraction", setSceneChangeMaxFraction, double)
+    PARAM("sceneChangeDepthThreshold", setSceneChangeDepthThreshold, double)
+    PARAM("sceneChangeColorThreshold", setSceneChangeColorThreshold, int)
+    PARAM("multiSurfaceSegmentation", setMultiSurfaceSegmentation, bool)
+    PARAM("surfaceMaxCount", setSurfaceMaxCount, int)
+    PARAM("surfaceMinInliers", setSurfaceMinInliers, int)
+    PARAM("surfaceMaxAngle", setSurfaceMaxAngle, double)
+#undef PARAM
+    return false;
+  }
+
+  bool isDirectory(const std::string &path)
+  {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+  }
+
+  // The pcd files in the directory, sorted by name
+  std::vector<std::string> listPCDFiles(const std::string &directory)
+  {
+    std::vector<std::string> files;
+    DIR *dir = opendir(directory.c_str());
+    if (dir == NULL)
+      return files;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+      std::string name = entry->d_name;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".pcd") == 0)
+        files.push_back(directory + "/" + name);
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    return files;
+  }
+
+  std::string jsonString(const std::string &s)
+  {
+    std::string out = "\"";
+    for (size_t i = 0; i < s.size(); i++)
+    {
+      if (s[i] == '"' || s[i] == '\\')
+        out += '\\';
+      out += s[i];
+    }
+    return out + "\"";
+  }
+
+  void writeCSV(const std::string &path, const std::string &label, const std::vector<Statistics> &statistics)
+  {
+    std::ofstream out(path.c_str());
+    out << "label,file,stage,unit,runs,min,median,p99,mean" << std::endl;
+    for (size_t i = 0; i < statistics.size(); i++)
+    {
+      const Statistics &s = statistics[i];
+      out << label << "," << s.file << "," << s.stage << "," << s.unit << "," << s.runs << ","
+        << s.min << "," << s.median << "," << s.p99 << "," << s.mean << std::endl;
+    }
+  }
+
+  void writeJSON(const std::string &path, const std::string &label, int iterations, int warmup, int seed,
+      const std::vector<std::string> &parameters, const std::vector<Statistics> &statistics)
+  {
+    std::ofstream out(path.c_str());
+    out << "{" << std::endl;
+    out << "  \"label\": " << jsonString(label) << "," << std::endl;
+    out << "  \"iterations\": " << iterations << "," << std::endl;
+    out << "  \"warmup\": " << warmup << "," << std::endl;
+    out << "  \"seed\": " << seed << "," << std::endl;
+    out << "  \"parameters\": [";
+    for (size_t i = 0; i < parameters.size(); i++)
+      out << (i ? ", " : "") << jsonString(parameters[i]);
+    out << "]," << std::endl;
+    out << "  \"statistics\": [" << std::endl;
+    for (size_t i = 0; i < statistics.size(); i++)
+    {
+      const Statistics &s = statistics[i];
+      out << "    {\"file\": " << jsonString(s.file) << ", \"stage\": " << jsonString(s.stage)
+        << ", \"unit\": " << jsonString(s.unit) << ", \"runs\": " << s.runs
+        << ", \"min\": " << s.min << ", \"median\": " << s.median
+        << ", \"p99\": " << s.p99 << ", \"mean\": " << s.mean << "}"
+        << (i + 1 < statistics.size() ? "," : "") << std::endl;
+    }
+    out << "  ]" << std::endl;
+    out << "}" << std::endl;
+  }
+
+  void usage()
+  {
+    std::cerr << "Usage: benchmark_segmentation <file.pcd|directory> [-n iterations] [-w warmup] [-s seed]"
+      << " [-p name=value]... [-l label] [--csv file] [--json file] [--metrics file]" << std::endl;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    usage();
+    return 1;
+  }
+
+  std::string input = argv[1];
+  int iterations = 20;
+  int warmup = 1;
+  int seed = 42;
+  std::string label;
+  std::string csv_path, json_path, metrics_path;
+  std::vector<std::string> parameters;
+  try
+  {
+    for (int i = 2; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (i + 1 >= argc)
+      {
+        usage();
+        return 1;
+      }
+      std::string value = argv[++i];
+      if (arg == "-n")
+        iterations = boost::lexical_cast<int>(value);
+      else if (arg == "-w")
+        warmup = boost::lexical_cast<int>(value);
+      else if (arg == "-s")
+        seed = boost::lexical_cast<int>(value);
+      else if (arg == "-p")
+        parameters.push_back(value);
+      else if (arg == "-l")
+        label = value;
+      else if (arg == "--csv")
+        csv_path = value;
+      else if (arg == "--json")
+        json_path = value;
+      else if (arg == "--metrics")
+        metrics_path = value;
+      else
+      {
+        usage();
+        return 1;
+      }
+    }
+  }
+  catch (boost::bad_lexical_cast &)
+  {
+    usage();
+    return 1;
+  }
+
+  std::vector<std::string> files;
+  if (isDirectory(input))
+    files = listPCDFiles(input);
+  else
+    files.push_back(input);
+  if (files.empty())
+  {
+    std::cerr << "No pcd files in " << input << std::endl;
+    return 1;
+  }
+
+#ifndef HAVE_NO_ROS
+  // The pipeline logs every stage. Only keep the warnings, they would dominate the timings
+  if (ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn))
+    ros::console::notifyLoggerLevelsChanged();
+#endif
+
+  std::vector<Statistics> statistics;
+  for (size_t f = 0; f < files.size(); f++)
+  {
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+    if (pcl::io::loadPCDFile<pcl::PointXYZRGB>(files[f], *cloud) == -1)
+    {
+      std::cerr << "Couldn't read file " << files[f] << std::endl;
+      return 1;
+    }
+
+    SuturoPerception sp;
+    for (size_t p = 0; p < parameters.size(); p++)
+    {
+      size_t split = parameters[p].find('=');
+      bool known = false;
+      try
+      {
+        known = split != std::string::npos &&
+          setParameter(sp, parameters[p].substr(0, split), parameters[p].substr(split + 1));
+      }
+      catch (boost::bad_lexical_cast &)
+      {
+      }
+      if (!known)
+      {
+        std::cerr << "Invalid parameter " << parameters[p] << std::endl;
+        return 1;
+      }
+    }
+
+    std::map<std::string, std::vector<double> > stage_samples;
+    std::vector<double> frame_samples, allocation_samples, object_samples;
+    for (int i = 0; i < warmup + iterations; i++)
+    {
+      MetricsRegistry::instance().setEnabled(!metrics_path.empty() && i >= warmup);
+      std::srand(seed);
+      boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+      sp.processCloudWithProjections(cloud);
+      boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
+      if (i < warmup)
+        continue;
+
+      SegmentationResult::ConstPtr result = sp.getLastResult();
+      for (std::map<std::string, double>::const_iterator it = result->stage_timings.begin();
+          it != result->stage_timings.end(); ++it)
+        stage_samples[it->first].push_back(it->second);
+      frame_samples.push_back((e - s).total_microseconds() / 1000.0);
+      allocation_samples.push_back(result->allocations);
+      object_samples.push_back(result->objects.size());
+    }
+
+    std::cout << files[f] << ": " << cloud->width << " x " << cloud->height << ", "
+      << iterations << " runs" << std::endl;
+    std::vector<Statistics> file_statistics;
+    for (std::map<std::string, std::vector<double> >::const_iterator it = stage_samples.begin();
+        it != stage_samples.end(); ++it)
+      file_statistics.push_back(computeStatistics(files[f], it->first, "ms", it->second));
+    file_statistics.push_back(computeStatistics(files[f], "FRAME", "ms", frame_samples));
+    file_statistics.push_back(computeStatistics(files[f], "allocations", "buffers", allocation_samples));
+    file_statistics.push_back(computeStatistics(files[f], "objects", "count", object_samples));
+    for (size_t i = 0; i < file_statistics.size(); i++)
+    {
+      const Statistics &s = file_statistics[i];
+      std::cout << "  " << s.stage << " [" << s.unit << "]: min " << s.min << ", median " << s.median
+        << ", p99 " << s.p99 << ", mean " << s.mean << " (" << s.runs << " runs)" << std::endl;
+    }
+    statistics.insert(statistics.end(), file_statistics.begin(), file_statistics.end());
+  }
+
+  if (!csv_path.empty())
+    writeCSV(csv_path, label, statistics);
+  if (!json_path.empty())
+    writeJSON(json_path, label, iterations, warmup, seed, parameters, statistics);
+  if (!metrics_path.empty())
+  {
+    std::ofstream out(metrics_path.c_str());
+    out << MetricsRegistry::instance().snapshot().toJSON() << std::endl;
+  }
+  return 0;
+}
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
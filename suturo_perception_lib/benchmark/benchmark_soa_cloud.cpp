@@ -0,0 +1,172 @@
+/**
+ * Microbenchmark for the geometric kernels on a SoACloud.
+ * Compares plane distance, projection, min/max and centroid on the
+ * separate coordinate arrays against their pcl equivalents on the
+ * PointXYZRGB cloud. The conversion to and from the SoACloud is
+ * measured on its own, so the gain can be weighed against it.
+ *
+ * Usage: benchmark_soa_cloud [file.pcd] [iterations]
+ */
+#include "point_cloud_operations.h"
+#include "soa_cloud.h"
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_types.h>
+#include <pcl/common/common.h>
+#include <pcl/common/centroid.h>
+#include <pcl/filters/project_inliers.h>
+#include <pcl/sample_consensus/sac_model_plane.h>
+#include <boost/lexical_cast.hpp>
+#include "boost/date_time/posix_time/posix_time.hpp"
+
+using namespace suturo_perception_lib;
+using namespace suturo_perception_utils;
+
+const double DISTANCE_THRESHOLD = 0.02;
+
+namespace
+{
+  boost::posix_time::ptime now()
+  {
+    return boost::posix_time::microsec_clock::local_time();
+  }
+
+  double msPerIteration(boost::posix_time::ptime s, int iterations)
+  {
+    return (now() - s).total_microseconds() / 1000.0 / iterations;
+  }
+
+  void report(const std::string &kernel, double pcl_ms, double soa_ms, const std::string &result)
+  {
+    std::cout << kernel << ": pcl " << pcl_ms << " ms, SoACloud " << soa_ms << " ms (speedup "
+      << pcl_ms / soa_ms << ")" << result << std::endl;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::string file = "box1.pcd";
+  int iterations = 100;
+  if (argc > 1)
+    file = argv[1];
+  if (argc > 2)
+    iterations = boost::lexical_cast<int>(argv[2]);
+
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in (new pcl::PointCloud<pcl::PointXYZRGB>);
+  if (pcl::io::loadPCDFile<pcl::PointXYZRGB>(file, *cloud_in) == -1)
+  {
+    std::cerr << "Couldn't read file " << file << std::endl;
+    return 1;
+  }
+  std::cout << "Cloud: " << cloud_in->width << " x " << cloud_in->height << ", "
+    << iterations << " iterations" << std::endl;
+
+  // The biggest plane of the scene, so the inlier sets have a realistic size
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_nanles (new pcl::PointCloud<pcl::PointXYZRGB>);
+  PointCloudOperations::removeNans(cloud_in, cloud_nanles);
+  pcl::PointIndices::Ptr plane_inliers (new pcl::PointIndices);
+  pcl::ModelCoefficients::Ptr coefficients (new pcl::ModelCoefficients);
+  PointCloudOperations::fitPlanarModel(cloud_nanles, plane_inliers, coefficients, 1000, DISTANCE_THRESHOLD);
+  if (coefficients->values.size() != 4)
+  {
+    std::cerr << "No plane in " << file << std::endl;
+    return 1;
+  }
+  Eigen::Vector4f plane(coefficients->values[0], coefficients->values[1],
+      coefficients->values[2], coefficients->values[3]);
+  pcl::IndicesPtr all_indices (new std::vector<int>(cloud_nanles->points.size()));
+  for (int i = 0; i < all_indices->size(); i++)
+    (*all_indices)[i] = i;
+
+  // conversion
+  SoACloud soa;
+  boost::posix_time::ptime s = now();
+  for (int i = 0; i < iterations; i++)
+    soa.fromPCL(*cloud_in);
+  double from_ms = msPerIteration(s, iterations);
+  pcl::PointCloud<pcl::PointXYZRGB> converted;
+  s = now();
+  for (int i = 0; i < iterations; i++)
+    soa.toPCL(converted);
+  double to_ms = msPerIteration(s, iterations);
+  std::cout << "fromPCL: " << from_ms << " ms, toPCL: " << to_ms << " ms" << std::endl;
+
+  // plane distance
+  pcl::SampleConsensusModelPlane<pcl::PointXYZRGB> model(cloud_in);
+  Eigen::VectorXf model_coefficients = plane;
+  std::vector<int> pcl_inliers;
+  s = now();
+  for (int i = 0; i < iterations; i++)
+    model.selectWithinDistance(model_coefficients, DISTANCE_THRESHOLD, pcl_inliers);
+  double pcl_ms = msPerIteration(s, iterations);
+  pcl::PointIndices::Ptr aos_inliers (new pcl::PointIndices);
+  s = now();
+  for (int i = 0; i < iterations; i++)
+    PointCloudOperations::scorePlanarModel(cloud_in, coefficients, DISTANCE_THRESHOLD, aos_inliers);
+  double aos_ms = msPerIteration(s, iterations);
+  std::vector<int> soa_inliers;
+  s = now();
+  for (int i = 0; i < iterations; i++)
+  {
+    soa_inliers.clear();
+    soa.selectWithinDistance(plane, DISTANCE_THRESHOLD, soa_inliers);
+  }
+  double soa_ms = msPerIteration(s, iterations);
+  report("selectWithinDistance", pcl_ms, soa_ms, ", " + boost::lexical_cast<std::string>(soa_inliers.size())
+      + " of " + boost::lexical_cast<std::string>(pcl_inliers.size()) + " inliers");
+  std::cout << "  scorePlanarModel on the PointXYZRGB cloud: " << aos_ms << " ms" << std::endl;
+
+  // projection of the whole cloud without NaNs
+  pcl::PointCloud<pcl::PointXYZRGB> pcl_projected;
+  pcl::ProjectInliers<pcl::PointXYZRGB> proj;
+  proj.setModelType(pcl::SACMODEL_PLANE);
+  proj.setInputCloud(cloud_nanles);
+  proj.setIndices(all_indices);
+  proj.setModelCoefficients(coefficients);
+  s = now();
+  for (int i = 0; i < iterations; i++)
+    proj.filter(pcl_projected);
+  pcl_ms = msPerIteration(s, iterations);
+  SoACloud nanles(*cloud_nanles), soa_projected;
+  s = now();
+  for (int i = 0; i < iterations; i++)
+    nanles.projectToPlane(plane, soa_projected);
+  soa_ms = msPerIteration(s, iterations);
+  report("projectToPlane", pcl_ms, soa_ms, "");
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr projected (new pcl::PointCloud<pcl::PointXYZRGB>);
+  pcl::PointIndices::Ptr object_indices (new pcl::PointIndices);
+  object_indices->indices = *all_indices;
+  s = now();
+  for (int i = 0; i < iterations; i++)
+    PointCloudOperations::projectToPlaneCoefficients(cloud_nanles, object_indices, coefficients, projected);
+  std::cout << "  projectToPlaneCoefficients with conversions: " << msPerIteration(s, iterations)
+    << " ms" << std::endl;
+
+  // bounding box
+  Eigen::Vector4f pcl_min, pcl_max, soa_min, soa_max;
+  s = now();
+  for (int i = 0; i < iterations; i++)
+    pcl::getMinMax3D(*cloud_in, pcl_min, pcl_max);
+  pcl_ms = msPerIteration(s, iterations);
+  s = now();
+  for (int i = 0; i < iterations; i++)
+    soa.getMinMax3D(soa_min, soa_max);
+  soa_ms = msPerIteration(s, iterations);
+  report("getMinMax3D", pcl_ms, soa_ms, ", max difference "
+      + boost::lexical_cast<std::string>(std::max((pcl_min - soa_min).cwiseAbs().maxCoeff(),
+          (pcl_max - soa_max).cwiseAbs().maxCoeff())));
+
+  // centroid
+  Eigen::Vector4f pcl_centroid, soa_centroid;
+  s = now();
+  for (int i = 0; i < iterations; i++)
+    pcl::compute3DCentroid(*cloud_in, pcl_centroid);
+  pcl_ms = msPerIteration(s, iterations);
+  s = now();
+  for (int i = 0; i < iterations; i++)
+    soa.compute3DCentroid(soa_centroid);
+  soa_ms = msPerIteration(s, iterations);
+  report("compute3DCentroid", pcl_ms, soa_ms, ", difference "
+      + boost::lexical_cast<std::string>((pcl_centroid - soa_centroid).norm()));
+  return 0;
+}
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
@@ -0,0 +1,66 @@
+#ifndef SUTURO_PERCEPTION_EUCLIDEAN_CLUSTERING_H
+#define SUTURO_PERCEPTION_EUCLIDEAN_CLUSTERING_H
+
+#include <vector>
+#include <stdint.h>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+
+namespace suturo_perception_lib
+{
+  /**
+   * Euclidean cluster extraction without a KdTree.
+   * The points are bucketed into cells with the size of the cluster tolerance,
+   * so neighbours can only be in the same or in one of the adjacent cells.
+   * The cells are processed in parallel and connected points are merged
+   * with a lock-free union-find.
+   *
+   * The result is the same as the one of pcl::EuclideanClusterExtraction:
+   * clusters between minClusterSize and maxClusterSize points, sorted by
+   * their size in descending order, with ascending indices.
+   */
+  class EuclideanClustering
+  {
+    public:
+      // threads <= 0 will use one thread per core
+      static void extract(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+          double clusterTolerance, int minClusterSize, int maxClusterSize,
+          std::vector<pcl::PointIndices> &clusters, int threads = 0);
+
+    private:
+      struct Cell
+      {
+        int ix, iy, iz;
+        int begin; // first point of the cell in the bucket list
+        int end;
+      };
+
+      // Hash table over the occupied cells
+      class CellGrid
+      {
+        public:
+          CellGrid(size_t expected_cells);
+          // Index of the cell, -1 if it's empty
+          int find(int ix, int iy, int iz) const;
+          int findOrInsert(int ix, int iy, int iz);
+          std::vector<Cell> cells;
+
+        private:
+          std::vector<int> table_;
+          size_t mask_;
+          size_t slot(int ix, int iy, int iz) const
+          {
+            return (((uint32_t)ix * 73856093u) ^ ((uint32_t)iy * 19349663u) ^ ((uint32_t)iz * 83492791u)) & mask_;
+          }
+      };
+
+      static int findRoot(volatile int *parent, int x);
+      static void unite(volatile int *parent, int a, int b);
+      static void connectCells(const pcl::PointCloud<pcl::PointXYZRGB> *cloud, const CellGrid *grid,
+          const std::vector<int> *buckets, float sqr_tolerance, int cell_begin, int cell_end, volatile int *parent);
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
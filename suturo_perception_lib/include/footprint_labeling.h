@@ -0,0 +1,54 @@
+#ifndef SUTURO_PERCEPTION_FOOTPRINT_LABELING_H
+#define SUTURO_PERCEPTION_FOOTPRINT_LABELING_H
+
+#include <vector>
+#include <stdint.h>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+#include <pcl/ModelCoefficients.h>
+
+namespace suturo_perception_lib
+{
+  /**
+   * Assignment of the points above a plane to the footprints of objects on it.
+   * The footprint of an object is the 2d convex hull of its cluster of points
+   * on the plane. All footprints are rasterized into a label map in the frame
+   * of the plane, so every point of the cloud only has to be checked against
+   * the footprint(s) below its cell.
+   *
+   * This gives the same points as one ExtractPolygonalPrismData per cluster,
+   * but with a single pass over the cloud. A point, that is above more than
+   * one footprint, belongs to the first of these clusters.
+   */
+  class FootprintLabeling
+  {
+    public:
+      // clusters reference the points of projected_cloud, that lie on the plane.
+      // object_indices[i] will contain the indices of all points of cloud_in between
+      // minHeight and maxHeight above the footprint of clusters[i]. The height is
+      // measured towards the origin of the sensor.
+      // Returns false, if the label map would get too big. Use
+      // PointCloudOperations::extractAllPointsAbovePointCloud in this case.
+      static bool extract(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+          const pcl::PointCloud<pcl::PointXYZRGB>::Ptr projected_cloud,
+          const std::vector<pcl::PointIndices> &clusters, const pcl::ModelCoefficients::Ptr plane,
+          double cellSize, double minHeight, double maxHeight,
+          std::vector<pcl::PointIndices> &object_indices);
+
+      // Upper limit for the number of cells in the label map
+      static const int MAX_CELLS = 4000000;
+
+    private:
+      struct Point2
+      {
+        float u, v;
+      };
+
+      static void convexHull(std::vector<Point2> &points, std::vector<Point2> &hull);
+      static bool insideHull(const std::vector<Point2> &hull, float u, float v);
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
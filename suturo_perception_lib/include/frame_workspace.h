@@ -0,0 +1,82 @@
+#ifndef SUTURO_PERCEPTION_FRAME_WORKSPACE_H
+#define SUTURO_PERCEPTION_FRAME_WORKSPACE_H
+
+#include <vector>
+#include <cstddef>
+#include <boost/shared_ptr.hpp>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+
+namespace suturo_perception_lib
+{
+  /**
+   * Pool of the intermediate clouds and index vectors of the frame processing.
+   * The buffers are kept over frames, so they keep their capacity and the
+   * processing of a frame doesn't need to allocate once the pool is warm.
+   *
+   * A buffer is only handed out again, if the pool holds the only reference
+   * to it. Buffers that end up in a published SegmentationResult stay untouched,
+   * until the last reader of the result drops them.
+   *
+   * The k-th buffer of a frame usually has the same job as the k-th buffer
+   * of the frame before, so it gets a free buffer that is atleast as big as
+   * the one of the last frame (best fit).
+   *
+   * Not threadsafe. Every SuturoPerception owns its own workspace.
+   */
+  class FrameWorkspace
+  {
+    public:
+      typedef pcl::PointCloud<pcl::PointXYZRGB> Cloud;
+
+      FrameWorkspace();
+
+      // Start and end a frame. endFrame() counts the allocations of the frame
+      void beginFrame();
+      void endFrame();
+
+      // An empty cloud or index vector with room for atleast reserve elements
+      Cloud::Ptr acquireCloud(size_t reserve = 0);
+      pcl::PointIndices::Ptr acquireIndices(size_t reserve = 0);
+
+      // Number of buffers, that had to be allocated or grown in the last frame.
+      // 0 means, that the frame was processed without heap allocations for its buffers.
+      int getLastFrameAllocations() const { return last_frame_allocations_; }
+      // Number of buffers owned by the pool
+      int getPoolSize() const { return clouds_.entries.size() + indices_.entries.size(); }
+
+      // Drop all buffers, that are not in use
+      void clear();
+
+      // Upper limit of buffers per type. More buffers are allocated without pooling
+      static const int MAX_POOLED = 256;
+
+      template <typename T>
+      struct Entry
+      {
+        boost::shared_ptr<T> buffer;
+        // The capacity, when the buffer was seen the last time
+        size_t capacity;
+      };
+
+      template <typename T>
+      struct Pool
+      {
+        std::vector<Entry<T> > entries;
+        // The entries handed out in the current frame, in order
+        std::vector<int> acquired;
+        // The capacities of the buffers handed out in the last frame, in order
+        std::vector<size_t> hints;
+      };
+
+    private:
+      Pool<Cloud> clouds_;
+      Pool<pcl::PointIndices> indices_;
+      int allocations_;
+      int last_frame_allocations_;
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
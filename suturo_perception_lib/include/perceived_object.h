@@ -1,21 +1,34 @@
 #ifndef PERCEIVED_OBJECT_H
 #define PERCEIVED_OBJECT_H
 
+#include <cassert>
+#include <string>
+#include <vector>
 #include "point.h"
 #include "roi.h"
 #include <pcl/point_types.h>
-#include <boost/signals2/mutex.hpp>
 #include "opencv2/core/core.hpp"
-#include <boost/thread.hpp>
 #include <suturo_perception_match_cuboid/cuboid.h>
 
 namespace suturo_perception_lib
 {
+  /**
+   * An object on the table and everything the capabilities found out about it.
+   *
+   * The object has two phases. While it is built, the segmentation and
+   * the capabilities fill in the fields. Every capability writes only its own
+   * group of fields (see below), so the capabilities of one object can run
+   * in parallel without a lock. After all of them are done, the object is frozen
+   * with freeze() and is read-only from then on. Calling a setter on a
+   * frozen object is a programming error.
+   */
   class PerceivedObject
   {
     public:
-      PerceivedObject() : mutex(new boost::signals2::mutex()) {
+      PerceivedObject() {
+        frozen_ = false;
         c_id = -1;
+        c_support_surface_id = -1;
         c_centroid.x = -1;
         c_centroid.y = -1;
         c_centroid.z = -1;
@@ -31,7 +44,9 @@ namespace suturo_perception_lib
         c_color_average_qs = -1;
         c_color_average_qv = -1;
         c_recognition_label_2d = "";
+        c_hue_histogram = NULL;
         c_hue_histogram_quality = 0;
+        c_hue_histogram_image = NULL;
         c_roi.origin.x = 0;
         c_roi.origin.y = 0;
         c_roi.width = 0;
@@ -43,246 +58,83 @@ namespace suturo_perception_lib
 
       };
 
-      // Threadsafe getters      
-      int get_c_id() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_id; 
-      };
-      
-      Point get_c_centroid() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        return c_centroid;
-      };
-      
-      double get_c_volume() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_volume;
-      };
-      
-      int get_c_shape() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_shape;
-      };
-      
-      uint8_t get_c_color_average_r() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_color_average_r;
-      };
-
-      uint8_t get_c_color_average_g() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_color_average_g; 
-      };
-
-      uint8_t get_c_color_average_b() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_color_average_b; 
-      };
-
-      uint32_t get_c_color_average_qh() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_color_average_qh; 
-      };
-
-      double get_c_color_average_qs() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_color_average_qs; 
-      };
-
-      double get_c_color_average_qv() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_color_average_qv; 
-      };
-
-      uint32_t get_c_color_average_h() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_color_average_h; 
-      };
-
-      double get_c_color_average_s() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_color_average_s; 
-      };
-
-      double get_c_color_average_v() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_color_average_v; 
-      };
-
-      std::string get_c_recognition_label_2d() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_recognition_label_2d; 
-      };
-
-      std::vector<uint32_t>* get_c_hue_histogram() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_hue_histogram; 
-      };
-
-      uint8_t get_c_hue_histogram_quality() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_hue_histogram_quality; 
-      };
+      // End the build phase. The object can't be modified afterwards
+      void freeze() { frozen_ = true; };
+      bool isFrozen() const { return frozen_; };
+
+      // Getters
+      int get_c_id() const { return c_id; };
+      int get_c_support_surface_id() const { return c_support_surface_id; };
+      const Point &get_c_centroid() const { return c_centroid; };
+      double get_c_volume() const { return c_volume; };
+      int get_c_shape() const { return c_shape; };
+      uint8_t get_c_color_average_r() const { return c_color_average_r; };
+      uint8_t get_c_color_average_g() const { return c_color_average_g; };
+      uint8_t get_c_color_average_b() const { return c_color_average_b; };
+      uint32_t get_c_color_average_qh() const { return c_color_average_qh; };
+      double get_c_color_average_qs() const { return c_color_average_qs; };
+      double get_c_color_average_qv() const { return c_color_average_qv; };
+      uint32_t get_c_color_average_h() const { return c_color_average_h; };
+      double get_c_color_average_s() const { return c_color_average_s; };
+      double get_c_color_average_v() const { return c_color_average_v; };
+      const std::string &get_c_recognition_label_2d() const { return c_recognition_label_2d; };
+      std::vector<uint32_t>* get_c_hue_histogram() const { return c_hue_histogram; };
+      uint8_t get_c_hue_histogram_quality() const { return c_hue_histogram_quality; };
+      cv::Mat *get_c_hue_histogram_image() const { return c_hue_histogram_image; };
+      const ROI &get_c_roi() const { return c_roi; };
+      const pcl::VFHSignature308 &get_c_vfhs() const { return c_vfhs; };
+      const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &get_pointCloud() const { return pointCloud; };
+      const Cuboid &get_c_cuboid() const { return c_cuboid; };
+
+      // Setters. Only allowed before freeze() is called.
+      // Segmentation
+      void set_c_id(int value) { assertBuilding(); c_id = value; };
+      void set_c_support_surface_id(int value) { assertBuilding(); c_support_surface_id = value; };
+      void set_c_centroid(const Point &value) { assertBuilding(); c_centroid = value; };
+      void set_c_volume(double value) { assertBuilding(); c_volume = value; };
+      void set_c_roi(const ROI &value) { assertBuilding(); c_roi = value; };
+      void set_pointCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &value) { assertBuilding(); pointCloud = value; };
+      // Shape detection
+      void set_c_shape(int value) { assertBuilding(); c_shape = value; };
+      // Color analysis
+      void set_c_color_average_r(uint8_t value) { assertBuilding(); c_color_average_r = value; };
+      void set_c_color_average_g(uint8_t value) { assertBuilding(); c_color_average_g = value; };
+      void set_c_color_average_b(uint8_t value) { assertBuilding(); c_color_average_b = value; };
+      void set_c_color_average_qh(uint32_t value) { assertBuilding(); c_color_average_qh = value; };
+      void set_c_color_average_qs(double value) { assertBuilding(); c_color_average_qs = value; };
+      void set_c_color_average_qv(double value) { assertBuilding(); c_color_average_qv = value; };
+      void set_c_color_average_h(uint32_t value) { assertBuilding(); c_color_average_h = value; };
+      void set_c_color_average_s(double value) { assertBuilding(); c_color_average_s = value; };
+      void set_c_color_average_v(double value) { assertBuilding(); c_color_average_v = value; };
+      void set_c_hue_histogram(std::vector<uint32_t> *value) { assertBuilding(); c_hue_histogram = value; };
+      void set_c_hue_histogram_quality(uint8_t value) { assertBuilding(); c_hue_histogram_quality = value; };
+      void set_c_hue_histogram_image(cv::Mat *histImg) { assertBuilding(); c_hue_histogram_image = histImg; };
+      // 2d recognition
+      void set_c_recognition_label_2d(const std::string &value) { assertBuilding(); c_recognition_label_2d = value; };
+      // VFH estimation
+      void set_c_vfhs(const pcl::VFHSignature308 &value) { assertBuilding(); c_vfhs = value; };
+      // Cuboid matching
+      void set_c_cuboid(const Cuboid &value) { assertBuilding(); c_cuboid = value; };
 
-      cv::Mat *get_c_hue_histogram_image() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_hue_histogram_image;
-      }
-
-      ROI get_c_roi() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_roi; 
-      };
-
-      pcl::VFHSignature308 get_c_vfhs() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_vfhs; 
-      };
-
-      pcl::PointCloud<pcl::PointXYZRGB>::Ptr get_pointCloud() const
+    private:
+      void assertBuilding() const
       {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return pointCloud; 
+        assert(!frozen_ && "PerceivedObject modified after freeze()");
       };
 
-      Cuboid get_c_cuboid() const
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex); 
-        return c_cuboid; 
-      };
+      bool frozen_;
 
-      // Threadsafe setters
-      void set_c_id(int value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_id = value;
-      };
-      void set_c_centroid(Point value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_centroid = value;
-      };
-      void set_c_volume(double value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_volume = value;
-      };
-      void set_c_shape(int value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_shape = value;
-      };
-      void set_c_color_average_r(uint8_t value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_color_average_r = value;
-      };
-      void set_c_color_average_g(uint8_t value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_color_average_g = value;
-      };
-      void set_c_color_average_b(uint8_t value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_color_average_b = value;
-      };
-      void set_c_color_average_qh(uint32_t value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_color_average_qh = value;
-      };
-      void set_c_color_average_qs(double value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_color_average_qs = value;
-      };
-      void set_c_color_average_qv(double value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_color_average_qv = value;
-      };
-      void set_c_color_average_h(uint32_t value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_color_average_h = value;
-      };
-      void set_c_color_average_s(double value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_color_average_s = value;
-      };
-      void set_c_color_average_v(double value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_color_average_v = value;
-      };
-      void set_c_recognition_label_2d(std::string value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_recognition_label_2d = value;
-      };
-      void set_c_hue_histogram(std::vector<uint32_t> *value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_hue_histogram = value;
-      };
-      void set_c_hue_histogram_quality(uint8_t value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_hue_histogram_quality = value;
-      };
-      void set_c_hue_histogram_image(cv::Mat *histImg)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_hue_histogram_image = histImg;
-      }
-      void set_c_roi(ROI value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_roi = value;
-      };
-      void set_c_vfhs(pcl::VFHSignature308 value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_vfhs = value;
-      };
-      void set_pointCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        pointCloud = value;
-      };
-    
-      void set_c_cuboid(Cuboid value)
-      {
-        boost::lock_guard<boost::signals2::mutex> lock(*mutex);
-        c_cuboid = value;
-      };
-    
-    private:
+      // Segmentation
       int c_id;
+      // Index of the surface in SegmentationResult::surface_clouds, that the object stands on
+      int c_support_surface_id;
       Point c_centroid;
       double c_volume;
+      ROI c_roi;
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr pointCloud;
+      // Shape detection
       int c_shape;
+      // Color analysis
       uint8_t c_color_average_r;
       uint8_t c_color_average_g;
       uint8_t c_color_average_b;
@@ -292,17 +144,15 @@ namespace suturo_perception_lib
       uint32_t c_color_average_qh;
       double c_color_average_qs;
       double c_color_average_qv;
-      std::string c_recognition_label_2d;
       std::vector<uint32_t> *c_hue_histogram;
       uint8_t c_hue_histogram_quality;
       cv::Mat *c_hue_histogram_image;
-      ROI c_roi;
+      // 2d recognition
+      std::string c_recognition_label_2d;
+      // VFH estimation
       pcl::VFHSignature308 c_vfhs;
-      pcl::PointCloud<pcl::PointXYZRGB>::Ptr pointCloud;
+      // Cuboid matching
       Cuboid c_cuboid;
-
-
-      boost::shared_ptr<boost::signals2::mutex> mutex;
   };
 }
 
@@ -0,0 +1,110 @@
+#ifndef SUTURO_PERCEPTION_PLANE_RANSAC_H
+#define SUTURO_PERCEPTION_PLANE_RANSAC_H
+
+#include <vector>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+#include <pcl/ModelCoefficients.h>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include "soa_cloud.h"
+
+namespace suturo_perception_lib
+{
+  /**
+   * Options of the plane RANSAC.
+   */
+  struct RansacOptions
+  {
+    RansacOptions() : confidence(0.99), guided(false), threads(0),
+      normal_prior(Eigen::Vector3f::Zero()), normal_tolerance(0.1745) {}
+
+    // Stop as soon as a sample without outliers has been drawn with this probability,
+    // estimated from the inlier ratio of the best plane so far. 1 always draws all samples
+    double confidence;
+    // Draw the first samples PROSAC style from the points closest to the sensor
+    bool guided;
+    // Threads, that score the hypotheses. <= 0 uses one thread per core
+    int threads;
+    // Expected normal of the plane, e.g. the up axis of the robot in the frame of the cloud.
+    // Both orientations match. The zero vector disables the prior
+    Eigen::Vector3f normal_prior;
+    // Maximum angle (rad) between the normal of a plane and normal_prior
+    double normal_tolerance;
+  };
+
+  /**
+   * RANSAC plane fitting with adaptive termination.
+   * A table covering 40% of the points is sampled without outliers with 99%
+   * confidence after about 70 samples, so the search usually ends long before
+   * the maximum number of iterations.
+   *
+   * The hypotheses are scored in batches. Every thread counts the inliers of all
+   * hypotheses of a batch on its block of the points, so a block stays in cache
+   * while it is scored. The samples are drawn by a single generator with a fixed
+   * seed, so the result doesn't depend on the number of threads.
+   *
+   * With guided sampling, the points are ranked by their distance to the sensor,
+   * whose noise grows with the distance. The ranking is split into PROSAC_GROUPS
+   * groups and the samples are drawn from a growing number of the best groups,
+   * following the growth function of PROSAC (Chum and Matas, 2005). Groups instead of
+   * single points let the sampled set grow fast enough for clouds with many points.
+   * After about maxIterations samples, the whole cloud is sampled uniformly.
+   *
+   * With a normal prior, hypotheses outside the tolerance are rejected before
+   * they are scored, so walls and cabinet fronts never win. The prior also seeds
+   * the sampling: the height of every point along the prior is sorted once, and
+   * the second and third point of a sample are drawn from the points, whose height
+   * is close to the one of the first point. A table point then mostly picks other
+   * table points instead of objects or walls, and the termination takes the
+   * inlier ratio within that height slab into account.
+   */
+  class PlaneRansac
+  {
+    public:
+      PlaneRansac(const RansacOptions &options = RansacOptions());
+
+      // Find the plane with the most points of cloud_in within distanceThreshold
+      // with atmost maxIterations samples. NaN points are ignored.
+      // The coefficients are normalized. Returns the number of inliers, 0 if no plane was found
+      int fit(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in, int maxIterations, double distanceThreshold,
+          pcl::PointIndices &inliers, pcl::ModelCoefficients &coefficients);
+
+      // Samples drawn by the last fit
+      int getIterations() const { return iterations_; }
+
+      // Samples needed to draw one without outliers with the given confidence, atmost maxIterations
+      static int requiredIterations(double inlierRatio, double confidence, int maxIterations);
+
+      // Samples needed to draw one without outliers with the given confidence, if the first
+      // point is an inlier with firstRatio and the others with otherRatio, atmost maxIterations
+      static int requiredIterations(double firstRatio, double otherRatio, double confidence, int maxIterations);
+
+      // Hypotheses, that are scored together
+      static const int BATCH_SIZE = 8;
+      // Points of a block, that is scored with all hypotheses of a batch at once
+      static const size_t SCORING_BLOCK_POINTS = 4096;
+      // Clouds below this size are scored by a single thread
+      static const size_t PARALLEL_SCORING_MIN_POINTS = 20000;
+      // Number of groups of the guided sampling
+      static const int PROSAC_GROUPS = 64;
+
+    private:
+      typedef std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> > Hypotheses;
+
+      // Shared by the scoring threads of a fit
+      struct Scoring;
+
+      // Count the inliers of all hypotheses on the points [begin, end)
+      static void scoreRange(const suturo_perception_utils::SoACloud *cloud, const Hypotheses *hypotheses,
+          float threshold, size_t begin, size_t end, std::vector<size_t> *counts);
+      static void scoringWorker(Scoring *scoring, int thread);
+
+      RansacOptions options_;
+      int iterations_;
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
@@ -0,0 +1,127 @@
+#ifndef SUTURO_PERCEPTION_POINT_CLOUD2_VIEW_H
+#define SUTURO_PERCEPTION_POINT_CLOUD2_VIEW_H
+
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+#include <pcl/point_types.h>
+
+namespace suturo_perception_lib
+{
+  /**
+   * Read-only strided view over the data buffer of a sensor_msgs::PointCloud2.
+   * Nothing is copied, so the view is only valid as long as the message
+   * is alive. Points are addressed by their index in the (possibly organized)
+   * cloud, like in a pcl::PointCloud.
+   */
+  class PointCloud2View
+  {
+    public:
+      PointCloud2View() : data_(NULL), width_(0), height_(0), point_step_(0), row_step_(0),
+        x_offset_(-1), y_offset_(-1), z_offset_(-1), rgb_offset_(-1), is_bigendian_(false) {}
+
+      /*
+       * Create a view on a sensor_msgs::PointCloud2 message.
+       * The message type is a template parameter to keep the lib
+       * independent from the message headers.
+       */
+      template <typename MessageT>
+      static PointCloud2View fromMessage(const MessageT &msg)
+      {
+        PointCloud2View view;
+        view.data_ = msg.data.empty() ? NULL : &msg.data[0];
+        view.width_ = msg.width;
+        view.height_ = msg.height;
+        view.point_step_ = msg.point_step;
+        view.row_step_ = msg.row_step;
+        view.is_bigendian_ = msg.is_bigendian;
+        for (size_t i = 0; i < msg.fields.size(); i++)
+        {
+          // x, y and z have to be floats. rgb is a packed float, rgba a packed uint32
+          if (msg.fields[i].name == "x" && msg.fields[i].datatype == FLOAT32)
+            view.x_offset_ = msg.fields[i].offset;
+          else if (msg.fields[i].name == "y" && msg.fields[i].datatype == FLOAT32)
+            view.y_offset_ = msg.fields[i].offset;
+          else if (msg.fields[i].name == "z" && msg.fields[i].datatype == FLOAT32)
+            view.z_offset_ = msg.fields[i].offset;
+          else if (msg.fields[i].name == "rgb" || msg.fields[i].name == "rgba")
+            view.rgb_offset_ = msg.fields[i].offset;
+        }
+        return view;
+      }
+
+      // true, if the buffer can be read as XYZ(RGB) points
+      bool isValid() const
+      {
+        return data_ != NULL && !is_bigendian_ && x_offset_ >= 0 && y_offset_ >= 0 && z_offset_ >= 0;
+      }
+      bool isOrganized() const { return height_ > 1; }
+      bool hasColor() const { return rgb_offset_ >= 0; }
+      uint32_t width() const { return width_; }
+      uint32_t height() const { return height_; }
+      size_t size() const { return static_cast<size_t>(width_) * height_; }
+
+      float z(size_t index) const { return readFloat(pointData(index), z_offset_); }
+
+      bool isFinite(size_t index) const
+      {
+        const uint8_t *p = pointData(index);
+        return pcl_isfinite(readFloat(p, x_offset_)) && pcl_isfinite(readFloat(p, y_offset_)) &&
+          pcl_isfinite(readFloat(p, z_offset_));
+      }
+
+      // Copy the point at index into p
+      void getPoint(size_t index, pcl::PointXYZRGB &p) const
+      {
+        readPoint(pointData(index), p);
+      }
+
+      // Same as above, but addressed by pixel. Avoids the division in loops over the grid
+      void getPoint(uint32_t row, uint32_t column, pcl::PointXYZRGB &p) const
+      {
+        readPoint(data_ + row * row_step_ + column * point_step_, p);
+      }
+
+    private:
+      // sensor_msgs::PointField::FLOAT32
+      static const uint8_t FLOAT32 = 7;
+
+      const uint8_t *data_;
+      uint32_t width_;
+      uint32_t height_;
+      uint32_t point_step_;
+      uint32_t row_step_;
+      int x_offset_;
+      int y_offset_;
+      int z_offset_;
+      int rgb_offset_;
+      bool is_bigendian_;
+
+      const uint8_t *pointData(size_t index) const
+      {
+        return data_ + (index / width_) * row_step_ + (index % width_) * point_step_;
+      }
+
+      void readPoint(const uint8_t *d, pcl::PointXYZRGB &p) const
+      {
+        p.x = readFloat(d, x_offset_);
+        p.y = readFloat(d, y_offset_);
+        p.z = readFloat(d, z_offset_);
+        if (rgb_offset_ >= 0)
+          memcpy(&p.rgba, d + rgb_offset_, sizeof(uint32_t));
+        else
+          p.rgba = 0;
+      }
+
+      // The buffer carries no alignment guarantees
+      static float readFloat(const uint8_t *p, int offset)
+      {
+        float f;
+        memcpy(&f, p + offset, sizeof(float));
+        return f;
+      }
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
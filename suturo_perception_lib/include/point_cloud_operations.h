@@ -15,7 +15,17 @@
 #include <pcl/ModelCoefficients.h>
 
 #include "suturo_perception_utils.h"
+#include "metrics_registry.h"
+#include "soa_cloud.h"
+#include "threadsafe_hull.h"
 #include "roi.h"
+#include "point_cloud2_view.h"
+#include "processing_region.h"
+#include "voxel_hash_grid.h"
+#include "euclidean_clustering.h"
+#include "raster_clustering.h"
+#include "footprint_labeling.h"
+#include "plane_ransac.h"
 #include <pcl/sample_consensus/method_types.h>
 #include <pcl/sample_consensus/model_types.h>
 #include <pcl/segmentation/sac_segmentation.h>
@@ -38,6 +48,10 @@
 #include <pcl/segmentation/sac_segmentation.h>
 #include <pcl/segmentation/extract_clusters.h>
 #include <pcl/surface/convex_hull.h>
+#include <pcl/features/integral_image_normal.h>
+#include <pcl/segmentation/organized_multi_plane_segmentation.h>
+#include <pcl/common/centroid.h>
+#include <pcl/common/eigen.h>
 
 namespace suturo_perception_lib
 {
@@ -58,18 +72,92 @@ namespace suturo_perception_lib
           pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out,
           pcl::PassThrough<pcl::PointXYZRGB> &pass,
           float zAxisFilterMin, float zAxisFilterMax);
+      // Hash based voxel grid with the results of a pcl::VoxelGrid. Big clouds are voxelized in parallel
       static void downsample(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
                       pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, float downsampleLeafSize);
+      // Variants that read directly from the buffer of a PointCloud2 message.
+      // Only the filtered points are copied into cloud_out.
+      static void removeNans(const PointCloud2View &view,
+          pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_nanles);
+      // Points outside of [zAxisFilterMin, zAxisFilterMax] will be set to NaN, if
+      // keepOrganized is true. Otherwise, only finite points in the range are kept.
+      static void filterZAxis(const PointCloud2View &view,
+          pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out,
+          float zAxisFilterMin, float zAxisFilterMax, bool keepOrganized);
+      static void downsample(const PointCloud2View &view,
+                      pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, float downsampleLeafSize);
+      // z-filter, NaN removal and downsampling in a single pass over the input.
+      // cloud_filtered gets the dense filtered points, removed_indices_filtered their index in the input.
+      // Points outside of region are skipped
+      static void filterAndDownsample(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+          pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered, std::vector<int> &removed_indices_filtered,
+          pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_downsampled,
+          float zAxisFilterMin, float zAxisFilterMax, float downsampleLeafSize,
+          const ProcessingRegion &region = ProcessingRegion());
+      static void filterAndDownsample(const PointCloud2View &view,
+          pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered, std::vector<int> &removed_indices_filtered,
+          pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_downsampled,
+          float zAxisFilterMin, float zAxisFilterMax, float downsampleLeafSize,
+          const ProcessingRegion &region = ProcessingRegion());
+      // z-filter of the pixel ROI of an organized cloud. cloud_out is organized with the size of the ROI,
+      // filtered points are NaN. pixel_indices maps the points of cloud_out to their index in the input
+      static void cropOrganized(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+          const ProcessingRegion &region, float zAxisFilterMin, float zAxisFilterMax,
+          pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, std::vector<int> &pixel_indices);
+      static void cropOrganized(const PointCloud2View &view,
+          const ProcessingRegion &region, float zAxisFilterMin, float zAxisFilterMax,
+          pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, std::vector<int> &pixel_indices);
+      // RANSAC with adaptive termination (see PlaneRansac), followed by a least-squares fit on the inliers
       static void fitPlanarModel(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
             pcl::PointIndices::Ptr inliers, pcl::ModelCoefficients::Ptr coefficients, 
             int planeMaxIterations, 
+            double planeDistanceThreshold, const RansacOptions &ransac = RansacOptions());
+      // RANSAC on cloud_in voxelized with coarseLeafSize, followed by least-squares fits on
+      // the inliers in cloud_full (e.g. the cloud before downsampling).
+      // inliers reference cloud_in, full_inliers cloud_full.
+      static void fitPlanarModelCoarseToFine(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+            const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_full,
+            pcl::PointIndices::Ptr inliers, pcl::PointIndices::Ptr full_inliers,
+            pcl::ModelCoefficients::Ptr coefficients,
+            int planeMaxIterations, double planeDistanceThreshold, float coarseLeafSize,
+            const RansacOptions &ransac = RansacOptions());
+      // Segment the biggest plane directly on the pixel grid of an organized cloud.
+      // The normals are computed with integral images and the planes are grown
+      // as connected components, so the returned plane (cloud_out) is already clustered.
+      // The inliers reference the organized cloud_in.
+      static bool fitPlanarModelOrganized(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+            pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out,
+            pcl::PointIndices::Ptr inliers, pcl::ModelCoefficients::Ptr coefficients,
+            int planeMinInliers, double planeAngularThreshold,
             double planeDistanceThreshold);
+      // Select every point of cloud_in within planeDistanceThreshold of the plane
+      // given by coefficients. Returns the number of inliers.
+      static int scorePlanarModel(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+            const pcl::ModelCoefficients::Ptr coefficients, double planeDistanceThreshold,
+            pcl::PointIndices::Ptr inliers);
+      // Same for a cloud, that is scored repeatedly and has been copied into a SoACloud once
+      static int scorePlanarModel(const suturo_perception_utils::SoACloud &cloud_in,
+            const pcl::ModelCoefficients::Ptr coefficients, double planeDistanceThreshold,
+            pcl::PointIndices::Ptr inliers);
+      // Least-squares fit of the plane in coefficients to the given inliers.
+      // The orientation of the normal is kept.
+      static void refinePlanarModel(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+            const pcl::PointIndices::Ptr inliers, pcl::ModelCoefficients::Ptr coefficients);
       static void extractInliersFromPointCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
           pcl::PointIndices::Ptr inliers, pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, bool setNegative);
       static bool extractBiggestCluster(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
           pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, const pcl::PointIndices::Ptr old_inliers,
           pcl::PointIndices::Ptr new_inliers, double ecClusterTolerance,
           int ecMinClusterSize, int ecMaxClusterSize);
+      // Find up to maxSurfaces support surfaces with atleast minInliers points, that are parallel
+      // (within maxAngle) to the normal prior of ransac, or to the biggest plane without a prior.
+      // The surfaces are the connected parts of the planes. Their normals point up.
+      // The indices of every removed plane point go to plane_points.
+      static int fitSupportSurfaces(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+          int maxSurfaces, int minInliers, double maxAngle, int planeMaxIterations, double planeDistanceThreshold,
+          double clusterTolerance, std::vector<pcl::PointIndices> &surfaces,
+          std::vector<pcl::ModelCoefficients::Ptr> &coefficients, pcl::PointIndices &plane_points,
+          const RansacOptions &ransac = RansacOptions());
       static void extractAllPointsAbovePointCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in, 
           const pcl::PointCloud<pcl::PointXYZRGB>::Ptr hull_cloud, 
           pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out,
@@ -78,6 +166,11 @@ namespace suturo_perception_lib
       static void projectToPlaneCoefficients(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
           pcl::PointIndices::Ptr object_indices, pcl::ModelCoefficients::Ptr coefficients,
           pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out);
+
+      // Number of least-squares fits of the coarse plane on the full resolution points
+      static const int COARSE_TO_FINE_REFINEMENTS = 2;
+      // Upper limit of planes, that fitSupportSurfaces removes (surfaces and others)
+      static const int MAX_SURFACE_PLANES = 16;
   };
 }
 
@@ -0,0 +1,84 @@
+#ifndef SUTURO_PERCEPTION_PROCESSING_REGION_H
+#define SUTURO_PERCEPTION_PROCESSING_REGION_H
+
+#include <cfloat>
+#include <algorithm>
+#include <stdint.h>
+#include <Eigen/Core>
+#include "roi.h"
+
+namespace suturo_perception_lib
+{
+  /**
+   * The part of a frame, that is processed.
+   * pixels restricts organized clouds to a rectangle of the pixel grid,
+   * the crop box restricts the positions of the points (in the frame of the cloud).
+   * Both are optional. An empty region covers the whole frame.
+   */
+  class ProcessingRegion
+  {
+    public:
+      ProcessingRegion() : use_pixels(false), use_box(false),
+        box_min(-FLT_MAX, -FLT_MAX, -FLT_MAX), box_max(FLT_MAX, FLT_MAX, FLT_MAX)
+      {
+        pixels.origin.x = 0;
+        pixels.origin.y = 0;
+        pixels.width = 0;
+        pixels.height = 0;
+      }
+
+      void setPixels(const ROI &roi) { pixels = roi; use_pixels = true; }
+      void setBox(const Eigen::Vector3f &min, const Eigen::Vector3f &max)
+      {
+        box_min = min;
+        box_max = max;
+        use_box = true;
+      }
+      void clearPixels() { use_pixels = false; }
+      void clearBox()
+      {
+        box_min = Eigen::Vector3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        box_max = Eigen::Vector3f(FLT_MAX, FLT_MAX, FLT_MAX);
+        use_box = false;
+      }
+
+      bool isEmpty() const { return !use_pixels && !use_box; }
+
+      // The rectangle [column_begin, column_end) x [row_begin, row_end), that has to be read
+      // from a frame of the given size. The pixel ROI only applies to organized frames
+      void pixelRange(uint32_t width, uint32_t height, uint32_t &column_begin, uint32_t &column_end,
+          uint32_t &row_begin, uint32_t &row_end) const
+      {
+        column_begin = 0;
+        column_end = width;
+        row_begin = 0;
+        row_end = height;
+        if (!use_pixels || height <= 1)
+          return;
+        column_begin = clamp(pixels.origin.x, width);
+        column_end = std::max(column_begin, clamp(pixels.origin.x + pixels.width, width));
+        row_begin = clamp(pixels.origin.y, height);
+        row_end = std::max(row_begin, clamp(pixels.origin.y + pixels.height, height));
+      }
+
+      // Restrict pixels to organized clouds
+      bool use_pixels;
+      ROI pixels;
+      // Restrict the points to the box [box_min, box_max].
+      // Without a box, the bounds are +-FLT_MAX, so only infinite points fall out
+      bool use_box;
+      Eigen::Vector3f box_min;
+      Eigen::Vector3f box_max;
+
+    private:
+      static uint32_t clamp(int v, uint32_t size)
+      {
+        if (v < 0)
+          return 0;
+        return std::min<uint32_t>(v, size);
+      }
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
@@ -0,0 +1,40 @@
+#ifndef SUTURO_PERCEPTION_RASTER_CLUSTERING_H
+#define SUTURO_PERCEPTION_RASTER_CLUSTERING_H
+
+#include <vector>
+#include <stdint.h>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+#include <pcl/ModelCoefficients.h>
+
+namespace suturo_perception_lib
+{
+  /**
+   * Clustering of points, that have been projected onto a plane.
+   * The points are rasterized into a 2d occupancy grid in the frame of the plane
+   * with cells of the size of the cluster tolerance. Occupied cells, that
+   * touch each other (8-neighbourhood), belong to the same cluster.
+   * So points up to 2 * sqrt(2) * clusterTolerance apart can be merged, while
+   * the EuclideanClustering keeps them apart beyond clusterTolerance.
+   * This is linear in the number of points and cells and doesn't depend
+   * on the density of the points.
+   *
+   * The output format is the same as the one of EuclideanClustering.
+   */
+  class RasterClustering
+  {
+    public:
+      // Returns false, if the raster would get too big for the extent of the points.
+      // Use the 3d EuclideanClustering in this case.
+      static bool extract(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+          const pcl::ModelCoefficients::Ptr plane, double clusterTolerance,
+          int minClusterSize, int maxClusterSize, std::vector<pcl::PointIndices> &clusters);
+
+      // Upper limit for the number of cells in the raster
+      static const int MAX_CELLS = 4000000;
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
@@ -0,0 +1,62 @@
+#ifndef SUTURO_PERCEPTION_SCENE_CHANGE_DETECTOR_H
+#define SUTURO_PERCEPTION_SCENE_CHANGE_DETECTOR_H
+
+#include <vector>
+#include <stdint.h>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include "point_cloud2_view.h"
+
+namespace suturo_perception_lib
+{
+  /**
+   * Cheap test, if an organized frame differs from a reference frame.
+   * Only every step-th pixel of every step-th row is compared. A sample
+   * has changed, if its depth moved by more than the depth threshold, it
+   * became valid or invalid, or one of its color channels moved by more
+   * than the color threshold.
+   *
+   * The samples of the frame, that has been compared last, are kept until
+   * the next comparison. acceptFrame() makes them the reference, so frames
+   * are always compared to the last frame, that has actually been processed.
+   */
+  class SceneChangeDetector
+  {
+    public:
+      SceneChangeDetector();
+
+      void setSampleStep(int step) { step_ = step < 1 ? 1 : step; reset(); }
+      void setDepthThreshold(float meters) { depth_threshold_ = meters; }
+      void setColorThreshold(int threshold) { color_threshold_ = threshold; }
+
+      // Fraction of the samples, that changed against the reference. 1, if the frame
+      // can't be compared (no reference, unorganized or of a different size)
+      float changedFraction(const pcl::PointCloud<pcl::PointXYZRGB> &cloud);
+      float changedFraction(const PointCloud2View &view);
+
+      // Use the last compared frame as reference
+      void acceptFrame();
+      // Forget the reference. The next frame counts as changed
+      void reset();
+
+    private:
+      float compare() const;
+
+      int step_;
+      float depth_threshold_;
+      int color_threshold_;
+
+      // Samples of the last compared frame and of the reference frame
+      std::vector<float> depth_;
+      std::vector<uint32_t> color_;
+      uint32_t width_;
+      uint32_t height_;
+      std::vector<float> reference_depth_;
+      std::vector<uint32_t> reference_color_;
+      uint32_t reference_width_;
+      uint32_t reference_height_;
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
@@ -0,0 +1,71 @@
+#ifndef SUTURO_PERCEPTION_SEGMENTATION_RESULT_H
+#define SUTURO_PERCEPTION_SEGMENTATION_RESULT_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include "boost/date_time/posix_time/posix_time.hpp"
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/ModelCoefficients.h>
+#include "opencv2/core/core.hpp"
+#include <Eigen/StdVector>
+#include "perceived_object.h"
+#include "roi.h"
+
+namespace suturo_perception_lib
+{
+  /**
+   * Everything the segmentation of a single frame produced.
+   * A result is built completely before it gets published by SuturoPerception
+   * and is never changed afterwards. Readers can share it without locks or copies.
+   */
+  struct SegmentationResult
+  {
+    typedef boost::shared_ptr<SegmentationResult> Ptr;
+    typedef boost::shared_ptr<const SegmentationResult> ConstPtr;
+
+    SegmentationResult() : frame_width(0), frame_height(0), reused(false), allocations(0) {}
+
+    // The time, when the processing of the frame started
+    boost::posix_time::ptime stamp;
+    // true, if the frame didn't change and everything below has been taken
+    // over from the result of an earlier frame. computed_stamp is the stamp
+    // of the frame, that has actually been segmented
+    bool reused;
+    boost::posix_time::ptime computed_stamp;
+    // Dimensions of the frame. The ROIs are in pixels of this frame
+    uint32_t frame_width;
+    uint32_t frame_height;
+
+    std::vector<PerceivedObject, Eigen::aligned_allocator<PerceivedObject> > objects;
+    // The image, mask and ROI of every object cluster
+    std::vector<cv::Mat> cluster_images;
+    std::vector<cv::Mat> cluster_masks;
+    std::vector<ROI> cluster_rois;
+
+    // The cloud of the segmented table and the cloud of everything above it
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr plane_cloud;
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr objects_on_plane_cloud;
+    pcl::ModelCoefficients::Ptr table_coefficients;
+    // Every support surface and its plane. The first one is the table above.
+    // PerceivedObject::get_c_support_surface_id() is an index into these
+    std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> surface_clouds;
+    std::vector<pcl::ModelCoefficients::Ptr> surface_coefficients;
+
+    // Milliseconds spent in every stage of the segmentation of this frame,
+    // keyed by the metric name of the stage (e.g. "perception_lib/cluster_projection").
+    // A stage, that ran more than once (e.g. once per object), has the sum of its runs
+    std::map<std::string, double> stage_timings;
+    // Number of intermediate buffers, that had to be allocated or grown for this frame
+    int allocations;
+    // The stages, that have been taken over from the last run on the same frame
+    // (see SuturoPerception::reprocessLastFrame). They have no timings
+    std::vector<std::string> reused_stages;
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
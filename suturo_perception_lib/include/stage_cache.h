@@ -0,0 +1,73 @@
+#ifndef SUTURO_PERCEPTION_STAGE_CACHE_H
+#define SUTURO_PERCEPTION_STAGE_CACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+
+namespace suturo_perception_lib
+{
+  /**
+   * Bookkeeping for the cached stages of the segmentation.
+   * Every stage is keyed by the versions of the stages it reads from and the
+   * parameters it uses. If a stage is looked up with the same key as in its last
+   * run, its output can be reused. Otherwise it has to run again and gets a new
+   * version, which changes the keys of all stages downstream of it.
+   *
+   * Only the keys are kept here. The outputs belong to the owner of the stages.
+   */
+  class StageCache
+  {
+    public:
+      // Key of a stage, built from everything that can be written to a stream
+      class Key
+      {
+        public:
+          Key() { stream_.precision(17); }
+          template <typename T>
+          Key &operator<<(const T &value) { stream_ << value << ';'; return *this; }
+          std::string str() const { return stream_.str(); }
+
+        private:
+          std::ostringstream stream_;
+      };
+
+      StageCache();
+
+      // true, if stage ran with key before and its output can be reused.
+      // Otherwise the key is stored and the stage gets a new version.
+      // A disabled cache never reuses a stage
+      bool reuse(const std::string &stage, const Key &key);
+      // Version of the output of stage. 0, if it never ran
+      unsigned long version(const std::string &stage) const;
+      // Run stage again on its next lookup, e.g. because it failed
+      void invalidate(const std::string &stage);
+      // Forget all stages, e.g. because a new frame arrived
+      void clear();
+
+      // Start a run over the stages. Resets the list of reused stages
+      void beginRun() { reused_.clear(); }
+      // The stages, that have been reused in the current run
+      const std::vector<std::string> &getReusedStages() const { return reused_; }
+
+      void setEnabled(bool enabled) { enabled_ = enabled; }
+      bool isEnabled() const { return enabled_; }
+
+    private:
+      struct Entry
+      {
+        std::string key;
+        unsigned long version;
+      };
+
+      bool enabled_;
+      // Versions are never handed out twice, not even after clear()
+      unsigned long next_version_;
+      std::map<std::string, Entry> entries_;
+      std::vector<std::string> reused_;
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
@@ -2,6 +2,7 @@
 #define SUTURO_PERCEPTION_H
 
 #include <iostream>
+#include <map>
 
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
@@ -13,9 +14,16 @@
 #include <pcl/filters/crop_hull.h>
 #include <pcl/filters/passthrough.h>
 #include <pcl/ModelCoefficients.h>
+#include <pcl/common/common.h>
 
 #include "suturo_perception_utils.h"
+#include "metrics_registry.h"
 #include "point_cloud_operations.h"
+#include "segmentation_result.h"
+#include "frame_workspace.h"
+#include "processing_region.h"
+#include "scene_change_detector.h"
+#include "stage_cache.h"
 #include "roi.h"
 #include "perceived_object.h"
 #include "point.h"
@@ -80,8 +88,17 @@ namespace suturo_perception_lib
     SuturoPerception();
     // void processCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in);
 		void processCloudWithProjections(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in);
+    // Process the data of a PointCloud2 message without converting it first
+    void processCloudWithProjections(const PointCloud2View &view);
+    // The result of the last processed frame. It is never NULL and will not change,
+    // so all of its members belong to the same frame
+    SegmentationResult::ConstPtr getLastResult();
+
+    // Copies of parts of the last result
     std::vector<PerceivedObject, Eigen::aligned_allocator<PerceivedObject> > getPerceivedObjects();
     std::vector<cv::Mat> getPerceivedClusterImages();
+    // Binary masks (255 = object) of the cluster images. Only filled, if enabled with setComputeClusterMasks
+    std::vector<cv::Mat> getPerceivedClusterMasks();
     std::vector<ROI> getPerceivedClusterROIs();
 
     // Get the cloud that is the basis for the object extraction
@@ -89,7 +106,7 @@ namespace suturo_perception_lib
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr getObjectsOnPlaneCloud();
 
     // TODO Refactor method to a result struct
-		void clusterFromProjection(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters, pcl::PointCloud<pcl::PointXYZRGB>::Ptr original_cloud, std::vector<int> *removed_indices_filtered, std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &extracted_objects, std::vector<cv::Mat> &extracted_images, std::vector<ROI> &perceived_cluster_rois_);
+		void clusterFromProjection(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters, pcl::PointCloud<pcl::PointXYZRGB>::Ptr original_cloud, std::vector<int> *removed_indices_filtered, std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &extracted_objects, std::vector<cv::Mat> &extracted_images, std::vector<cv::Mat> &extracted_masks, std::vector<ROI> &perceived_cluster_rois_);
 
     void extractAllPointsAbovePointCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr hull_cloud, pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, pcl::PointIndices::Ptr object_indices, int convex_hull_dimension);
 
@@ -114,6 +131,33 @@ namespace suturo_perception_lib
     void setEcObjClusterTolerance(double v) {ecObjClusterTolerance = v;};
     void setEcObjMinClusterSize(int v) {ecObjMinClusterSize = v;};
     void setEcObjMaxClusterSize(int v) {ecObjMaxClusterSize = v;};
+    void setOrganizedSegmentation(bool v) {organizedSegmentation = v;};
+    void setPlaneTracking(bool v) {planeTracking = v;};
+    void setPlaneTrackingMinInlierRatio(double v) {planeTrackingMinInlierRatio = v;};
+    void setOrganizedPlaneMinInliers(int v) {organizedPlaneMinInliers = v;};
+    void setOrganizedPlaneAngularThreshold(double v) {organizedPlaneAngularThreshold = v;};
+    void setRasterObjectClustering(bool v) {rasterObjectClustering = v;};
+    void setCoarsePlaneFitting(bool v) {coarsePlaneFitting = v;};
+    void setCoarsePlaneLeafSize(double v) {coarsePlaneLeafSize = v;};
+    void setAutoROI(bool v) {autoROI = v;};
+    void setAutoROIMargin(double v) {autoROIMargin = v;};
+    void setAutoROIPixelMargin(int v) {autoROIPixelMargin = v;};
+    void setSceneChangeGating(bool v) {sceneChangeGating = v;};
+    void setSceneChangeMaxFraction(double v) {sceneChangeMaxFraction = v;};
+    void setSceneChangeDepthThreshold(double v) {sceneChangeDepthThreshold = v;};
+    void setSceneChangeColorThreshold(int v) {sceneChangeColorThreshold = v;};
+    void setMultiSurfaceSegmentation(bool v) {multiSurfaceSegmentation = v;};
+    void setSurfaceMaxCount(int v) {surfaceMaxCount = v;};
+    void setSurfaceMinInliers(int v) {surfaceMinInliers = v;};
+    void setSurfaceMaxAngle(double v) {surfaceMaxAngle = v;};
+    void setStageCaching(bool v) {stageCaching = v; stage_cache_.setEnabled(v);};
+    void setPlaneRansacConfidence(double v) {planeRansacConfidence = v;};
+    void setPlaneRansacGuided(bool v) {planeRansacGuided = v;};
+    void setPlaneRansacThreads(int v) {planeRansacThreads = v;};
+    void setPlaneNormalTolerance(double v) {planeNormalTolerance = v;};
+    // Expected normal of the table in the frame of the clouds, e.g. the up axis of the robot.
+    // The zero vector searches planes of every orientation
+    void setPlaneNormalPrior(const Eigen::Vector3f &v) {planeNormalPrior = v;};
 
     // Set the input cloud, that has been used for the computation.
     // You can keep that as a reference, to work with the original cloud later
@@ -134,9 +178,43 @@ namespace suturo_perception_lib
     double getEcObjClusterTolerance() {return ecObjClusterTolerance;};
     int getEcObjMinClusterSize() {return ecObjMinClusterSize;};
     int getEcObjMaxClusterSize() {return ecObjMaxClusterSize;};
+    bool getOrganizedSegmentation() {return organizedSegmentation;};
+    bool getPlaneTracking() {return planeTracking;};
+    double getPlaneTrackingMinInlierRatio() {return planeTrackingMinInlierRatio;};
+    int getOrganizedPlaneMinInliers() {return organizedPlaneMinInliers;};
+    double getOrganizedPlaneAngularThreshold() {return organizedPlaneAngularThreshold;};
+    bool getRasterObjectClustering() {return rasterObjectClustering;};
+    bool getCoarsePlaneFitting() {return coarsePlaneFitting;};
+    double getCoarsePlaneLeafSize() {return coarsePlaneLeafSize;};
+    bool getAutoROI() {return autoROI;};
+    double getAutoROIMargin() {return autoROIMargin;};
+    int getAutoROIPixelMargin() {return autoROIPixelMargin;};
+    bool getSceneChangeGating() {return sceneChangeGating;};
+    double getSceneChangeMaxFraction() {return sceneChangeMaxFraction;};
+    double getSceneChangeDepthThreshold() {return sceneChangeDepthThreshold;};
+    int getSceneChangeColorThreshold() {return sceneChangeColorThreshold;};
+    bool getMultiSurfaceSegmentation() {return multiSurfaceSegmentation;};
+    int getSurfaceMaxCount() {return surfaceMaxCount;};
+    int getSurfaceMinInliers() {return surfaceMinInliers;};
+    double getSurfaceMaxAngle() {return surfaceMaxAngle;};
+    bool getStageCaching() {return stageCaching;};
+    double getPlaneRansacConfidence() {return planeRansacConfidence;};
+    bool getPlaneRansacGuided() {return planeRansacGuided;};
+    int getPlaneRansacThreads() {return planeRansacThreads;};
+    double getPlaneNormalTolerance() {return planeNormalTolerance;};
+    Eigen::Vector3f getPlaneNormalPrior() {return planeNormalPrior;};
 
     // Get the received point cloud, that you are working on
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr getOriginalCloud(){ return original_cloud_;}
+    uint32_t getFrameWidth(){ return frame_width_;}
+    uint32_t getFrameHeight(){ return frame_height_;}
+    // Number of intermediate buffers, that had to be allocated or grown for the last frame.
+    // Stays at 0 once the workspace is warm and the scene doesn't change much
+    int getFrameAllocations(){ return getLastResult()->allocations;}
+    // Milliseconds spent in the stages of the last frame, see SegmentationResult::stage_timings
+    std::map<std::string, double> getLastStageTimings(){ return getLastResult()->stage_timings;}
+    // Give the pooled buffers of the frame processing back to the system
+    void releaseWorkspace(){ workspace_.clear();}
     // Get the received rgb image, that you are working on
     boost::shared_ptr<cv::Mat> getOriginalRGBImage(){ return original_rgb_image_;}
 
@@ -145,6 +223,36 @@ namespace suturo_perception_lib
 
     // Flag for volume calculation on the hull of a point cluster
     void setCalculateHullVolume(bool c){ calculateHullVolume_ = c; }
+    // Flag for the computation of a mask image for every cluster image
+    void setComputeClusterMasks(bool c){ computeClusterMasks_ = c; }
+
+    // Forget the table plane of the last frame. The next frame
+    // will run the full plane search again (e.g. after the robot moved)
+    void resetPlaneTracking(){ tracked_plane_.reset(); tracked_inlier_ratio_ = 0; }
+
+    // Only process the given pixels of organized clouds and the points inside of the box.
+    // The box is in the frame of the input cloud
+    void setPixelROI(const ROI &roi){ region_.setPixels(roi); }
+    void clearPixelROI(){ region_.clearPixels(); }
+    void setCropBox(const Eigen::Vector3f &min, const Eigen::Vector3f &max){ region_.setBox(min, max); }
+    void clearCropBox(){ region_.clearBox(); }
+    // The region, that the next frame will be restricted to. With autoROI, this is the
+    // region around the table of the last frame, if there was one
+    const ProcessingRegion &getProcessingRegion() const
+    {
+      return autoROI && !auto_region_.isEmpty() ? auto_region_ : region_;
+    }
+    // Forget the frame, that unchanged frames are compared to. The next frame is segmented again
+    void resetSceneChange(){ scene_change_.reset(); }
+    // Forget the region around the last table. The next frame uses the explicit region again
+    void resetAutoROI(){ auto_region_ = ProcessingRegion(); }
+
+    // Segment the last frame again with the current parameters, e.g. after a reconfiguration.
+    // Only the stages, whose inputs or parameters changed, run again. Returns false, if
+    // stageCaching is disabled or no frame has been processed since it has been enabled
+    bool reprocessLastFrame();
+    // Forget the intermediate results of the last frame
+    void resetStageCache(){ stage_cache_.clear(); stages_ = FrameStages(); }
 
     private:
     // the logger
@@ -168,35 +276,223 @@ namespace suturo_perception_lib
     double ecObjClusterTolerance;
     int ecObjMinClusterSize;
     int ecObjMaxClusterSize;
+    // table segmentation on the pixel grid of organized clouds
+    bool organizedSegmentation;
+    int organizedPlaneMinInliers;
+    double organizedPlaneAngularThreshold;
     bool calculateHullVolume_;
-    std::vector<cv::Mat> perceived_cluster_images_;
-    std::vector<ROI> perceived_cluster_rois_;
+    bool computeClusterMasks_;
+    // reuse the table plane of the last frame, as long as atleast
+    // planeTrackingMinInlierRatio of the inliers are still there
+    bool planeTracking;
+    double planeTrackingMinInlierRatio;
+    // cluster the projected object points on a 2d raster of the table instead of in 3d.
+    // Merges objects up to 2 * sqrt(2) * ecObjClusterTolerance apart
+    bool rasterObjectClustering;
+    // search the table plane on a cloud with coarsePlaneLeafSize and refine it on all points
+    bool coarsePlaneFitting;
+    double coarsePlaneLeafSize;
+    // restrict the processing to the table of the last frame, grown by autoROIMargin (meters) and autoROIPixelMargin (pixels)
+    bool autoROI;
+    double autoROIMargin;
+    int autoROIPixelMargin;
+    // reuse the last result, if less than sceneChangeMaxFraction of the sampled pixels moved by more than
+    // sceneChangeDepthThreshold (meters) or changed their color by more than sceneChangeColorThreshold
+    bool sceneChangeGating;
+    double sceneChangeMaxFraction;
+    double sceneChangeDepthThreshold;
+    int sceneChangeColorThreshold;
+    // segment up to surfaceMaxCount support surfaces with atleast surfaceMinInliers points (after downsampling),
+    // that are parallel to the biggest one within surfaceMaxAngle
+    bool multiSurfaceSegmentation;
+    int surfaceMaxCount;
+    int surfaceMinInliers;
+    double surfaceMaxAngle;
+    // keep the intermediate results of the last frame, so reprocessLastFrame only runs the stages again, whose inputs or parameters changed
+    bool stageCaching;
+    // Confidence of the adaptive termination of the plane RANSAC, 1 always runs planeMaxIterations
+    double planeRansacConfidence;
+    // Draw the first RANSAC samples from the points closest to the sensor
+    bool planeRansacGuided;
+    // Threads, that score the RANSAC hypotheses. <= 0 uses one thread per core
+    int planeRansacThreads;
+    // Maximum angle (rad) between the table normal and the planeNormalPrior
+    double planeNormalTolerance;
+    Eigen::Vector3f planeNormalPrior;
     // The coefficients of the detected table
     pcl::ModelCoefficients::Ptr table_coefficients_;
 
+    // The table plane that is tracked over consecutive frames and the inlier ratio
+    // of the last full plane search
+    pcl::ModelCoefficients::Ptr tracked_plane_;
+    double tracked_inlier_ratio_;
+
+    // Fit the table plane to cloud_in. Tries the tracked plane first, if plane tracking is enabled.
+    // cloud_full is the full resolution cloud for the coarse-to-fine fitting
+    void fitTablePlane(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_full, pcl::PointIndices::Ptr inliers,
+        pcl::ModelCoefficients::Ptr coefficients);
+
+    // The intermediate results of the last frame. With stageCaching, they are kept after the
+    // frame, so reprocessLastFrame can take the stages over, that didn't change (see stage_cache_)
+    struct FrameStages
+    {
+      FrameStages() : surface_count(0) {}
+
+      // The frame and the region, that has been processed
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr input;
+      ProcessingRegion region;
+      // "filter" and "downsample". object_cloud is the cloud, that the objects are extracted from
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered;
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_cloud;
+      pcl::PointIndices::Ptr pixel_indices;
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_downsampled;
+      // "plane" and "table cluster"
+      pcl::ModelCoefficients::Ptr plane_coefficients;
+      pcl::PointIndices::Ptr plane_inliers;
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr plane_region;
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr table_cloud;
+      pcl::PointIndices::Ptr table_inliers;
+      // "prism" and "projection"
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr objects_on_plane;
+      pcl::PointIndices::Ptr object_indices;
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr objects_projected;
+      // "object clusters", "object extraction" and "object properties"
+      std::vector<pcl::PointIndices> cluster_indices;
+      std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> objects;
+      std::vector<cv::Mat> images;
+      std::vector<cv::Mat> masks;
+      std::vector<ROI> rois;
+      std::vector<PerceivedObject, Eigen::aligned_allocator<PerceivedObject> > perceived_objects;
+      // "support surfaces" of the multiSurfaceSegmentation
+      int surface_count;
+      std::vector<pcl::PointIndices> surface_indices;
+      std::vector<pcl::ModelCoefficients::Ptr> surface_coefficients;
+      pcl::PointIndices::Ptr surface_points;
+    };
+
+    // Everything from the z-filter on for a frame, that is available as a cloud.
+    // The filter stages only run, if their parameters or the region changed
+    void processStages(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in, const ProcessingRegion &region,
+        boost::posix_time::ptime start);
+
+    // Everything after the z-filter. Shared by both processCloudWithProjections variants
+    // The segmentation of the frame goes into result
+    void segmentFilteredCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_organized, pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered,
+        std::vector<int> &removed_indices_filtered, boost::posix_time::ptime start, SegmentationResult &result);
+
+    // Input and output of the object extraction above a single support surface
+    struct SurfaceObjects
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr surface;
+      pcl::ModelCoefficients::Ptr coefficients;
+      // The prism ends below the next surface above this one
+      double prism_z_max;
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_points;
+      std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> objects;
+      std::vector<cv::Mat> images;
+      std::vector<cv::Mat> masks;
+      std::vector<ROI> rois;
+    };
+
+    // clusterFromProjection for the objects on the plane with a prism of height prism_z_max.
+    // Only touches the given workspace, so it can run for several surfaces in parallel
+    void clusterFromProjection(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters,
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr original_cloud, std::vector<int> *removed_indices_filtered,
+        std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &extracted_objects, std::vector<cv::Mat> &extracted_images,
+        std::vector<cv::Mat> &extracted_masks, std::vector<ROI> &perceived_cluster_rois_,
+        pcl::ModelCoefficients::Ptr plane, double prism_z_max, FrameWorkspace &workspace);
+
+    // The parts of clusterFromProjection, that are cached as separate stages.
+    // canClusterProjection checks the input, clusterProjection finds the clusters and
+    // extractClusterObjects extracts the points, image, mask and ROI of every cluster
+    bool canClusterProjection(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters,
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr original_cloud);
+    void clusterProjection(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters, pcl::ModelCoefficients::Ptr plane,
+        std::vector<pcl::PointIndices> &cluster_indices);
+    void extractClusterObjects(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters,
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr original_cloud, std::vector<int> *removed_indices_filtered,
+        const std::vector<pcl::PointIndices> &cluster_indices,
+        std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &extracted_objects, std::vector<cv::Mat> &extracted_images,
+        std::vector<cv::Mat> &extracted_masks, std::vector<ROI> &perceived_cluster_rois_,
+        pcl::ModelCoefficients::Ptr plane, double prism_z_max, FrameWorkspace &workspace);
+
+    // Turn the extracted clusters into PerceivedObjects on the given support surface
+    void addPerceivedObjects(const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &extracted_objects,
+        const std::vector<ROI> &rois, int surface_id, SegmentationResult &result);
+
+    // multiSurfaceSegmentation: everything after the z-filter for all support surfaces
+    void segmentSurfaces(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in, pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered,
+        std::vector<int> &removed_indices_filtered, boost::posix_time::ptime start, SegmentationResult &result);
+    // Extract the objects above a single surface. Runs on the worker threads of segmentSurfaces
+    void extractSurfaceObjects(pcl::PointCloud<pcl::PointXYZRGB>::Ptr candidates, pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+        std::vector<int> *removed_indices_filtered, SurfaceObjects *surface, FrameWorkspace *workspace);
+
+    // Derive the auto region for the next frame from the table in result. cloud_filtered are the
+    // filtered points of this frame and pixel_indices their index in the frame
+    void updateAutoRegion(const SegmentationResult &result, const pcl::PointCloud<pcl::PointXYZRGB> &cloud_filtered,
+        const std::vector<int> &pixel_indices);
+
+    // Test the frame against the last segmented one. If it didn't change, the last
+    // result is published again with the stamp start and true is returned
+    template <typename FrameT>
+    bool reuseUnchangedFrame(const FrameT &frame, boost::posix_time::ptime start);
+
+    // Make result the last result. Readers, that still hold the previous one, keep it
+    void publishResult(SegmentationResult::ConstPtr result);
+    // Start a frame in the workspace and reset the timings and allocations of the frame
+    void beginFrame();
+    // End the frame in the workspace, store the timings and allocations in result and publish it
+    void finishFrame(SegmentationResult::Ptr result);
+    // Record the time of a stage in the MetricsRegistry and add it to the timings of the frame. Threadsafe.
+    // stage is the stable "<module>/<what>" id of the stage, text only goes to the log
+    void logStage(boost::posix_time::ptime s, boost::posix_time::ptime e,
+        const std::string &stage, const std::string &text);
+    // The planeRansac* parameters
+    RansacOptions ransacOptions() const;
+
+    // Compares the frames for sceneChangeGating
+    SceneChangeDetector scene_change_;
+
+    // Keys of the stages in stages_. Every new frame clears it
+    StageCache stage_cache_;
+    FrameStages stages_;
+
+    // One workspace per support surface, for the parallel object extraction
+    std::vector<boost::shared_ptr<FrameWorkspace> > surface_workspaces_;
+
+    // Timings and buffer allocations of the current frame. Guarded by the mutex,
+    // because the support surfaces are processed in parallel
+    std::map<std::string, double> frame_timings_;
+    int frame_allocations_;
+    boost::signals2::mutex frame_stats_mutex_;
+
+    // The region set with setPixelROI and setCropBox and the one around the last table
+    ProcessingRegion region_;
+    ProcessingRegion auto_region_;
+
+    // The intermediate clouds and indices, that are recycled over frames
+    FrameWorkspace workspace_;
+
+    // Dimensions of the last processed frame. Used to map points to pixels
+    uint32_t frame_width_;
+    uint32_t frame_height_;
+
     // Pointer to the input images. These can be used to review the original input and compare
     // it to the results.
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr original_cloud_;
     boost::shared_ptr<cv::Mat> original_rgb_image_;
 
-    // The cloud of the extracted plane in the segmentation process
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr plane_cloud_;
-
-    // The cloud of the extracted objects above the plane
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr objects_on_plane_cloud_;
-
     // Set this flag to true to write partial pcds
     // while processing a cloud
     bool writer_pcd;
 
     // ID counter for the perceived objects
     int objectID;
-    // Buffer for the last perceived objects
-    // std::vector<PerceivedObject> perceivedObjects;
-    std::vector<PerceivedObject, Eigen::aligned_allocator<PerceivedObject> > perceivedObjects;
-    
-    // Mutex for buffer locking
-    boost::signals2::mutex mutex;
+    // The last published result. The mutex only guards the swap of the pointer
+    SegmentationResult::ConstPtr last_result_;
+    boost::signals2::mutex result_mutex_;
 
     // debug var for time profiling
     bool debug;
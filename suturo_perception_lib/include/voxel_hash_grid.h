@@ -0,0 +1,77 @@
+#ifndef SUTURO_PERCEPTION_VOXEL_HASH_GRID_H
+#define SUTURO_PERCEPTION_VOXEL_HASH_GRID_H
+
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+namespace suturo_perception_lib
+{
+  /**
+   * Voxel grid, that accumulates the points of every occupied voxel
+   * in an open addressing hash table. In contrast to pcl::VoxelGrid,
+   * no index list has to be sorted, so points can be added while
+   * the input is read.
+   * The resulting centroids are equal to the ones of pcl::VoxelGrid
+   * and are returned in the same order.
+   */
+  class VoxelHashGrid
+  {
+    public:
+      VoxelHashGrid(float leaf_size);
+
+      // Prepare the table for the given number of occupied voxels
+      void reserve(size_t voxels);
+      void clear();
+
+      int voxelCoordinate(float v) const { return static_cast<int>(floor(v * inverse_leaf_size_)); }
+      float inverseLeafSize() const { return inverse_leaf_size_; }
+
+      // Add a point to the voxel containing it. The point has to be finite
+      void addPoint(const pcl::PointXYZRGB &p)
+      {
+        addPoint(voxelCoordinate(p.x), voxelCoordinate(p.y), voxelCoordinate(p.z), p);
+      }
+      // Add a point, whose voxel coordinates have already been computed
+      void addPoint(int ix, int iy, int iz, const pcl::PointXYZRGB &p);
+
+      // Add all voxels of other to this grid. Both grids need the same leaf size
+      void merge(const VoxelHashGrid &other);
+
+      // Number of occupied voxels
+      size_t size() const { return voxels_.size(); }
+
+      // Write the centroid of every voxel into cloud_out, ordered like the output of pcl::VoxelGrid
+      void getCentroids(pcl::PointCloud<pcl::PointXYZRGB> &cloud_out) const;
+
+    private:
+      struct Voxel
+      {
+        int ix, iy, iz;
+        float x, y, z;
+        float r, g, b;
+        uint32_t count;
+      };
+
+      // z-major order, like the linear voxel index of pcl::VoxelGrid
+      static bool voxelLess(const Voxel &a, const Voxel &b);
+
+      float inverse_leaf_size_;
+      std::vector<Voxel> voxels_;
+      // Slot i holds the index of a voxel in voxels_ or -1, if empty
+      std::vector<int> table_;
+      size_t mask_;
+
+      size_t slot(int ix, int iy, int iz) const
+      {
+        return (((uint32_t)ix * 73856093u) ^ ((uint32_t)iy * 19349663u) ^ ((uint32_t)iz * 83492791u)) & mask_;
+      }
+      int findOrInsert(int ix, int iy, int iz);
+      void rehash(size_t capacity);
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
@@ -0,0 +1,259 @@
+#include "euclidean_clustering.h"
+
+#include <algorithm>
+#include <cmath>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+using namespace suturo_perception_lib;
+
+namespace
+{
+  // Clouds below this size are clustered by a single thread
+  const int PARALLEL_CLUSTERING_MIN_POINTS = 20000;
+
+  // Half of the 26 neighbour cells. The other half is covered by the neighbours themselves
+  const int NEIGHBOUR_OFFSETS[13][3] = {
+    { 1, 0, 0},
+    {-1, 1, 0}, { 0, 1, 0}, { 1, 1, 0},
+    {-1,-1, 1}, { 0,-1, 1}, { 1,-1, 1},
+    {-1, 0, 1}, { 0, 0, 1}, { 1, 0, 1},
+    {-1, 1, 1}, { 0, 1, 1}, { 1, 1, 1}
+  };
+
+  inline float sqrDistance(const pcl::PointXYZRGB &a, const pcl::PointXYZRGB &b)
+  {
+    float dx = a.x - b.x;
+    float dy = a.y - b.y;
+    float dz = a.z - b.z;
+    return dx * dx + dy * dy + dz * dz;
+  }
+
+  bool biggerCluster(const pcl::PointIndices &a, const pcl::PointIndices &b)
+  {
+    return a.indices.size() > b.indices.size();
+  }
+}
+
+EuclideanClustering::CellGrid::CellGrid(size_t expected_cells)
+{
+  // Keep the load factor below 0.5
+  size_t capacity = 1024;
+  while (capacity < 2 * expected_cells)
+    capacity *= 2;
+  table_.assign(capacity, -1);
+  mask_ = capacity - 1;
+  cells.reserve(expected_cells);
+}
+
+int EuclideanClustering::CellGrid::find(int ix, int iy, int iz) const
+{
+  size_t s = slot(ix, iy, iz);
+  while (table_[s] != -1)
+  {
+    const Cell &c = cells[table_[s]];
+    if (c.ix == ix && c.iy == iy && c.iz == iz)
+      return table_[s];
+    s = (s + 1) & mask_;
+  }
+  return -1;
+}
+
+int EuclideanClustering::CellGrid::findOrInsert(int ix, int iy, int iz)
+{
+  size_t s = slot(ix, iy, iz);
+  while (table_[s] != -1)
+  {
+    const Cell &c = cells[table_[s]];
+    if (c.ix == ix && c.iy == iy && c.iz == iz)
+      return table_[s];
+    s = (s + 1) & mask_;
+  }
+  Cell c;
+  c.ix = ix;
+  c.iy = iy;
+  c.iz = iz;
+  c.begin = 0;
+  c.end = 0;
+  cells.push_back(c);
+  table_[s] = cells.size() - 1;
+  return table_[s];
+}
+
+/*
+ * Find the root of x. Compresses the path by pointing every visited
+ * element to its grandparent. A failed CAS only means, that another
+ * thread changed the parent in the meantime, which is fine.
+ */
+int EuclideanClustering::findRoot(volatile int *parent, int x)
+{
+  while (true)
+  {
+    int p = parent[x];
+    if (p == x)
+      return x;
+    int gp = parent[p];
+    if (p != gp)
+      __sync_bool_compare_and_swap(&parent[x], p, gp);
+    x = gp;
+  }
+}
+
+/*
+ * Merge the sets of a and b. The root with the bigger index will always be
+ * linked to the smaller one, so no cycles can be created by concurrent unions.
+ */
+void EuclideanClustering::unite(volatile int *parent, int a, int b)
+{
+  while (true)
+  {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a == b)
+      return;
+    if (a < b)
+      std::swap(a, b);
+    // a might not be a root anymore. Retry in this case
+    if (__sync_bool_compare_and_swap(&parent[a], a, b))
+      return;
+  }
+}
+
+/*
+ * Connect all points of the cells [cell_begin, cell_end) to the points
+ * within the tolerance in the same and in the neighbouring cells.
+ */
+void EuclideanClustering::connectCells(const pcl::PointCloud<pcl::PointXYZRGB> *cloud, const CellGrid *grid,
+    const std::vector<int> *buckets, float sqr_tolerance, int cell_begin, int cell_end, volatile int *parent)
+{
+  const std::vector<int> &b = *buckets;
+  for (int c = cell_begin; c < cell_end; c++)
+  {
+    const Cell &cell = grid->cells[c];
+
+    // points of the same cell
+    for (int i = cell.begin; i < cell.end; i++)
+    {
+      for (int j = i + 1; j < cell.end; j++)
+      {
+        if (findRoot(parent, b[i]) != findRoot(parent, b[j]) &&
+            sqrDistance(cloud->points[b[i]], cloud->points[b[j]]) <= sqr_tolerance)
+          unite(parent, b[i], b[j]);
+      }
+    }
+
+    // points of the neighbour cells
+    for (int n = 0; n < 13; n++)
+    {
+      int neighbour = grid->find(cell.ix + NEIGHBOUR_OFFSETS[n][0], cell.iy + NEIGHBOUR_OFFSETS[n][1],
+          cell.iz + NEIGHBOUR_OFFSETS[n][2]);
+      if (neighbour < 0)
+        continue;
+      const Cell &other = grid->cells[neighbour];
+      for (int i = cell.begin; i < cell.end; i++)
+      {
+        for (int j = other.begin; j < other.end; j++)
+        {
+          if (findRoot(parent, b[i]) != findRoot(parent, b[j]) &&
+              sqrDistance(cloud->points[b[i]], cloud->points[b[j]]) <= sqr_tolerance)
+            unite(parent, b[i], b[j]);
+        }
+      }
+    }
+  }
+}
+
+void EuclideanClustering::extract(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    double clusterTolerance, int minClusterSize, int maxClusterSize,
+    std::vector<pcl::PointIndices> &clusters, int threads)
+{
+  clusters.clear();
+  const pcl::PointCloud<pcl::PointXYZRGB> &cloud = *cloud_in;
+  const int size = cloud.points.size();
+  if (size == 0)
+    return;
+
+  // Bucket the points into cells with the size of the tolerance
+  const float inverse_cell_size = 1.0f / clusterTolerance;
+  std::vector<int> cell_of(size, -1);
+  CellGrid grid(size);
+  for (int i = 0; i < size; i++)
+  {
+    const pcl::PointXYZRGB &p = cloud.points[i];
+    if (!pcl::isFinite(p))
+      continue;
+    int c = grid.findOrInsert(static_cast<int>(floor(p.x * inverse_cell_size)),
+        static_cast<int>(floor(p.y * inverse_cell_size)), static_cast<int>(floor(p.z * inverse_cell_size)));
+    cell_of[i] = c;
+    grid.cells[c].end++; // count the points first
+  }
+  // Counting sort of the points into their cells
+  int offset = 0;
+  for (int c = 0; c < grid.cells.size(); c++)
+  {
+    int count = grid.cells[c].end;
+    grid.cells[c].begin = offset;
+    grid.cells[c].end = offset;
+    offset += count;
+  }
+  std::vector<int> buckets(offset);
+  for (int i = 0; i < size; i++)
+  {
+    if (cell_of[i] >= 0)
+      buckets[grid.cells[cell_of[i]].end++] = i;
+  }
+
+  // Connect the neighbours
+  std::vector<int> parent_storage(size);
+  for (int i = 0; i < size; i++)
+    parent_storage[i] = i;
+  volatile int *parent = &parent_storage[0];
+  const float sqr_tolerance = clusterTolerance * clusterTolerance;
+
+  if (threads <= 0)
+    threads = boost::thread::hardware_concurrency();
+  if (threads < 1 || size < PARALLEL_CLUSTERING_MIN_POINTS)
+    threads = 1;
+  const int cell_count = grid.cells.size();
+  boost::thread_group workers;
+  for (int t = 0; t < threads; t++)
+  {
+    int begin = (int64_t) cell_count * t / threads;
+    int end = (int64_t) cell_count * (t + 1) / threads;
+    if (t == threads - 1)
+      connectCells(&cloud, &grid, &buckets, sqr_tolerance, begin, end, parent); // use the calling thread as well
+    else
+      workers.create_thread(boost::bind(&EuclideanClustering::connectCells, &cloud, &grid, &buckets,
+            sqr_tolerance, begin, end, parent));
+  }
+  workers.join_all();
+
+  // Collect the clusters
+  std::vector<int> cluster_size(size, 0);
+  for (int i = 0; i < size; i++)
+  {
+    if (cell_of[i] >= 0)
+      cluster_size[findRoot(parent, i)]++;
+  }
+  std::vector<int> cluster_of_root(size, -1);
+  for (int i = 0; i < size; i++)
+  {
+    if (cell_of[i] < 0)
+      continue;
+    int root = findRoot(parent, i);
+    if (cluster_size[root] < minClusterSize || cluster_size[root] > maxClusterSize)
+      continue;
+    if (cluster_of_root[root] < 0)
+    {
+      cluster_of_root[root] = clusters.size();
+      clusters.push_back(pcl::PointIndices());
+      clusters.back().header = cloud.header;
+      clusters.back().indices.reserve(cluster_size[root]);
+    }
+    clusters[cluster_of_root[root]].indices.push_back(i);
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), biggerCluster);
+}
+
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
@@ -0,0 +1,258 @@
+#include "footprint_labeling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+using namespace suturo_perception_lib;
+
+namespace
+{
+  // Label map values besides the index of a footprint
+  const int NO_FOOTPRINT = -1;
+  const int SHARED_CELL = -2;
+
+  template <typename P>
+  inline float cross(const P &o, const P &a, const P &b)
+  {
+    return (a.u - o.u) * (b.v - o.v) - (a.v - o.v) * (b.u - o.u);
+  }
+
+  template <typename P>
+  bool lessUV(const P &a, const P &b)
+  {
+    return a.u < b.u || (a.u == b.u && a.v < b.v);
+  }
+}
+
+/*
+ * Andrew's monotone chain. The hull will be counter-clockwise without
+ * collinear points. It has less than 3 points, if the input is degenerated.
+ */
+void FootprintLabeling::convexHull(std::vector<Point2> &points, std::vector<Point2> &hull)
+{
+  hull.clear();
+  if (points.size() < 3)
+    return;
+  std::sort(points.begin(), points.end(), lessUV<Point2>);
+
+  hull.resize(2 * points.size());
+  int k = 0;
+  // lower hull
+  for (int i = 0; i < points.size(); i++)
+  {
+    while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+      k--;
+    hull[k++] = points[i];
+  }
+  // upper hull
+  for (int i = points.size() - 2, lower = k + 1; i >= 0; i--)
+  {
+    while (k >= lower && cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+      k--;
+    hull[k++] = points[i];
+  }
+  hull.resize(k - 1); // the last point is the first one
+  if (hull.size() < 3)
+    hull.clear();
+}
+
+bool FootprintLabeling::insideHull(const std::vector<Point2> &hull, float u, float v)
+{
+  Point2 p;
+  p.u = u;
+  p.v = v;
+  for (int i = 0, j = hull.size() - 1; i < hull.size(); j = i++)
+  {
+    if (cross(hull[j], hull[i], p) < 0)
+      return false;
+  }
+  return true;
+}
+
+bool FootprintLabeling::extract(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    const pcl::PointCloud<pcl::PointXYZRGB>::Ptr projected_cloud,
+    const std::vector<pcl::PointIndices> &clusters, const pcl::ModelCoefficients::Ptr plane,
+    double cellSize, double minHeight, double maxHeight,
+    std::vector<pcl::PointIndices> &object_indices)
+{
+  object_indices.clear();
+  if (plane == NULL || plane->values.size() < 4)
+    return false;
+
+  // Plane with the normal pointing to the sensor and an orthonormal base (u, v) on it
+  Eigen::Vector3f normal(plane->values[0], plane->values[1], plane->values[2]);
+  float norm = normal.norm();
+  if (norm == 0)
+    return false;
+  normal /= norm;
+  float d = plane->values[3] / norm;
+  if (d < 0)
+  {
+    normal = -normal;
+    d = -d;
+  }
+  Eigen::Vector3f u = normal.unitOrthogonal();
+  Eigen::Vector3f v = normal.cross(u);
+
+  // Footprints of the clusters in plane coordinates
+  std::vector<std::vector<Point2> > hulls(clusters.size());
+  std::vector<Point2> points;
+  float min_u = 0, max_u = 0, min_v = 0, max_v = 0;
+  bool first = true;
+  for (int c = 0; c < clusters.size(); c++)
+  {
+    points.clear();
+    points.reserve(clusters[c].indices.size());
+    for (std::vector<int>::const_iterator it = clusters[c].indices.begin(); it != clusters[c].indices.end(); ++it)
+    {
+      const pcl::PointXYZRGB &p = projected_cloud->points[*it];
+      if (!pcl::isFinite(p))
+        continue;
+      Eigen::Vector3f pt(p.x, p.y, p.z);
+      Point2 q;
+      q.u = u.dot(pt);
+      q.v = v.dot(pt);
+      points.push_back(q);
+    }
+    convexHull(points, hulls[c]);
+    for (int i = 0; i < hulls[c].size(); i++)
+    {
+      if (first)
+      {
+        min_u = max_u = hulls[c][i].u;
+        min_v = max_v = hulls[c][i].v;
+        first = false;
+      }
+      min_u = std::min(min_u, hulls[c][i].u);
+      max_u = std::max(max_u, hulls[c][i].u);
+      min_v = std::min(min_v, hulls[c][i].v);
+      max_v = std::max(max_v, hulls[c][i].v);
+    }
+  }
+
+  object_indices.resize(clusters.size());
+  for (int c = 0; c < clusters.size(); c++)
+    object_indices[c].header = cloud_in->header;
+  if (first)
+    return true; // no footprints, no objects
+
+  const float inverse_cell_size = 1.0f / cellSize;
+  const int min_x = static_cast<int>(floor(min_u * inverse_cell_size));
+  const int min_y = static_cast<int>(floor(min_v * inverse_cell_size));
+  const int max_x = static_cast<int>(floor(max_u * inverse_cell_size));
+  const int max_y = static_cast<int>(floor(max_v * inverse_cell_size));
+  if (((int64_t) max_x - min_x + 1) * ((int64_t) max_y - min_y + 1) > MAX_CELLS)
+  {
+    object_indices.clear();
+    return false;
+  }
+  const int width = max_x - min_x + 1;
+  const int height = max_y - min_y + 1;
+
+  // Rasterize every footprint row by row. A row covers all cells between the
+  // smallest and the biggest u of the hull edges clipped to the row.
+  std::vector<int> label_map(width * height, NO_FOOTPRINT);
+  for (int c = 0; c < hulls.size(); c++)
+  {
+    const std::vector<Point2> &hull = hulls[c];
+    if (hull.empty())
+      continue;
+    float hull_min_v = hull[0].v, hull_max_v = hull[0].v;
+    for (int i = 1; i < hull.size(); i++)
+    {
+      hull_min_v = std::min(hull_min_v, hull[i].v);
+      hull_max_v = std::max(hull_max_v, hull[i].v);
+    }
+    int first_row = static_cast<int>(floor(hull_min_v * inverse_cell_size));
+    int last_row = static_cast<int>(floor(hull_max_v * inverse_cell_size));
+    for (int row = first_row; row <= last_row; row++)
+    {
+      float v0 = row * cellSize;
+      float v1 = (row + 1) * cellSize;
+      float row_min_u = 0, row_max_u = 0;
+      bool row_empty = true;
+      for (int i = 0, j = hull.size() - 1; i < hull.size(); j = i++)
+      {
+        const Point2 &a = hull[j];
+        const Point2 &b = hull[i];
+        float t0 = 0, t1 = 1;
+        if (a.v != b.v)
+        {
+          t0 = (v0 - a.v) / (b.v - a.v);
+          t1 = (v1 - a.v) / (b.v - a.v);
+          if (t0 > t1)
+            std::swap(t0, t1);
+          t0 = std::max(t0, 0.0f);
+          t1 = std::min(t1, 1.0f);
+          if (t0 > t1)
+            continue;
+        }
+        else if (a.v < v0 || a.v > v1)
+          continue;
+        float ua = a.u + t0 * (b.u - a.u);
+        float ub = a.u + t1 * (b.u - a.u);
+        if (row_empty)
+        {
+          row_min_u = row_max_u = ua;
+          row_empty = false;
+        }
+        row_min_u = std::min(row_min_u, std::min(ua, ub));
+        row_max_u = std::max(row_max_u, std::max(ua, ub));
+      }
+      if (row_empty)
+        continue;
+      int y = std::max(0, std::min(height - 1, row - min_y));
+      int x0 = std::max(0, static_cast<int>(floor(row_min_u * inverse_cell_size)) - min_x);
+      int x1 = std::min(width - 1, static_cast<int>(floor(row_max_u * inverse_cell_size)) - min_x);
+      for (int x = x0; x <= x1; x++)
+      {
+        int &label = label_map[y * width + x];
+        if (label == NO_FOOTPRINT)
+          label = c;
+        else if (label != c)
+          label = SHARED_CELL;
+      }
+    }
+  }
+
+  // Single pass over the cloud
+  const pcl::PointCloud<pcl::PointXYZRGB> &cloud = *cloud_in;
+  for (int i = 0; i < cloud.points.size(); i++)
+  {
+    const pcl::PointXYZRGB &p = cloud.points[i];
+    if (!pcl::isFinite(p))
+      continue;
+    Eigen::Vector3f pt(p.x, p.y, p.z);
+    float h = normal.dot(pt) + d;
+    if (h < minHeight || h > maxHeight)
+      continue;
+    float pu = u.dot(pt);
+    float pv = v.dot(pt);
+    int x = static_cast<int>(floor(pu * inverse_cell_size)) - min_x;
+    int y = static_cast<int>(floor(pv * inverse_cell_size)) - min_y;
+    if (x < 0 || x >= width || y < 0 || y >= height)
+      continue;
+    int label = label_map[y * width + x];
+    if (label == NO_FOOTPRINT)
+      continue;
+    if (label != SHARED_CELL)
+    {
+      if (insideHull(hulls[label], pu, pv))
+        object_indices[label].indices.push_back(i);
+      continue;
+    }
+    for (int c = 0; c < hulls.size(); c++)
+    {
+      if (!hulls[c].empty() && insideHull(hulls[c], pu, pv))
+      {
+        object_indices[c].indices.push_back(i);
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
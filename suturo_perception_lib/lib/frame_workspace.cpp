@@ -0,0 +1,173 @@
+#include "frame_workspace.h"
+
+#include <algorithm>
+
+using namespace suturo_perception_lib;
+
+namespace
+{
+  size_t capacityOf(const FrameWorkspace::Cloud &cloud)
+  {
+    return cloud.points.capacity();
+  }
+
+  size_t capacityOf(const pcl::PointIndices &indices)
+  {
+    return indices.indices.capacity();
+  }
+
+  void reserve(FrameWorkspace::Cloud &cloud, size_t size)
+  {
+    cloud.points.reserve(size);
+  }
+
+  void reserve(pcl::PointIndices &indices, size_t size)
+  {
+    indices.indices.reserve(size);
+  }
+
+  // Make a used buffer look like a new one. The memory of the points is kept
+  void reset(FrameWorkspace::Cloud &cloud)
+  {
+    cloud.points.clear();
+    cloud.header = FrameWorkspace::Cloud().header;
+    cloud.width = 0;
+    cloud.height = 0;
+    cloud.is_dense = true;
+    cloud.sensor_origin_ = Eigen::Vector4f::Zero();
+    cloud.sensor_orientation_ = Eigen::Quaternionf::Identity();
+  }
+
+  void reset(pcl::PointIndices &indices)
+  {
+    indices.indices.clear();
+    indices.header = pcl::PointIndices().header;
+  }
+
+  template <typename T>
+  boost::shared_ptr<T> acquire(FrameWorkspace::Pool<T> &pool, size_t size, int &allocations)
+  {
+    // Make room for what the buffer with the same job needed in the last frame
+    const int k = pool.acquired.size();
+    if (k < pool.hints.size())
+      size = std::max(size, pool.hints[k]);
+
+    // Take the smallest free buffer that is big enough, or the biggest one, if none is
+    int best = -1;
+    size_t best_capacity = 0;
+    for (int i = 0; i < pool.entries.size(); i++)
+    {
+      if (!pool.entries[i].buffer.unique())
+        continue;
+      size_t capacity = capacityOf(*pool.entries[i].buffer);
+      bool better;
+      if (best < 0)
+        better = true;
+      else if (best_capacity >= size)
+        better = capacity >= size && capacity < best_capacity;
+      else
+        better = capacity > best_capacity;
+      if (better)
+      {
+        best = i;
+        best_capacity = capacity;
+      }
+    }
+
+    if (best < 0)
+    {
+      allocations++;
+      boost::shared_ptr<T> buffer(new T);
+      if (pool.entries.size() >= FrameWorkspace::MAX_POOLED)
+      {
+        reserve(*buffer, size);
+        return buffer;
+      }
+      FrameWorkspace::Entry<T> entry;
+      entry.buffer = buffer;
+      entry.capacity = 0;
+      pool.entries.push_back(entry);
+      best = pool.entries.size() - 1;
+    }
+    else
+    {
+      reset(*pool.entries[best].buffer);
+    }
+
+    pool.acquired.push_back(best);
+    reserve(*pool.entries[best].buffer, size);
+    return pool.entries[best].buffer;
+  }
+
+  // Count the buffers, that grew during the frame, and remember the
+  // capacities for the next frame
+  template <typename T>
+  void finish(FrameWorkspace::Pool<T> &pool, int &allocations)
+  {
+    pool.hints.resize(pool.acquired.size());
+    for (int k = 0; k < pool.acquired.size(); k++)
+      pool.hints[k] = capacityOf(*pool.entries[pool.acquired[k]].buffer);
+    pool.acquired.clear();
+
+    for (int i = 0; i < pool.entries.size(); i++)
+    {
+      size_t capacity = capacityOf(*pool.entries[i].buffer);
+      if (capacity > pool.entries[i].capacity)
+        allocations++;
+      pool.entries[i].capacity = capacity;
+    }
+  }
+
+  template <typename T>
+  void release(FrameWorkspace::Pool<T> &pool)
+  {
+    std::vector<FrameWorkspace::Entry<T> > in_use;
+    for (int i = 0; i < pool.entries.size(); i++)
+    {
+      if (!pool.entries[i].buffer.unique())
+        in_use.push_back(pool.entries[i]);
+    }
+    pool.entries.swap(in_use);
+    pool.acquired.clear();
+    pool.hints.clear();
+  }
+}
+
+FrameWorkspace::FrameWorkspace()
+{
+  allocations_ = 0;
+  last_frame_allocations_ = 0;
+}
+
+void FrameWorkspace::beginFrame()
+{
+  allocations_ = 0;
+  clouds_.acquired.clear();
+  indices_.acquired.clear();
+}
+
+void FrameWorkspace::endFrame()
+{
+  finish(clouds_, allocations_);
+  finish(indices_, allocations_);
+  last_frame_allocations_ = allocations_;
+  allocations_ = 0;
+}
+
+FrameWorkspace::Cloud::Ptr FrameWorkspace::acquireCloud(size_t reserve)
+{
+  return acquire(clouds_, reserve, allocations_);
+}
+
+pcl::PointIndices::Ptr FrameWorkspace::acquireIndices(size_t reserve)
+{
+  return acquire(indices_, reserve, allocations_);
+}
+
+void FrameWorkspace::clear()
+{
+  release(clouds_);
+  release(indices_);
+}
+
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
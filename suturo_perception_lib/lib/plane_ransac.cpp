@@ -0,0 +1,362 @@
+#include "plane_ransac.h"
+
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Geometry>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+using namespace suturo_perception_lib;
+using namespace suturo_perception_utils;
+
+namespace
+{
+  const int SAMPLE_SIZE = 3;
+  // Seed of the sampling, so every fit of the same cloud finds the same plane
+  const unsigned int SEED = 12345;
+
+  // Orders point indices by their height along the normal prior
+  struct HeightOrder
+  {
+    HeightOrder(const std::vector<float> &heights) : heights(&heights) {}
+    bool operator()(int a, int b) const { return (*heights)[a] < (*heights)[b]; }
+    bool operator()(int a, float h) const { return (*heights)[a] < h; }
+    bool operator()(float h, int a) const { return h < (*heights)[a]; }
+    const std::vector<float> *heights;
+  };
+
+  /*
+   * Draws the samples from a pool of point indices.
+   * Without groups, every sample is uniform over the pool. With groups, the pool
+   * is ordered by quality and the samples follow the PROSAC growth function
+   * over the groups: sample t takes one point of the newest group n and the
+   * others from the groups before it. Group n + 1 is added after the
+   * T'_n-th sample, until all groups are in and the sampling is uniform.
+   * With a slab, the second and third point are replaced by points, whose height
+   * differs by atmost the slab from the height of the first point.
+   */
+  class Sampler
+  {
+    public:
+      Sampler(const std::vector<int> &pool, int groups, int maxIterations) :
+        pool_(pool), groups_(groups), rng_(SEED), t_(0), n_(SAMPLE_SIZE), t_n_(maxIterations), t_n_prime_(1),
+        heights_(NULL), by_height_(NULL), slab_(0)
+      {
+        // T_m = T_N * prod (m - i) / (N - i)
+        for (int i = 0; i < SAMPLE_SIZE && groups_ >= SAMPLE_SIZE; i++)
+          t_n_ *= (double) (n_ - i) / (groups_ - i);
+      }
+
+      // by_height has to be sorted by heights
+      void setSlab(const std::vector<float> &heights, const std::vector<int> &by_height, float slab)
+      {
+        heights_ = &heights;
+        by_height_ = &by_height;
+        slab_ = slab;
+      }
+
+      void next(int *sample)
+      {
+        nextFromPool(sample);
+        if (!by_height_)
+          return;
+        const float height = (*heights_)[sample[0]];
+        const HeightOrder order(*heights_);
+        const size_t begin = std::lower_bound(by_height_->begin(), by_height_->end(), height - slab_, order)
+          - by_height_->begin();
+        const size_t end = std::upper_bound(by_height_->begin(), by_height_->end(), height + slab_, order)
+          - by_height_->begin();
+        // The slab contains the first point
+        if (end - begin >= SAMPLE_SIZE)
+          draw(*by_height_, begin, end, 1, SAMPLE_SIZE, sample);
+      }
+
+    private:
+      const std::vector<int> &pool_;
+      int groups_;
+      boost::random::mt19937 rng_;
+      int t_;
+      int n_;
+      double t_n_;
+      int t_n_prime_;
+      const std::vector<float> *heights_;
+      const std::vector<int> *by_height_;
+      float slab_;
+
+      size_t groupEnd(int group) const { return pool_.size() * group / groups_; }
+
+      void nextFromPool(int *sample)
+      {
+        t_++;
+        if (groups_ < SAMPLE_SIZE)
+        {
+          draw(pool_, 0, pool_.size(), 0, SAMPLE_SIZE, sample);
+          return;
+        }
+        if (t_ == t_n_prime_ && n_ < groups_)
+        {
+          double t_next = t_n_ * (n_ + 1) / (n_ + 1 - SAMPLE_SIZE);
+          t_n_prime_ += std::max(1, (int) ceil(t_next - t_n_));
+          t_n_ = t_next;
+          n_++;
+        }
+        const size_t end = groupEnd(n_);
+        if (t_n_prime_ < t_)
+        {
+          draw(pool_, 0, end, 0, SAMPLE_SIZE, sample);
+        }
+        else
+        {
+          const size_t begin = groupEnd(n_ - 1);
+          draw(pool_, begin, end, 0, 1, sample);
+          draw(pool_, 0, begin, 1, SAMPLE_SIZE, sample);
+        }
+      }
+
+      // sample[first, last) gets points of source[begin, end), that differ from sample[0, last)
+      void draw(const std::vector<int> &source, size_t begin, size_t end, int first, int last, int *sample)
+      {
+        boost::random::uniform_int_distribution<size_t> position(begin, end - 1);
+        for (int k = first; k < last; k++)
+        {
+          bool duplicate;
+          do
+          {
+            sample[k] = source[position(rng_)];
+            duplicate = false;
+            for (int j = 0; j < k; j++)
+              duplicate = duplicate || sample[j] == sample[k];
+          } while (duplicate);
+        }
+      }
+  };
+
+  // Normalized plane through the three points of sample. false, if they are collinear
+  bool planeFromSample(const SoACloud &cloud, const int *sample, Eigen::Vector4f &plane)
+  {
+    Eigen::Vector3f p0(cloud.x()[sample[0]], cloud.y()[sample[0]], cloud.z()[sample[0]]);
+    Eigen::Vector3f p1(cloud.x()[sample[1]], cloud.y()[sample[1]], cloud.z()[sample[1]]);
+    Eigen::Vector3f p2(cloud.x()[sample[2]], cloud.y()[sample[2]], cloud.z()[sample[2]]);
+    Eigen::Vector3f normal = (p1 - p0).cross(p2 - p0);
+    float norm = normal.norm();
+    if (!(norm > 1e-12f))
+      return false;
+    normal /= norm;
+    plane << normal, -normal.dot(p0);
+    return true;
+  }
+}
+
+struct PlaneRansac::Scoring
+{
+  Scoring(const SoACloud &cloud, float threshold, int threads) : cloud(cloud), threshold(threshold),
+    bounds(threads + 1), counts(threads), start(threads), finish(threads), done(false)
+  {
+  }
+
+  const SoACloud &cloud;
+  const float threshold;
+  Hypotheses hypotheses;
+  // thread t scores the points [bounds[t], bounds[t + 1])
+  std::vector<size_t> bounds;
+  std::vector<std::vector<size_t> > counts;
+  boost::barrier start;
+  boost::barrier finish;
+  bool done;
+};
+
+PlaneRansac::PlaneRansac(const RansacOptions &options) : options_(options), iterations_(0)
+{
+}
+
+int PlaneRansac::requiredIterations(double inlierRatio, double confidence, int maxIterations)
+{
+  return requiredIterations(inlierRatio, inlierRatio, confidence, maxIterations);
+}
+
+int PlaneRansac::requiredIterations(double firstRatio, double otherRatio, double confidence, int maxIterations)
+{
+  if (confidence >= 1 || firstRatio <= 0 || otherRatio <= 0)
+    return maxIterations;
+  const double outlier_free = std::min(firstRatio, 1.0) * pow(std::min(otherRatio, 1.0), SAMPLE_SIZE - 1);
+  if (outlier_free >= 1)
+    return std::min(1, maxIterations);
+  const double k = log(1 - confidence) / log(1 - outlier_free);
+  if (!(k < maxIterations))
+    return maxIterations;
+  return std::max(1, (int) ceil(k));
+}
+
+void PlaneRansac::scoreRange(const SoACloud *cloud, const Hypotheses *hypotheses,
+    float threshold, size_t begin, size_t end, std::vector<size_t> *counts)
+{
+  counts->assign(hypotheses->size(), 0);
+  for (size_t block = begin; block < end; block += SCORING_BLOCK_POINTS)
+  {
+    const size_t block_end = std::min(end, block + SCORING_BLOCK_POINTS);
+    for (int h = 0; h < hypotheses->size(); h++)
+      (*counts)[h] += cloud->countWithinDistance((*hypotheses)[h], threshold, block, block_end);
+  }
+}
+
+void PlaneRansac::scoringWorker(Scoring *scoring, int thread)
+{
+  while (true)
+  {
+    scoring->start.wait();
+    if (scoring->done)
+      return;
+    scoreRange(&scoring->cloud, &scoring->hypotheses, scoring->threshold,
+        scoring->bounds[thread], scoring->bounds[thread + 1], &scoring->counts[thread]);
+    scoring->finish.wait();
+  }
+}
+
+int PlaneRansac::fit(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in, int maxIterations,
+    double distanceThreshold, pcl::PointIndices &inliers, pcl::ModelCoefficients &coefficients)
+{
+  iterations_ = 0;
+  inliers.indices.clear();
+  coefficients.values.clear();
+
+  const SoACloud cloud(*cloud_in);
+  std::vector<int> pool;
+  pool.reserve(cloud.size());
+  for (int i = 0; i < cloud.size(); i++)
+  {
+    if (pcl_isfinite(cloud.x()[i]) && pcl_isfinite(cloud.y()[i]) && pcl_isfinite(cloud.z()[i]))
+      pool.push_back(i);
+  }
+  if (pool.size() < SAMPLE_SIZE)
+    return 0;
+
+  int groups = 0;
+  if (options_.guided)
+  {
+    // The noise of the sensor grows with the distance
+    std::vector<std::pair<float, int> > ranked(pool.size());
+    for (int i = 0; i < pool.size(); i++)
+    {
+      const pcl::PointXYZRGB &p = cloud_in->points[pool[i]];
+      ranked[i] = std::make_pair(p.x * p.x + p.y * p.y + p.z * p.z, pool[i]);
+    }
+    std::sort(ranked.begin(), ranked.end());
+    for (int i = 0; i < pool.size(); i++)
+      pool[i] = ranked[i].second;
+    groups = std::min<size_t>(PROSAC_GROUPS, pool.size() / SAMPLE_SIZE);
+  }
+  Sampler sampler(pool, groups, maxIterations);
+
+  const bool prior = options_.normal_prior.squaredNorm() > 0;
+  const double tolerance = std::min(options_.normal_tolerance, M_PI / 2);
+  const float min_cos = cos(tolerance);
+  Eigen::Vector3f normal_prior = Eigen::Vector3f::Zero();
+  std::vector<float> heights;
+  std::vector<int> by_height;
+  float slab = 0;
+  if (prior)
+  {
+    normal_prior = options_.normal_prior.normalized();
+    heights.resize(cloud.size(), 0);
+    for (int i = 0; i < pool.size(); i++)
+    {
+      const int index = pool[i];
+      heights[index] = normal_prior.dot(Eigen::Vector3f(cloud.x()[index], cloud.y()[index], cloud.z()[index]));
+    }
+    by_height = pool;
+    std::sort(by_height.begin(), by_height.end(), HeightOrder(heights));
+    // Two inliers of a plane within the tolerance differ atmost by this height,
+    // if they are atmost the diagonal of the bounding box apart
+    Eigen::Vector4f min_pt, max_pt;
+    cloud.getMinMax3D(min_pt, max_pt);
+    slab = 2 * distanceThreshold + (max_pt - min_pt).head<3>().norm() * 2 * sin(tolerance / 2);
+    sampler.setSlab(heights, by_height, slab);
+  }
+
+  int threads = options_.threads;
+  if (threads <= 0)
+    threads = boost::thread::hardware_concurrency();
+  if (threads < 1 || cloud.size() < PARALLEL_SCORING_MIN_POINTS)
+    threads = 1;
+  threads = std::min<size_t>(threads, cloud.size() / PARALLEL_SCORING_MIN_POINTS + 1);
+
+  // The blocks of the threads start at whole SSE registers
+  Scoring scoring(cloud, distanceThreshold, threads);
+  const size_t registers = (cloud.size() + SoACloud::LANES - 1) / SoACloud::LANES;
+  for (int t = 0; t < threads; t++)
+    scoring.bounds[t] = registers * t / threads * SoACloud::LANES;
+  scoring.bounds[threads] = cloud.size();
+  boost::thread_group workers;
+  for (int t = 0; t < threads - 1; t++)
+    workers.create_thread(boost::bind(&PlaneRansac::scoringWorker, &scoring, t));
+
+  Eigen::Vector4f best_plane;
+  size_t best_count = 0;
+  int required = maxIterations;
+  int sample[SAMPLE_SIZE];
+  // height of the first point of every hypothesis
+  std::vector<float> first_heights;
+  while (iterations_ < required)
+  {
+    scoring.hypotheses.clear();
+    first_heights.clear();
+    while (scoring.hypotheses.size() < BATCH_SIZE && iterations_ < required)
+    {
+      iterations_++;
+      sampler.next(sample);
+      Eigen::Vector4f plane;
+      if (!planeFromSample(cloud, sample, plane))
+        continue;
+      // Rejected before it costs a pass over the cloud
+      if (prior && fabs(plane.head<3>().dot(normal_prior)) < min_cos)
+        continue;
+      scoring.hypotheses.push_back(plane);
+      if (prior)
+        first_heights.push_back(heights[sample[0]]);
+    }
+
+    // The calling thread scores the last block
+    scoring.start.wait();
+    scoreRange(&cloud, &scoring.hypotheses, scoring.threshold, scoring.bounds[threads - 1],
+        scoring.bounds[threads], &scoring.counts[threads - 1]);
+    scoring.finish.wait();
+
+    for (int h = 0; h < scoring.hypotheses.size(); h++)
+    {
+      size_t count = 0;
+      for (int t = 0; t < threads; t++)
+        count += scoring.counts[t][h];
+      if (count > best_count)
+      {
+        best_count = count;
+        best_plane = scoring.hypotheses[h];
+        const double ratio = (double) best_count / pool.size();
+        double slab_ratio = ratio;
+        if (prior)
+        {
+          // The other points of a sample come from the slab around the first one
+          const HeightOrder order(heights);
+          const size_t in_slab = std::upper_bound(by_height.begin(), by_height.end(), first_heights[h] + slab, order)
+            - std::lower_bound(by_height.begin(), by_height.end(), first_heights[h] - slab, order);
+          slab_ratio = (double) best_count / in_slab;
+        }
+        required = std::min(required, requiredIterations(ratio, slab_ratio, options_.confidence, maxIterations));
+      }
+    }
+  }
+  scoring.done = true;
+  scoring.start.wait();
+  workers.join_all();
+
+  if (best_count == 0)
+    return 0;
+  coefficients.values.resize(4);
+  for (int k = 0; k < 4; k++)
+    coefficients.values[k] = best_plane[k];
+  inliers.indices.reserve(best_count);
+  return cloud.selectWithinDistance(best_plane, distanceThreshold, inliers.indices);
+}
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
@@ -1,8 +1,221 @@
 #include "point_cloud_operations.h"
 
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace suturo_perception_lib;
 using namespace suturo_perception_utils;
 
+namespace
+{
+  /*
+   * Keep a point of the fused filter, that passed the z-filter and the NaN check.
+   */
+  inline void keepPoint(const pcl::PointXYZRGB &p, int index, int ix, int iy, int iz,
+      pcl::PointCloud<pcl::PointXYZRGB> &cloud_filtered, std::vector<int> &removed_indices_filtered,
+      VoxelHashGrid &grid)
+  {
+    cloud_filtered.points.push_back(p);
+    removed_indices_filtered.push_back(index);
+    grid.addPoint(ix, iy, iz, p);
+  }
+
+  /*
+   * The box, that a point has to be in to pass the fused filter: the z range
+   * intersected with the crop box of the region. The other bounds are +-FLT_MAX,
+   * so comparisons reject NaN and infinite coordinates as well.
+   */
+  struct FilterBounds
+  {
+    FilterBounds(float zAxisFilterMin, float zAxisFilterMax, const ProcessingRegion &region)
+    {
+      for (int k = 0; k < 3; k++)
+      {
+        min[k] = region.box_min[k];
+        max[k] = region.box_max[k];
+      }
+      min[2] = std::max(min[2], zAxisFilterMin);
+      max[2] = std::min(max[2], zAxisFilterMax);
+    }
+
+    bool contains(const pcl::PointXYZRGB &p) const
+    {
+      return p.z >= min[2] && p.z <= max[2] && p.x >= min[0] && p.x <= max[0] && p.y >= min[1] && p.y <= max[1];
+    }
+
+    float min[3];
+    float max[3];
+  };
+
+  inline void filterPoint(const pcl::PointXYZRGB &p, int index, const FilterBounds &bounds,
+      pcl::PointCloud<pcl::PointXYZRGB> &cloud_filtered, std::vector<int> &removed_indices_filtered,
+      VoxelHashGrid &grid)
+  {
+    if (bounds.contains(p))
+    {
+      keepPoint(p, index, grid.voxelCoordinate(p.x), grid.voxelCoordinate(p.y), grid.voxelCoordinate(p.z),
+          cloud_filtered, removed_indices_filtered, grid);
+    }
+  }
+
+  // Clouds below this size are voxelized by a single thread
+  const size_t PARALLEL_DOWNSAMPLE_MIN_POINTS = 50000;
+
+  int downsampleThreads(size_t points)
+  {
+    if (points < PARALLEL_DOWNSAMPLE_MIN_POINTS)
+      return 1;
+    int threads = boost::thread::hardware_concurrency();
+    if (threads < 1)
+      threads = 1;
+    return std::min<size_t>(threads, points / PARALLEL_DOWNSAMPLE_MIN_POINTS + 1);
+  }
+
+  // Add the finite points [begin, end) of cloud to grid
+  void accumulateCloud(const pcl::PointCloud<pcl::PointXYZRGB> *cloud, size_t begin, size_t end, VoxelHashGrid *grid)
+  {
+    grid->reserve((end - begin) / 4);
+    for (size_t i = begin; i < end; i++)
+    {
+      if (pcl::isFinite(cloud->points[i]))
+        grid->addPoint(cloud->points[i]);
+    }
+  }
+
+  // Add the finite points of the rows [row_begin, row_end) of view to grid
+  void accumulateView(const PointCloud2View *view, uint32_t row_begin, uint32_t row_end, VoxelHashGrid *grid)
+  {
+    grid->reserve((size_t)(row_end - row_begin) * view->width() / 4);
+    pcl::PointXYZRGB p;
+    for (uint32_t row = row_begin; row < row_end; row++)
+    {
+      for (uint32_t column = 0; column < view->width(); column++)
+      {
+        view->getPoint(row, column, p);
+        if (pcl::isFinite(p))
+          grid->addPoint(p);
+      }
+    }
+  }
+
+#ifdef __SSE2__
+  // floor() for four floats. SSE2 has no rounding mode for this, so truncate
+  // and correct the negative values
+  inline __m128i floor4(__m128 v)
+  {
+    __m128i t = _mm_cvttps_epi32(v);
+    __m128i correction = _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(t), v)); // -1 where t > v
+    return _mm_add_epi32(t, correction);
+  }
+#endif
+
+  /*
+   * Fused filter of the points [begin, end) of a cloud. The indices of the
+   * kept points are their indices in points.
+   */
+  void filterRange(const pcl::PointCloud<pcl::PointXYZRGB>::VectorType &points, int begin, int end,
+      const FilterBounds &bounds, pcl::PointCloud<pcl::PointXYZRGB> &cloud_filtered,
+      std::vector<int> &removed_indices_filtered, VoxelHashGrid &grid)
+  {
+    int i = begin;
+#ifdef __SSE2__
+    // Test four points at once. The xyz part of a PointXYZRGB is 16 byte aligned
+    const __m128 x_min = _mm_set1_ps(bounds.min[0]);
+    const __m128 x_max = _mm_set1_ps(bounds.max[0]);
+    const __m128 y_min = _mm_set1_ps(bounds.min[1]);
+    const __m128 y_max = _mm_set1_ps(bounds.max[1]);
+    const __m128 z_min = _mm_set1_ps(bounds.min[2]);
+    const __m128 z_max = _mm_set1_ps(bounds.max[2]);
+    const __m128 inverse_leaf = _mm_set1_ps(grid.inverseLeafSize());
+    int ix[4], iy[4], iz[4];
+    for (; i + 4 <= end; i += 4)
+    {
+      __m128 x = _mm_load_ps(points[i].data);
+      __m128 y = _mm_load_ps(points[i + 1].data);
+      __m128 z = _mm_load_ps(points[i + 2].data);
+      __m128 w = _mm_load_ps(points[i + 3].data);
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+
+      // inside of the bounds (false for NaN, and for inf because of the finite bounds)
+      __m128 keep = _mm_and_ps(_mm_cmpge_ps(z, z_min), _mm_cmple_ps(z, z_max));
+      keep = _mm_and_ps(keep, _mm_and_ps(_mm_cmpge_ps(x, x_min), _mm_cmple_ps(x, x_max)));
+      keep = _mm_and_ps(keep, _mm_and_ps(_mm_cmpge_ps(y, y_min), _mm_cmple_ps(y, y_max)));
+      int mask = _mm_movemask_ps(keep);
+      if (mask == 0)
+        continue;
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(ix), floor4(_mm_mul_ps(x, inverse_leaf)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(iy), floor4(_mm_mul_ps(y, inverse_leaf)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(iz), floor4(_mm_mul_ps(z, inverse_leaf)));
+      for (int k = 0; k < 4; k++)
+      {
+        if (mask & (1 << k))
+          keepPoint(points[i + k], i + k, ix[k], iy[k], iz[k], cloud_filtered, removed_indices_filtered, grid);
+      }
+    }
+#endif
+    for (; i < end; i++)
+    {
+      filterPoint(points[i], i, bounds, cloud_filtered, removed_indices_filtered, grid);
+    }
+  }
+
+  // Read the points of a pcl cloud by pixel, like a PointCloud2View
+  class OrganizedCloudReader
+  {
+    public:
+      OrganizedCloudReader(const pcl::PointCloud<pcl::PointXYZRGB> &cloud) : cloud_(cloud) {}
+      uint32_t width() const { return cloud_.width; }
+      uint32_t height() const { return cloud_.height; }
+      void getPoint(uint32_t row, uint32_t column, pcl::PointXYZRGB &p) const
+      {
+        p = cloud_.points[row * cloud_.width + column];
+      }
+    private:
+      const pcl::PointCloud<pcl::PointXYZRGB> &cloud_;
+  };
+
+  /*
+   * Copy the pixel ROI of region into the organized cloud_out. Points outside
+   * of the bounds get NaN coordinates. pixel_indices maps the points of cloud_out
+   * to their index in the frame.
+   */
+  template <typename Reader>
+  void cropOrganizedFrame(const Reader &frame, const ProcessingRegion &region, const FilterBounds &bounds,
+      pcl::PointCloud<pcl::PointXYZRGB> &cloud_out, std::vector<int> &pixel_indices)
+  {
+    uint32_t column_begin, column_end, row_begin, row_end;
+    region.pixelRange(frame.width(), frame.height(), column_begin, column_end, row_begin, row_end);
+    const uint32_t width = column_end - column_begin;
+    const uint32_t height = row_end - row_begin;
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    cloud_out.points.resize((size_t) width * height);
+    pixel_indices.resize(cloud_out.points.size());
+    size_t index = 0;
+    for (uint32_t row = row_begin; row < row_end; row++)
+    {
+      int pixel = row * frame.width() + column_begin;
+      for (uint32_t column = column_begin; column < column_end; column++, index++, pixel++)
+      {
+        pcl::PointXYZRGB &p = cloud_out.points[index];
+        frame.getPoint(row, column, p);
+        if (!bounds.contains(p))
+          p.x = p.y = p.z = nan;
+        pixel_indices[index] = pixel;
+      }
+    }
+    cloud_out.width = width;
+    cloud_out.height = height;
+    cloud_out.is_dense = false;
+  }
+}
+
 /*
  * Remove NaNs from given pointcloud. 
  * Return the nanles cloud.
@@ -10,14 +223,10 @@ using namespace suturo_perception_utils;
 void PointCloudOperations::removeNans(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_nanles)
 {
-  Logger logger("point_cloud_operations");
-  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  ScopedTimer timer("point_cloud_operations/removeNans");
 
   std::vector<int> nans;
   pcl::removeNaNFromPointCloud(*cloud_in,*cloud_nanles,nans);
-
-  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(s, e, "removeNans()");
 }
 
 /**
@@ -39,50 +248,308 @@ void
     return;
   }
 
-  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  ScopedTimer timer("point_cloud_operations/filterZAxis");
 
   pass.setInputCloud(cloud_in);
   pass.setFilterFieldName("z");
   pass.setFilterLimits(zAxisFilterMin, zAxisFilterMax);
   pass.setKeepOrganized(true);
   pass.filter(*cloud_out);
-
-  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(s, e, "filterZAxis()");
 }
 
 /*
- * Downsample the input cloud with a pcl::VoxelGrid
+ * Downsample the input cloud with a hash based voxel grid.
+ * The centroids and averaged colors are the same as the ones of a pcl::VoxelGrid,
+ * but no index list has to be sorted. Big clouds will be split into chunks,
+ * that are voxelized in parallel and merged afterwards.
+ * cloud_in and cloud_out may be the same cloud.
  * Return the filtered cloud.
  */
 void 
  PointCloudOperations::downsample(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, float downsampleLeafSize)
+{
+  ScopedTimer timer("point_cloud_operations/downsample");
+
+  const size_t size = cloud_in->points.size();
+  const int threads = downsampleThreads(size);
+  std::vector<boost::shared_ptr<VoxelHashGrid> > grids;
+  boost::thread_group workers;
+  for (int t = 0; t < threads; t++)
+  {
+    grids.push_back(boost::shared_ptr<VoxelHashGrid>(new VoxelHashGrid(downsampleLeafSize)));
+    size_t begin = size * t / threads;
+    size_t end = size * (t + 1) / threads;
+    if (t == threads - 1)
+      accumulateCloud(cloud_in.get(), begin, end, grids[t].get()); // use the calling thread as well
+    else
+      workers.create_thread(boost::bind(&accumulateCloud, cloud_in.get(), begin, end, grids[t].get()));
+  }
+  workers.join_all();
+
+  for (int t = 1; t < threads; t++)
+    grids[0]->merge(*grids[t]);
+  grids[0]->getCentroids(*cloud_out);
+}
+
+/*
+ * Copy all finite points of the given view into cloud_nanles.
+ */
+void PointCloudOperations::removeNans(const PointCloud2View &view,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_nanles)
+{
+  ScopedTimer timer("point_cloud_operations/removeNans");
+
+  cloud_nanles->points.clear();
+  cloud_nanles->points.reserve(view.size());
+  pcl::PointXYZRGB p;
+  for (uint32_t row = 0; row < view.height(); row++)
+  {
+    for (uint32_t column = 0; column < view.width(); column++)
+    {
+      view.getPoint(row, column, p);
+      if (pcl::isFinite(p))
+        cloud_nanles->points.push_back(p);
+    }
+  }
+  cloud_nanles->width = cloud_nanles->points.size();
+  cloud_nanles->height = 1;
+  cloud_nanles->is_dense = true;
+}
+
+/*
+ * Filter the view on the z-axis and copy the result into cloud_out.
+ * If keepOrganized is set, cloud_out will have the dimensions of the view and
+ * the coordinates of filtered points are set to NaN, like a pcl::PassThrough
+ * with setKeepOrganized(true) would do.
+ */
+void 
+ PointCloudOperations::filterZAxis(const PointCloud2View &view,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out,
+    float zAxisFilterMin, float zAxisFilterMax, bool keepOrganized)
 {
   Logger logger("point_cloud_operations");
-  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
 
-  pcl::VoxelGrid <pcl::PointXYZRGB> vg;
-  vg.setInputCloud(cloud_in);
-  vg.setLeafSize(downsampleLeafSize,downsampleLeafSize,downsampleLeafSize);
-  vg.filter(*cloud_out);
+  if(view.size() == 0)
+  {
+    logger.logError("Could not filter on Z Axis. input cloud empty");
+    return;
+  }
+
+  ScopedTimer timer("point_cloud_operations/filterZAxis");
+
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  cloud_out->points.clear();
+  if (keepOrganized)
+    cloud_out->points.resize(view.size());
+  else
+    cloud_out->points.reserve(view.size());
+
+  pcl::PointXYZRGB p;
+  size_t index = 0;
+  for (uint32_t row = 0; row < view.height(); row++)
+  {
+    for (uint32_t column = 0; column < view.width(); column++, index++)
+    {
+      view.getPoint(row, column, p);
+      // comparisons with NaN are false, so invalid points are filtered as well
+      bool inside = p.z >= zAxisFilterMin && p.z <= zAxisFilterMax;
+      if (keepOrganized)
+      {
+        if (!inside)
+          p.x = p.y = p.z = nan;
+        cloud_out->points[index] = p;
+      }
+      else if (inside && pcl_isfinite(p.x) && pcl_isfinite(p.y))
+      {
+        cloud_out->points.push_back(p);
+      }
+    }
+  }
 
-  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(s, e, "downsample()");
+  if (keepOrganized)
+  {
+    cloud_out->width = view.width();
+    cloud_out->height = view.height();
+    cloud_out->is_dense = false;
+  }
+  else
+  {
+    cloud_out->width = cloud_out->points.size();
+    cloud_out->height = 1;
+    cloud_out->is_dense = true;
+  }
+}
+
+/*
+ * Downsample the finite points of the view with a hash based voxel grid.
+ * Same as above, but the rows of the view are split between the threads.
+ */
+void 
+ PointCloudOperations::downsample(const PointCloud2View &view,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, float downsampleLeafSize)
+{
+  ScopedTimer timer("point_cloud_operations/downsample");
+
+  const int threads = std::min<int>(downsampleThreads(view.size()), view.height());
+  std::vector<boost::shared_ptr<VoxelHashGrid> > grids;
+  boost::thread_group workers;
+  for (int t = 0; t < threads; t++)
+  {
+    grids.push_back(boost::shared_ptr<VoxelHashGrid>(new VoxelHashGrid(downsampleLeafSize)));
+    uint32_t begin = (uint64_t) view.height() * t / threads;
+    uint32_t end = (uint64_t) view.height() * (t + 1) / threads;
+    if (t == threads - 1)
+      accumulateView(&view, begin, end, grids[t].get());
+    else
+      workers.create_thread(boost::bind(&accumulateView, &view, begin, end, grids[t].get()));
+  }
+  workers.join_all();
+
+  for (int t = 1; t < threads; t++)
+    grids[0]->merge(*grids[t]);
+  if (threads > 0)
+    grids[0]->getCentroids(*cloud_out);
+}
+
+/*
+ * Fused z-filter, NaN removal and voxel grid downsampling.
+ * Every point of cloud_in is read once. Points with a finite position inside of
+ * [zAxisFilterMin, zAxisFilterMax] are copied into cloud_filtered and accumulated
+ * in a hash based voxel grid, whose centroids are written to cloud_downsampled.
+ * removed_indices_filtered maps every point of cloud_filtered to its index in cloud_in.
+ *
+ * The result is the same as the one of filterZAxis, removeNans and downsample,
+ * but without the keepOrganized copy and the sorting of the pcl::VoxelGrid.
+ *
+ * Only the points inside of region are considered. Of an organized cloud,
+ * only the rows and columns of the pixel ROI are read at all.
+ */
+void
+ PointCloudOperations::filterAndDownsample(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered, std::vector<int> &removed_indices_filtered,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_downsampled,
+    float zAxisFilterMin, float zAxisFilterMax, float downsampleLeafSize,
+    const ProcessingRegion &region)
+{
+  ScopedTimer timer("point_cloud_operations/filterAndDownsample");
+
+  const pcl::PointCloud<pcl::PointXYZRGB>::VectorType &points = cloud_in->points;
+  const int size = points.size();
+  cloud_filtered->points.clear();
+  cloud_filtered->points.reserve(size);
+  removed_indices_filtered.clear();
+  removed_indices_filtered.reserve(size);
+  VoxelHashGrid grid(downsampleLeafSize);
+
+  const FilterBounds bounds(zAxisFilterMin, zAxisFilterMax, region);
+  uint32_t column_begin, column_end, row_begin, row_end;
+  region.pixelRange(cloud_in->width, cloud_in->height, column_begin, column_end, row_begin, row_end);
+  if (cloud_in->height <= 1)
+  {
+    filterRange(points, 0, size, bounds, *cloud_filtered, removed_indices_filtered, grid);
+  }
+  else
+  {
+    // Only the rows and columns of the pixel ROI are read
+    for (uint32_t row = row_begin; row < row_end; row++)
+    {
+      int row_start = row * cloud_in->width;
+      filterRange(points, row_start + column_begin, row_start + column_end, bounds,
+          *cloud_filtered, removed_indices_filtered, grid);
+    }
+  }
+
+  cloud_filtered->width = cloud_filtered->points.size();
+  cloud_filtered->height = 1;
+  cloud_filtered->is_dense = true;
+  grid.getCentroids(*cloud_downsampled);
+}
+
+/*
+ * Fused z-filter, NaN removal and voxel grid downsampling on the buffer of a PointCloud2.
+ * Same as above, the indices refer to the points of the view.
+ */
+void
+ PointCloudOperations::filterAndDownsample(const PointCloud2View &view,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered, std::vector<int> &removed_indices_filtered,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_downsampled,
+    float zAxisFilterMin, float zAxisFilterMax, float downsampleLeafSize,
+    const ProcessingRegion &region)
+{
+  ScopedTimer timer("point_cloud_operations/filterAndDownsample");
+
+  cloud_filtered->points.clear();
+  cloud_filtered->points.reserve(view.size());
+  removed_indices_filtered.clear();
+  removed_indices_filtered.reserve(view.size());
+  VoxelHashGrid grid(downsampleLeafSize);
+
+  // The fields of a message are not aligned, so this is a scalar loop
+  const FilterBounds bounds(zAxisFilterMin, zAxisFilterMax, region);
+  uint32_t column_begin, column_end, row_begin, row_end;
+  region.pixelRange(view.width(), view.height(), column_begin, column_end, row_begin, row_end);
+  pcl::PointXYZRGB p;
+  for (uint32_t row = row_begin; row < row_end; row++)
+  {
+    int index = row * view.width() + column_begin;
+    for (uint32_t column = column_begin; column < column_end; column++, index++)
+    {
+      view.getPoint(row, column, p);
+      filterPoint(p, index, bounds, *cloud_filtered, removed_indices_filtered, grid);
+    }
+  }
+
+  cloud_filtered->width = cloud_filtered->points.size();
+  cloud_filtered->height = 1;
+  cloud_filtered->is_dense = true;
+  grid.getCentroids(*cloud_downsampled);
+}
+
+/*
+ * Copy the pixel ROI of region out of the organized cloud_in. cloud_out stays organized
+ * with the size of the ROI, points outside of the z range or the crop box get NaN coordinates.
+ * pixel_indices maps every point of cloud_out to its index in cloud_in.
+ */
+void
+ PointCloudOperations::cropOrganized(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    const ProcessingRegion &region, float zAxisFilterMin, float zAxisFilterMax,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, std::vector<int> &pixel_indices)
+{
+  ScopedTimer timer("point_cloud_operations/cropOrganized");
+
+  cropOrganizedFrame(OrganizedCloudReader(*cloud_in), region, FilterBounds(zAxisFilterMin, zAxisFilterMax, region),
+      *cloud_out, pixel_indices);
+  cloud_out->header = cloud_in->header;
+}
+
+/*
+ * Same as above, for the buffer of a PointCloud2.
+ */
+void
+ PointCloudOperations::cropOrganized(const PointCloud2View &view,
+    const ProcessingRegion &region, float zAxisFilterMin, float zAxisFilterMax,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, std::vector<int> &pixel_indices)
+{
+  ScopedTimer timer("point_cloud_operations/cropOrganized");
+
+  cropOrganizedFrame(view, region, FilterBounds(zAxisFilterMin, zAxisFilterMax, region), *cloud_out, pixel_indices);
 }
 
 /*
  * Fit plane to the input cloud
  * Return the inliers.
+ * planeMaxIterations is an upper bound, the search stops as soon as the best
+ * plane has been found with the confidence of the RansacOptions.
  */
 void 
  PointCloudOperations::fitPlanarModel(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
     pcl::PointIndices::Ptr inliers, pcl::ModelCoefficients::Ptr coefficients, 
     int planeMaxIterations, 
-    double planeDistanceThreshold)
+    double planeDistanceThreshold, const RansacOptions &ransac)
 {
   Logger logger("point_cloud_operations");
-  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  ScopedTimer timer("point_cloud_operations/fitPlanarModel");
 
   if(cloud_in->points.size() == 0)
   {
@@ -90,20 +557,257 @@ void
     return;
   }
 
-  pcl::SACSegmentation<pcl::PointXYZRGB> seg;
-  seg.setModelType(pcl::SACMODEL_PLANE); // TODO: parameterize
-  seg.setMethodType(pcl::SAC_RANSAC);    // TODO: parameterize
-  seg.setMaxIterations(planeMaxIterations);
-  seg.setDistanceThreshold(planeDistanceThreshold);
-  seg.setInputCloud(cloud_in);
-  seg.segment(*inliers,*coefficients);
-  if (inliers->indices.size () == 0)
+  PlaneRansac plane_ransac(ransac);
+  int inlier_count = plane_ransac.fit(cloud_in, planeMaxIterations, planeDistanceThreshold, *inliers, *coefficients);
+  MetricsRegistry::instance().increment("point_cloud_operations/ransac_iterations", plane_ransac.getIterations());
+  if (inlier_count == 0)
   {
     logger.logError("Could not estimate a planar model for the given dataset. The inlier size is 0");
+    return;
+  }
+
+  // Like the optimized coefficients of pcl::SACSegmentation
+  refinePlanarModel(cloud_in, inliers, coefficients);
+  scorePlanarModel(cloud_in, coefficients, planeDistanceThreshold, inliers);
+}
+
+/*
+ * Coarse-to-fine plane fitting.
+ * The RANSAC search runs on a copy of cloud_in, that is voxelized with coarseLeafSize.
+ * That plane is refined by least-squares fits on its inliers in cloud_full,
+ * so the accuracy doesn't depend on the leaf size of the search.
+ * full_inliers will contain the inliers of the refined plane in cloud_full,
+ * inliers the ones in cloud_in.
+ */
+void
+ PointCloudOperations::fitPlanarModelCoarseToFine(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_full,
+    pcl::PointIndices::Ptr inliers, pcl::PointIndices::Ptr full_inliers,
+    pcl::ModelCoefficients::Ptr coefficients,
+    int planeMaxIterations, double planeDistanceThreshold, float coarseLeafSize, const RansacOptions &ransac)
+{
+  Logger logger("point_cloud_operations");
+  ScopedTimer timer("point_cloud_operations/fitPlanarModelCoarseToFine");
+
+  full_inliers->indices.clear();
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_coarse (new pcl::PointCloud<pcl::PointXYZRGB>);
+  downsample(cloud_in, cloud_coarse, coarseLeafSize);
+  if(cloud_coarse->points.size() < 3)
+  {
+    logger.logWarn("Coarse cloud too small for the plane search. Using the input cloud");
+    fitPlanarModel(cloud_in, inliers, coefficients, planeMaxIterations, planeDistanceThreshold, ransac);
+    return;
+  }
+
+  fitPlanarModel(cloud_coarse, inliers, coefficients, planeMaxIterations, planeDistanceThreshold, ransac);
+  if(inliers->indices.size() == 0)
+    return;
+  logger.logInfo((boost::format("Coarse plane: %s of %s points") % inliers->indices.size()
+        % cloud_coarse->points.size()).str());
+
+  // The coarse plane can be a bit off, so the inliers get collected and fitted twice.
+  // cloud_full is scored on every pass, so only its coordinates are streamed
+  SoACloud full_coordinates(*cloud_full);
+  for (int i = 0; i < COARSE_TO_FINE_REFINEMENTS; i++)
+  {
+    if(scorePlanarModel(full_coordinates, coefficients, planeDistanceThreshold, full_inliers) < 3)
+      break;
+    refinePlanarModel(cloud_full, full_inliers, coefficients);
+  }
+  scorePlanarModel(full_coordinates, coefficients, planeDistanceThreshold, full_inliers);
+  scorePlanarModel(cloud_in, coefficients, planeDistanceThreshold, inliers);
+}
+
+/*
+ * Fit a plane to an organized input cloud.
+ * Normals are estimated with integral images and the planes are
+ * segmented as connected components on the pixel grid. Both steps
+ * are linear in the number of pixels.
+ *
+ * The biggest planar region will be put into cloud_out, the inliers
+ * reference the organized cloud_in.
+ * Returns false, if no plane with atleast planeMinInliers points could be found.
+ */
+bool
+ PointCloudOperations::fitPlanarModelOrganized(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out,
+    pcl::PointIndices::Ptr inliers, pcl::ModelCoefficients::Ptr coefficients,
+    int planeMinInliers, double planeAngularThreshold,
+    double planeDistanceThreshold)
+{
+  Logger logger("point_cloud_operations");
+  ScopedTimer timer("point_cloud_operations/fitPlanarModelOrganized");
+
+  if(!cloud_in->isOrganized())
+  {
+    logger.logError("Could not estimate a planar model on the pixel grid. input cloud is not organized");
+    return false;
+  }
+
+  // Normals from integral images. NaNs (e.g. from the z-filter) are handled
+  // by the estimation and result in NaN normals
+  pcl::PointCloud<pcl::Normal>::Ptr normals (new pcl::PointCloud<pcl::Normal>);
+  pcl::IntegralImageNormalEstimation<pcl::PointXYZRGB, pcl::Normal> ne;
+  ne.setNormalEstimationMethod(pcl::IntegralImageNormalEstimation<pcl::PointXYZRGB, pcl::Normal>::COVARIANCE_MATRIX);
+  ne.setMaxDepthChangeFactor(0.02f);
+  ne.setNormalSmoothingSize(10.0f);
+  ne.setInputCloud(cloud_in);
+  ne.compute(*normals);
+
+  pcl::OrganizedMultiPlaneSegmentation<pcl::PointXYZRGB, pcl::Normal, pcl::Label> mps;
+  mps.setMinInliers(planeMinInliers);
+  mps.setAngularThreshold(planeAngularThreshold);
+  mps.setDistanceThreshold(planeDistanceThreshold);
+  mps.setInputNormals(normals);
+  mps.setInputCloud(cloud_in);
+
+  std::vector<pcl::ModelCoefficients> model_coefficients;
+  std::vector<pcl::PointIndices> inlier_indices;
+  mps.segment(model_coefficients, inlier_indices);
+
+  logger.logInfo((boost::format("Found %s planar regions on the pixel grid") % inlier_indices.size()).str());
+  if(inlier_indices.size() == 0)
+  {
+    logger.logError("Could not estimate a planar model on the pixel grid. No region found");
+    return false;
+  }
+
+  // Take the biggest region. This will be most likely our table
+  int biggest = 0;
+  for (int i = 1; i < inlier_indices.size(); i++)
+  {
+    if(inlier_indices.at(i).indices.size() > inlier_indices.at(biggest).indices.size())
+      biggest = i;
+  }
+  inliers->indices = inlier_indices.at(biggest).indices;
+  *coefficients = model_coefficients.at(biggest);
+
+  cloud_out->points.clear();
+  cloud_out->points.reserve(inliers->indices.size());
+  for (std::vector<int>::const_iterator pit = inliers->indices.begin (); pit != inliers->indices.end (); pit++)
+    cloud_out->points.push_back (cloud_in->points[*pit]);
+  cloud_out->width = cloud_out->points.size ();
+  cloud_out->height = 1;
+  cloud_out->is_dense = true;
+  return true;
+}
+
+/*
+ * Score a known plane against cloud_in.
+ * All points within planeDistanceThreshold will be put into inliers.
+ * Return the number of inliers.
+ */
+int
+ PointCloudOperations::scorePlanarModel(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    const pcl::ModelCoefficients::Ptr coefficients, double planeDistanceThreshold,
+    pcl::PointIndices::Ptr inliers)
+{
+  inliers->indices.clear();
+  if(coefficients->values.size() != 4)
+    return 0;
+
+  float a = coefficients->values[0];
+  float b = coefficients->values[1];
+  float c = coefficients->values[2];
+  float d = coefficients->values[3];
+  float norm = sqrt(a * a + b * b + c * c);
+  if(norm == 0)
+    return 0;
+  // compare against the scaled threshold instead of normalizing every distance
+  float threshold = planeDistanceThreshold * norm;
+
+  const pcl::PointCloud<pcl::PointXYZRGB>::VectorType &points = cloud_in->points;
+  const int size = points.size();
+  inliers->indices.reserve(size);
+  int i = 0;
+#ifdef __SSE2__
+  // Distances of four points at once. NaN points are never inliers
+  const __m128 va = _mm_set1_ps(a);
+  const __m128 vb = _mm_set1_ps(b);
+  const __m128 vc = _mm_set1_ps(c);
+  const __m128 vd = _mm_set1_ps(d);
+  const __m128 vthreshold = _mm_set1_ps(threshold);
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  for (; i + 4 <= size; i += 4)
+  {
+    __m128 x = _mm_load_ps(points[i].data);
+    __m128 y = _mm_load_ps(points[i + 1].data);
+    __m128 z = _mm_load_ps(points[i + 2].data);
+    __m128 w = _mm_load_ps(points[i + 3].data);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+
+    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(va, x), _mm_mul_ps(vb, y)),
+        _mm_add_ps(_mm_mul_ps(vc, z), vd));
+    int mask = _mm_movemask_ps(_mm_cmple_ps(_mm_andnot_ps(sign, distance), vthreshold));
+    if (mask == 0)
+      continue;
+    for (int k = 0; k < 4; k++)
+    {
+      if (mask & (1 << k))
+        inliers->indices.push_back(i + k);
+    }
   }
+#endif
+  for (; i < size; i++)
+  {
+    const pcl::PointXYZRGB &p = points[i];
+    if(fabs(a * p.x + b * p.y + c * p.z + d) <= threshold)
+      inliers->indices.push_back(i);
+  }
+  return inliers->indices.size();
+}
 
-  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(s, e, "fitPlanarModel()");
+/*
+ * Same as above on the coordinate arrays of a SoACloud.
+ */
+int
+ PointCloudOperations::scorePlanarModel(const SoACloud &cloud_in,
+    const pcl::ModelCoefficients::Ptr coefficients, double planeDistanceThreshold,
+    pcl::PointIndices::Ptr inliers)
+{
+  inliers->indices.clear();
+  if(coefficients->values.size() != 4)
+    return 0;
+
+  Eigen::Vector4f plane(coefficients->values[0], coefficients->values[1],
+      coefficients->values[2], coefficients->values[3]);
+  inliers->indices.reserve(cloud_in.size());
+  return cloud_in.selectWithinDistance(plane, planeDistanceThreshold, inliers->indices);
+}
+
+/*
+ * Refit the plane in coefficients to the given inliers of cloud_in
+ * by a least-squares fit (smallest eigenvector of the covariance matrix).
+ * The normal will point to the same side as before.
+ */
+void
+ PointCloudOperations::refinePlanarModel(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    const pcl::PointIndices::Ptr inliers, pcl::ModelCoefficients::Ptr coefficients)
+{
+  if(inliers->indices.size() < 3)
+    return;
+
+  Eigen::Matrix3f covariance_matrix;
+  Eigen::Vector4f centroid;
+  pcl::computeMeanAndCovarianceMatrix(*cloud_in, inliers->indices, covariance_matrix, centroid);
+
+  EIGEN_ALIGN16 Eigen::Vector3f::Scalar eigen_value;
+  EIGEN_ALIGN16 Eigen::Vector3f eigen_vector;
+  pcl::eigen33(covariance_matrix, eigen_value, eigen_vector);
+
+  // keep the orientation of the old normal
+  if(coefficients->values.size() == 4)
+  {
+    Eigen::Vector3f old_normal(coefficients->values[0], coefficients->values[1], coefficients->values[2]);
+    if(old_normal.dot(eigen_vector) < 0)
+      eigen_vector = -eigen_vector;
+  }
+
+  coefficients->values.resize(4);
+  coefficients->values[0] = eigen_vector[0];
+  coefficients->values[1] = eigen_vector[1];
+  coefficients->values[2] = eigen_vector[2];
+  coefficients->values[3] = -eigen_vector.dot(centroid.head<3>());
 }
 
 void PointCloudOperations::extractInliersFromPointCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
@@ -129,7 +833,7 @@ pcl::PointIndices::Ptr inliers, pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out
 * If you want to map the original inliers (which correspond to the input cloud_in), you can pass in a Pointer to the old inliers and receive the new inliers after the clustering in new_inliers.
 * When both inlier pointers are NOT NULL, the mapping will be calculated and put into new_inliers.
 *
-* ecObjClusterTolerance sets the ClusterTolance in pcl::EuclideanClusterExtraction.
+* ecClusterTolerance sets the ClusterTolance of the EuclideanClustering.
 * ecMinClusterSize ist the minimum size of a cluster, while ecMaxClusterSize is the maximum size of the cluster.
 */
 bool PointCloudOperations::extractBiggestCluster(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in, pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out, const pcl::PointIndices::Ptr old_inliers, pcl::PointIndices::Ptr new_inliers,
@@ -138,7 +842,7 @@ bool PointCloudOperations::extractBiggestCluster(const pcl::PointCloud<pcl::Poin
     int ecMaxClusterSize)
 {
   Logger logger("point_cloud_operations");
-  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  ScopedTimer timer("point_cloud_operations/extractBiggestCluster");
   // Should we map the extracted points to the inliers in the input cloud?
   bool map_indices=false;
   if(old_inliers != NULL && new_inliers != NULL)
@@ -151,19 +855,8 @@ bool PointCloudOperations::extractBiggestCluster(const pcl::PointCloud<pcl::Poin
   }
 
   // Use cluster extraction to get rid of the outliers of the segmented table
-  pcl::search::KdTree<pcl::PointXYZRGB>::Ptr treeTable (new pcl::search::KdTree<pcl::PointXYZRGB>);
-  treeTable->setInputCloud (cloud_in);  
   std::vector<pcl::PointIndices> cluster_indices;
-  pcl::EuclideanClusterExtraction<pcl::PointXYZRGB> ecTable;
-  ecTable.setClusterTolerance (ecClusterTolerance); // 2cm
-  ecTable.setMinClusterSize (ecMinClusterSize);
-  ecTable.setMaxClusterSize (ecMaxClusterSize);
-  ecTable.setSearchMethod (treeTable);
-  ecTable.setInputCloud (cloud_in);
-  ecTable.extract (cluster_indices);
-
-  std::vector<int> cluster_get_indices;
-  cluster_get_indices = *ecTable.getIndices();
+  EuclideanClustering::extract(cloud_in, ecClusterTolerance, ecMinClusterSize, ecMaxClusterSize, cluster_indices);
 
   logger.logInfo((boost::format("cluster_indices vector size: %s") % cluster_indices.size()).str());
 
@@ -180,11 +873,8 @@ bool PointCloudOperations::extractBiggestCluster(const pcl::PointCloud<pcl::Poin
     cloud_out->points.push_back (cloud_in->points[*pit]); 
 
     if(map_indices)
-      new_inliers->indices.push_back(cluster_get_indices.at(*pit)); // Map the indices
-                                                                  // from the cluster extraction
-                                                                  // to a proper PointIndicies
-                                                                  // instance relative to our
-                                                                  // original plane
+      new_inliers->indices.push_back(*pit); // The cluster indices are relative to our
+                                            // original plane already
   }
   cloud_out->width = cloud_out->points.size ();
   cloud_out->height = 1;
@@ -193,12 +883,129 @@ bool PointCloudOperations::extractBiggestCluster(const pcl::PointCloud<pcl::Poin
   // logger.logError("New Inliers calculated: " << new_inliers->indices.size());
 
   // if(writer_pcd) writer.write ("cloud_out.pcd", *cloud_out, false);
-
-  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(s, e, "extractBiggestCluster()");
   return true;
 }
 
+/*
+ * Iterative plane extraction for scenes with more than one support surface, like shelves.
+ * The biggest plane of the remaining points is fitted and removed, until it has less than
+ * minInliers points or maxPlanes planes have been removed. The up direction is the
+ * normal prior of the RansacOptions. Then the RANSAC only finds planes close to it, so walls
+ * are never removed. Without a prior, the first plane, oriented to the sensor origin,
+ * defines the up direction, which is wrong, if the biggest plane is a wall or a board
+ * seen from below. Planes, that are not parallel to up (within maxAngle), are
+ * removed as well (e.g. walls), but don't become surfaces.
+ * Every plane is split into its connected parts (clusterTolerance). The parts with atleast
+ * minInliers points are the surfaces, biggest part of a plane first. Their coefficients are
+ * refined on the part and all normals point in the up direction, so the objects of every
+ * surface lie on the positive side of its plane.
+ * plane_points gets the indices of the points of every removed plane.
+ * Returns the number of surfaces.
+ */
+int PointCloudOperations::fitSupportSurfaces(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    int maxSurfaces, int minInliers, double maxAngle, int planeMaxIterations, double planeDistanceThreshold,
+    double clusterTolerance, std::vector<pcl::PointIndices> &surfaces,
+    std::vector<pcl::ModelCoefficients::Ptr> &coefficients, pcl::PointIndices &plane_points,
+    const RansacOptions &ransac)
+{
+  Logger logger("point_cloud_operations");
+  ScopedTimer timer("point_cloud_operations/fitSupportSurfaces");
+
+  surfaces.clear();
+  coefficients.clear();
+  plane_points.indices.clear();
+  if (minInliers < 3)
+    minInliers = 3;
+
+  std::vector<int> remaining(cloud_in->points.size());
+  for (int i = 0; i < remaining.size(); i++)
+    remaining[i] = i;
+  std::vector<char> in_plane(cloud_in->points.size(), 0);
+
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr rest (new pcl::PointCloud<pcl::PointXYZRGB>);
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr plane (new pcl::PointCloud<pcl::PointXYZRGB>);
+  pcl::PointIndices::Ptr inliers (new pcl::PointIndices);
+  const bool prior = ransac.normal_prior.squaredNorm() > 0;
+  Eigen::Vector3f up = prior ? ransac.normal_prior.normalized() : Eigen::Vector3f::Zero();
+  const float min_cos = cos(maxAngle);
+  for (int attempt = 0; attempt < MAX_SURFACE_PLANES && surfaces.size() < maxSurfaces &&
+      remaining.size() >= minInliers; attempt++)
+  {
+    rest->points.resize(remaining.size());
+    for (int i = 0; i < remaining.size(); i++)
+      rest->points[i] = cloud_in->points[remaining[i]];
+    rest->width = rest->points.size();
+    rest->height = 1;
+    rest->is_dense = true;
+
+    pcl::ModelCoefficients::Ptr plane_coefficients (new pcl::ModelCoefficients);
+    inliers->indices.clear();
+    fitPlanarModel(rest, inliers, plane_coefficients, planeMaxIterations, planeDistanceThreshold, ransac);
+    if (inliers->indices.size() < minInliers || plane_coefficients->values.size() < 4)
+      break;
+
+    Eigen::Vector3f normal(plane_coefficients->values[0], plane_coefficients->values[1], plane_coefficients->values[2]);
+    normal.normalize();
+
+    // The plane is gone for the next attempts
+    plane->points.resize(inliers->indices.size());
+    for (int i = 0; i < inliers->indices.size(); i++)
+    {
+      int index = remaining[inliers->indices[i]];
+      in_plane[index] = 1;
+      plane_points.indices.push_back(index);
+      plane->points[i] = cloud_in->points[index];
+      inliers->indices[i] = index; // from here on relative to cloud_in
+    }
+    plane->width = plane->points.size();
+    plane->height = 1;
+    plane->is_dense = true;
+    int kept = 0;
+    for (int i = 0; i < remaining.size(); i++)
+    {
+      if (!in_plane[remaining[i]])
+        remaining[kept++] = remaining[i];
+    }
+    remaining.resize(kept);
+
+    if (!prior && surfaces.empty())
+    {
+      // Let the normal point to the sensor
+      up = plane_coefficients->values[3] < 0 ? -normal : normal;
+    }
+    if (fabs(normal.dot(up)) < min_cos)
+    {
+      logger.logInfo("Skipping a plane, that is not parallel to the support surfaces");
+      continue;
+    }
+    if (normal.dot(up) < 0)
+    {
+      for (int k = 0; k < 4; k++)
+        plane_coefficients->values[k] = -plane_coefficients->values[k];
+    }
+
+    std::vector<pcl::PointIndices> parts;
+    EuclideanClustering::extract(plane, clusterTolerance, minInliers, plane->points.size(), parts);
+    for (int p = 0; p < parts.size() && surfaces.size() < maxSurfaces; p++)
+    {
+      pcl::PointIndices surface;
+      surface.indices.reserve(parts[p].indices.size());
+      for (int i = 0; i < parts[p].indices.size(); i++)
+        surface.indices.push_back(inliers->indices[parts[p].indices[i]]);
+      std::sort(surface.indices.begin(), surface.indices.end());
+
+      pcl::ModelCoefficients::Ptr surface_coefficients (new pcl::ModelCoefficients(*plane_coefficients));
+      pcl::PointIndices::Ptr surface_indices (new pcl::PointIndices(surface));
+      refinePlanarModel(cloud_in, surface_indices, surface_coefficients);
+
+      surfaces.push_back(surface);
+      coefficients.push_back(surface_coefficients);
+    }
+  }
+  std::sort(plane_points.indices.begin(), plane_points.indices.end());
+  return surfaces.size();
+}
+
 /*
  * Extract all Points above a given pointcloud (hull_cloud)
  * A Convex Hull will be calculated around this point cloud.
@@ -213,11 +1020,7 @@ void PointCloudOperations::extractAllPointsAbovePointCloud(const pcl::PointCloud
     int convex_hull_dimension, double prismZMin, double prismZMax)
 {
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr hull_points (new pcl::PointCloud<pcl::PointXYZRGB> ());
-  pcl::ConvexHull<pcl::PointXYZRGB> hull;
-
-  hull.setDimension (convex_hull_dimension); 
-  hull.setInputCloud (hull_cloud);
-  hull.reconstruct (*hull_points);
+  suturo_perception_utils::ThreadsafeHull::computeConvexHull(hull_cloud, hull_points, convex_hull_dimension);
 
   pcl::ExtractPolygonalPrismData<pcl::PointXYZRGB> prism;
   prism.setInputCloud (cloud_in);
@@ -228,7 +1031,6 @@ void PointCloudOperations::extractAllPointsAbovePointCloud(const pcl::PointCloud
   // Create the filtering object
   pcl::ExtractIndices<pcl::PointXYZRGB> extract;
   // Extract the inliers of the prism
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters (new pcl::PointCloud<pcl::PointXYZRGB>());
   extract.setInputCloud (cloud_in);
   extract.setIndices (object_indices);
   extract.setNegative (false);
@@ -250,13 +1052,20 @@ void PointCloudOperations::projectToPlaneCoefficients(pcl::PointCloud<pcl::Point
     return;
   }
 
-  // Project the model inliers
-  pcl::ProjectInliers<pcl::PointXYZRGB> proj_objs;
-  proj_objs.setModelType (pcl::SACMODEL_PLANE);
-  proj_objs.setIndices (object_indices); // project the whole object cloud to the plane
-  proj_objs.setInputCloud (cloud_in);
-  proj_objs.setModelCoefficients (coefficients); // project to the plane model
-  proj_objs.filter (*cloud_out);
+  if(coefficients->values.size() != 4)
+  {
+    logger.logError("No plane coefficients in projectToPlaneCoefficients. Skip ...");
+    return;
+  }
+
+  // Project the model inliers. Like pcl::ProjectInliers, only the indexed points are kept
+  SoACloud objects;
+  objects.fromPCL(*cloud_in, object_indices->indices);
+  Eigen::Vector4f plane(coefficients->values[0], coefficients->values[1],
+      coefficients->values[2], coefficients->values[3]);
+  objects.projectToPlane(plane, objects);
+  objects.toPCL(*cloud_out);
+  cloud_out->header = cloud_in->header;
 
 }
 
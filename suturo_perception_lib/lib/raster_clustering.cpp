@@ -0,0 +1,141 @@
+#include "raster_clustering.h"
+
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+using namespace suturo_perception_lib;
+
+namespace
+{
+  bool biggerCluster(const pcl::PointIndices &a, const pcl::PointIndices &b)
+  {
+    return a.indices.size() > b.indices.size();
+  }
+}
+
+bool RasterClustering::extract(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    const pcl::ModelCoefficients::Ptr plane, double clusterTolerance,
+    int minClusterSize, int maxClusterSize, std::vector<pcl::PointIndices> &clusters)
+{
+  clusters.clear();
+  if (plane == NULL || plane->values.size() < 4)
+    return false;
+
+  // Orthonormal base (u, v) of the plane
+  Eigen::Vector3f normal(plane->values[0], plane->values[1], plane->values[2]);
+  if (normal.norm() == 0)
+    return false;
+  normal.normalize();
+  Eigen::Vector3f u = normal.unitOrthogonal();
+  Eigen::Vector3f v = normal.cross(u);
+
+  // Plane coordinates of every finite point
+  const pcl::PointCloud<pcl::PointXYZRGB> &cloud = *cloud_in;
+  const int size = cloud.points.size();
+  const float inverse_cell_size = 1.0f / clusterTolerance;
+  std::vector<int> cell_x(size), cell_y(size);
+  std::vector<bool> valid(size, false);
+  int min_x = 0, max_x = -1, min_y = 0, max_y = -1;
+  bool first = true;
+  for (int i = 0; i < size; i++)
+  {
+    const pcl::PointXYZRGB &p = cloud.points[i];
+    if (!pcl::isFinite(p))
+      continue;
+    Eigen::Vector3f pt(p.x, p.y, p.z);
+    int cx = static_cast<int>(floor(u.dot(pt) * inverse_cell_size));
+    int cy = static_cast<int>(floor(v.dot(pt) * inverse_cell_size));
+    cell_x[i] = cx;
+    cell_y[i] = cy;
+    valid[i] = true;
+    if (first)
+    {
+      min_x = max_x = cx;
+      min_y = max_y = cy;
+      first = false;
+    }
+    min_x = std::min(min_x, cx);
+    max_x = std::max(max_x, cx);
+    min_y = std::min(min_y, cy);
+    max_y = std::max(max_y, cy);
+  }
+  if (first)
+    return true; // no points, no clusters
+
+  // Add a border of empty cells, so the neighbourhood needs no bounds checks
+  if (((int64_t) max_x - min_x + 3) * ((int64_t) max_y - min_y + 3) > MAX_CELLS)
+    return false;
+  const int width = max_x - min_x + 3;
+  const int height = max_y - min_y + 3;
+
+  // Occupancy: -1 empty, -2 occupied but not labelled yet, >= 0 component label
+  std::vector<int> raster(width * height, -1);
+  std::vector<int> cell_of(size, -1);
+  for (int i = 0; i < size; i++)
+  {
+    if (!valid[i])
+      continue;
+    int cell = (cell_y[i] - min_y + 1) * width + (cell_x[i] - min_x + 1);
+    raster[cell] = -2;
+    cell_of[i] = cell;
+  }
+
+  // Connected components with a flood fill over the 8-neighbourhood
+  const int neighbours[8] = { -width - 1, -width, -width + 1, -1, 1, width - 1, width, width + 1 };
+  int labels = 0;
+  std::vector<int> stack;
+  for (int cell = 0; cell < raster.size(); cell++)
+  {
+    if (raster[cell] != -2)
+      continue;
+    raster[cell] = labels;
+    stack.push_back(cell);
+    while (!stack.empty())
+    {
+      int c = stack.back();
+      stack.pop_back();
+      for (int n = 0; n < 8; n++)
+      {
+        int neighbour = c + neighbours[n];
+        if (raster[neighbour] == -2)
+        {
+          raster[neighbour] = labels;
+          stack.push_back(neighbour);
+        }
+      }
+    }
+    labels++;
+  }
+
+  // Collect the points of every component
+  std::vector<int> component_size(labels, 0);
+  for (int i = 0; i < size; i++)
+  {
+    if (cell_of[i] >= 0)
+      component_size[raster[cell_of[i]]]++;
+  }
+  std::vector<int> cluster_of_label(labels, -1);
+  for (int i = 0; i < size; i++)
+  {
+    if (cell_of[i] < 0)
+      continue;
+    int label = raster[cell_of[i]];
+    if (component_size[label] < minClusterSize || component_size[label] > maxClusterSize)
+      continue;
+    if (cluster_of_label[label] < 0)
+    {
+      cluster_of_label[label] = clusters.size();
+      clusters.push_back(pcl::PointIndices());
+      clusters.back().header = cloud.header;
+      clusters.back().indices.reserve(component_size[label]);
+    }
+    clusters[cluster_of_label[label]].indices.push_back(i);
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), biggerCluster);
+  return true;
+}
+
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
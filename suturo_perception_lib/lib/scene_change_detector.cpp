@@ -0,0 +1,156 @@
+#include "scene_change_detector.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace suturo_perception_lib;
+
+namespace
+{
+  inline bool depthChanged(float depth, float reference, float threshold)
+  {
+    bool valid = pcl_isfinite(depth);
+    if (valid != (bool) pcl_isfinite(reference))
+      return true;
+    return valid && fabs(depth - reference) > threshold;
+  }
+
+  inline bool colorChanged(uint32_t color, uint32_t reference, int threshold)
+  {
+    // Compare r, g and b. The highest byte is alpha or padding
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+      int a = (color >> shift) & 0xff;
+      int b = (reference >> shift) & 0xff;
+      if (abs(a - b) > threshold)
+        return true;
+    }
+    return false;
+  }
+
+#ifdef __SSE2__
+  // Number of set bits of a movemask
+  const int MASK_BITS[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+#endif
+}
+
+SceneChangeDetector::SceneChangeDetector() : step_(4), depth_threshold_(0.01), color_threshold_(24),
+  width_(0), height_(0), reference_width_(0), reference_height_(0)
+{
+}
+
+float SceneChangeDetector::changedFraction(const pcl::PointCloud<pcl::PointXYZRGB> &cloud)
+{
+  width_ = cloud.width;
+  height_ = cloud.height;
+  depth_.clear();
+  color_.clear();
+  if (height_ <= 1)
+    return 1;
+
+  for (uint32_t row = 0; row < height_; row += step_)
+  {
+    const pcl::PointXYZRGB *p = &cloud.points[row * width_];
+    for (uint32_t column = 0; column < width_; column += step_)
+    {
+      depth_.push_back(p[column].z);
+      color_.push_back(p[column].rgba);
+    }
+  }
+  return compare();
+}
+
+float SceneChangeDetector::changedFraction(const PointCloud2View &view)
+{
+  width_ = view.width();
+  height_ = view.height();
+  depth_.clear();
+  color_.clear();
+  if (height_ <= 1)
+    return 1;
+
+  pcl::PointXYZRGB p;
+  for (uint32_t row = 0; row < height_; row += step_)
+  {
+    for (uint32_t column = 0; column < width_; column += step_)
+    {
+      view.getPoint(row, column, p);
+      depth_.push_back(p.z);
+      color_.push_back(p.rgba);
+    }
+  }
+  return compare();
+}
+
+void SceneChangeDetector::acceptFrame()
+{
+  // Swap instead of copying, the buffers keep their capacity
+  depth_.swap(reference_depth_);
+  color_.swap(reference_color_);
+  reference_width_ = width_;
+  reference_height_ = height_;
+  depth_.clear();
+  color_.clear();
+  width_ = 0;
+  height_ = 0;
+}
+
+void SceneChangeDetector::reset()
+{
+  reference_depth_.clear();
+  reference_color_.clear();
+  reference_width_ = 0;
+  reference_height_ = 0;
+}
+
+/*
+ * Count the changed samples of the current frame.
+ */
+float SceneChangeDetector::compare() const
+{
+  const int n = depth_.size();
+  if (n == 0 || width_ != reference_width_ || height_ != reference_height_ || reference_depth_.size() != n)
+    return 1;
+
+  int changed = 0;
+  int i = 0;
+#ifdef __SSE2__
+  // Four samples at once. The color channels are compared bytewise
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 depth_threshold = _mm_set1_ps(depth_threshold_);
+  const __m128i color_mask = _mm_set1_epi32(0x00ffffff);
+  const __m128i color_threshold = _mm_set1_epi8((char) std::min(255, std::max(0, color_threshold_)));
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128 d = _mm_loadu_ps(&depth_[i]);
+    __m128 r = _mm_loadu_ps(&reference_depth_[i]);
+    // |d - r| > threshold is false, if one of them is NaN ...
+    __m128 moved = _mm_cmpgt_ps(_mm_and_ps(_mm_sub_ps(d, r), abs_mask), depth_threshold);
+    // ... so a sample, that became valid or invalid, is checked on its own
+    moved = _mm_or_ps(moved, _mm_xor_ps(_mm_cmpunord_ps(d, d), _mm_cmpunord_ps(r, r)));
+
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&color_[i]));
+    __m128i rc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&reference_color_[i]));
+    __m128i color_diff = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(c, rc), _mm_subs_epu8(rc, c)), color_mask);
+    // Only channels, that differ by more than the threshold, stay non zero
+    __m128i same_color = _mm_cmpeq_epi32(_mm_subs_epu8(color_diff, color_threshold), zero);
+    moved = _mm_or_ps(moved, _mm_castsi128_ps(_mm_xor_si128(same_color, _mm_set1_epi32(-1))));
+
+    changed += MASK_BITS[_mm_movemask_ps(moved)];
+  }
+#endif
+  for (; i < n; i++)
+  {
+    if (depthChanged(depth_[i], reference_depth_[i], depth_threshold_) ||
+        colorChanged(color_[i], reference_color_[i], color_threshold_))
+      changed++;
+  }
+  return (float) changed / n;
+}
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
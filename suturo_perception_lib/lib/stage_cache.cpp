@@ -0,0 +1,43 @@
+#include "stage_cache.h"
+
+using namespace suturo_perception_lib;
+
+StageCache::StageCache() : enabled_(false), next_version_(1)
+{
+}
+
+bool StageCache::reuse(const std::string &stage, const Key &key)
+{
+  const std::string k = key.str();
+  std::map<std::string, Entry>::iterator it = entries_.find(stage);
+  if (enabled_ && it != entries_.end() && it->second.key == k)
+  {
+    reused_.push_back(stage);
+    return true;
+  }
+
+  Entry &entry = entries_[stage];
+  entry.key = k;
+  entry.version = next_version_++;
+  return false;
+}
+
+unsigned long StageCache::version(const std::string &stage) const
+{
+  std::map<std::string, Entry>::const_iterator it = entries_.find(stage);
+  return it == entries_.end() ? 0 : it->second.version;
+}
+
+void StageCache::invalidate(const std::string &stage)
+{
+  std::map<std::string, Entry>::iterator it = entries_.find(stage);
+  if (it != entries_.end())
+    it->second.key.clear();
+}
+
+void StageCache::clear()
+{
+  entries_.clear();
+  reused_.clear();
+}
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
@@ -31,69 +31,158 @@ SuturoPerception::SuturoPerception()
   ecObjClusterTolerance = 0.03; // 3cm
   ecObjMinClusterSize = 100;
   ecObjMaxClusterSize = 25000;
+  organizedSegmentation = false;
+  organizedPlaneMinInliers = 5000;
+  organizedPlaneAngularThreshold = 0.0523; // 3 deg
+  planeTracking = false;
+  planeTrackingMinInlierRatio = 0.8;
+  tracked_inlier_ratio_ = 0;
+  frame_allocations_ = 0;
+  frame_width_ = 0;
+  frame_height_ = 0;
+  rasterObjectClustering = false;
+  coarsePlaneFitting = false;
+  coarsePlaneLeafSize = 0.03; // 3cm
+  autoROI = false;
+  autoROIMargin = 0.1; // 10cm
+  autoROIPixelMargin = 20;
+  sceneChangeGating = false;
+  sceneChangeMaxFraction = 0.02;
+  sceneChangeDepthThreshold = 0.01; // 1cm
+  sceneChangeColorThreshold = 24;
+  multiSurfaceSegmentation = false;
+  surfaceMaxCount = 4;
+  surfaceMinInliers = 1000;
+  surfaceMaxAngle = 0.1745; // 10 deg
+  stageCaching = false;
+  planeRansacConfidence = 0.99;
+  planeRansacGuided = false;
+  planeRansacThreads = 0;
+  planeNormalTolerance = 0.1745;
+  planeNormalPrior = Eigen::Vector3f::Zero();
   debug = true;
   writer_pcd = false;
   calculateHullVolume_ = true;
+  computeClusterMasks_ = false;
+  last_result_.reset(new SegmentationResult);
 }
 
 
 pcl::PointCloud<pcl::PointXYZRGB>::Ptr SuturoPerception::getObjectsOnPlaneCloud()
 {
-  return objects_on_plane_cloud_;
+  return getLastResult()->objects_on_plane_cloud;
 }
 pcl::PointCloud<pcl::PointXYZRGB>::Ptr SuturoPerception::getPlaneCloud()
 {
-  return plane_cloud_;
+  return getLastResult()->plane_cloud;
 }
 
 /**
- * Use EuclideanClusterExtraction on object_clusters to identify seperate objects in the given pointcloud.
+ * Use RasterClustering (or EuclideanClustering) on object_clusters to identify seperate objects in the given pointcloud.
  * Create a ConvexHull for every object_cluster and extract everything that's above it (in a given range,
- * see SuturoPerception::prismZMax and SuturoPerception::prismZMin.
+ * see SuturoPerception::prismZMax and SuturoPerception::prismZMin. All objects are extracted
+ * in a single pass over original_cloud with FootprintLabeling.
  * In the future, this method will also extract 2d images from every object cluster.
  */
-void SuturoPerception::clusterFromProjection(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters, pcl::PointCloud<pcl::PointXYZRGB>::Ptr original_cloud, std::vector<int> *removed_indices_filtered, std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &extracted_objects, std::vector<cv::Mat> &extracted_images, std::vector<ROI> &perceived_cluster_rois_)
+void SuturoPerception::clusterFromProjection(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters, pcl::PointCloud<pcl::PointXYZRGB>::Ptr original_cloud, std::vector<int> *removed_indices_filtered, std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &extracted_objects, std::vector<cv::Mat> &extracted_images, std::vector<cv::Mat> &extracted_masks, std::vector<ROI> &perceived_cluster_rois_)
 {
+  clusterFromProjection(object_clusters, original_cloud, removed_indices_filtered, extracted_objects, extracted_images,
+      extracted_masks, perceived_cluster_rois_, table_coefficients_, prismZMax, workspace_);
+}
+
+/*
+ * Same as above, but for the objects on the given plane. Objects end
+ * prism_z_max above the plane and the buffers come from workspace.
+ */
+void SuturoPerception::clusterFromProjection(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr original_cloud, std::vector<int> *removed_indices_filtered,
+    std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &extracted_objects, std::vector<cv::Mat> &extracted_images,
+    std::vector<cv::Mat> &extracted_masks, std::vector<ROI> &perceived_cluster_rois_,
+    pcl::ModelCoefficients::Ptr plane, double prism_z_max, FrameWorkspace &workspace)
+{
+  if(!canClusterProjection(object_clusters, original_cloud))
+    return;
+
+  std::vector<pcl::PointIndices> cluster_indices;
+  clusterProjection(object_clusters, plane, cluster_indices);
+  extractClusterObjects(object_clusters, original_cloud, removed_indices_filtered, cluster_indices, extracted_objects,
+      extracted_images, extracted_masks, perceived_cluster_rois_, plane, prism_z_max, workspace);
+}
 
+bool SuturoPerception::canClusterProjection(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr original_cloud)
+{
   if(object_clusters->points.size() == 0)
   {
     logger.logError("clusterFromProjection: object_clusters is empty. Skipping ...");
-    return;
+    return false;
   }
 
   if(original_cloud->points.size() < 50)
   {
     logger.logError("clusterFromProjection: original_cloud has less than 50 points. Skipping ...");
-    return;
+    return false;
   }
+  return true;
+}
 
-  mutex.lock();
-  // extracted_images = tmpPerceivedObjects; // TODO use temporary list for images
-  extracted_images.clear();
-  mutex.unlock();
-
-  pcl::PCDWriter writer;
+/*
+ * Identify the clusters in the projected object points.
+ */
+void SuturoPerception::clusterProjection(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters,
+    pcl::ModelCoefficients::Ptr plane, std::vector<pcl::PointIndices> &cluster_indices)
+{
   boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
 
   // Identify clusters in the input cloud
-  pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZRGB>);
-  tree->setInputCloud (object_clusters);
-
-  std::vector<pcl::PointIndices> cluster_indices;
-  pcl::EuclideanClusterExtraction<pcl::PointXYZRGB> ec;
-  ec.setClusterTolerance (ecObjClusterTolerance);
-  ec.setMinClusterSize (ecObjMinClusterSize);
-  ec.setMaxClusterSize (ecObjMaxClusterSize);
-  ec.setSearchMethod (tree);
-  ec.setInputCloud (object_clusters);
-  ec.extract(cluster_indices);
+  if (!rasterObjectClustering ||
+      !RasterClustering::extract(object_clusters, plane, ecObjClusterTolerance,
+        ecObjMinClusterSize, ecObjMaxClusterSize, cluster_indices))
+  {
+    if (rasterObjectClustering)
+      logger.logWarn("Object points too widespread for raster clustering, using 3d clustering");
+    EuclideanClustering::extract(object_clusters, ecObjClusterTolerance, ecObjMinClusterSize, ecObjMaxClusterSize,
+        cluster_indices);
+  }
   logger.logInfo((boost::format("Found %s clusters.") % cluster_indices.size()).str());
 
   boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(s, e, "filtering out objects above the plane");
+  logStage(s, e, "perception_lib/cluster_projection", "filtering out objects above the plane");
+
+  if(writer_pcd)
+  {
+    pcl::PCDWriter writer;
+    writer.write ("cluster_from_projection_clusters.pcd", *object_clusters, false);
+  }
+}
+
+/*
+ * Extract the points above the given clusters of object_clusters from original_cloud,
+ * together with their image, mask and ROI.
+ */
+void SuturoPerception::extractClusterObjects(pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr original_cloud, std::vector<int> *removed_indices_filtered,
+    const std::vector<pcl::PointIndices> &cluster_indices,
+    std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &extracted_objects, std::vector<cv::Mat> &extracted_images,
+    std::vector<cv::Mat> &extracted_masks, std::vector<ROI> &perceived_cluster_rois_,
+    pcl::ModelCoefficients::Ptr plane, double prism_z_max, FrameWorkspace &workspace)
+{
+  extracted_images.clear();
+  extracted_masks.clear();
+
+  // Extract every point above the 2d clusters with a single pass over the original cloud.
+  // The points above a cluster will belong to a single object on the table
+  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  std::vector<pcl::PointIndices> clusters_object_indices;
+  bool labeled = FootprintLabeling::extract(original_cloud, object_clusters, cluster_indices, plane,
+      ecObjClusterTolerance, prismZMin, prism_z_max, clusters_object_indices);
+  if (!labeled)
+    logger.logWarn("Object footprints too widespread for a label map, extracting every object on its own");
+  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
+  logStage(s, e, "perception_lib/footprint_labeling", "labeling object points");
 
-  int i=0;
   // Iterate over the found clusters and extract single pointclouds
+  std::vector<pcl::PointIndices::Ptr> objects_indices;
   for (std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin (); it != cluster_indices.end (); ++it)
   {
     if (it->indices.size() < 10)
@@ -101,57 +190,63 @@ void SuturoPerception::clusterFromProjection(pcl::PointCloud<pcl::PointXYZRGB>::
       logger.logError("Cloud cluster has less than 10 points, skipping...");
       continue;
     }
-    // Gather all points for a cluster into a single pointcloud
     boost::posix_time::ptime s1 = boost::posix_time::microsec_clock::local_time();
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_cluster (new pcl::PointCloud<pcl::PointXYZRGB>);
-    for (std::vector<int>::const_iterator pit = it->indices.begin (); pit != it->indices.end (); pit++)
-      cloud_cluster->points.push_back (object_clusters->points[*pit]); //*
-
-    cloud_cluster->width = cloud_cluster->points.size ();
-    cloud_cluster->height = 1;
-    cloud_cluster->is_dense = true;
-    logger.logInfo((boost::format("Cloud Cluster Size is %s") % cloud_cluster->points.size ()).str());
-    //std::ostringstream fn;
-    //fn << "2dcluster_" << i << ".pcd";
-    //if(writer_pcd) writer.write(fn.str(), *cloud_cluster, false);
+    logger.logInfo((boost::format("Cloud Cluster Size is %s") % it->indices.size ()).str());
 
-  
-    // Extract every point above the 2d cluster.
-    // These points will belong to a single object on the table
-    pcl::PointIndices::Ptr object_indices (new pcl::PointIndices); // The extracted indices of a single object above the plane
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_points (new pcl::PointCloud<pcl::PointXYZRGB>());
-    PointCloudOperations::extractAllPointsAbovePointCloud(original_cloud, cloud_cluster, object_points, object_indices, 2,
-        prismZMin, prismZMax);
+    pcl::PointIndices::Ptr object_indices = workspace.acquireIndices(); // The extracted indices of a single object above the plane
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_points = workspace.acquireCloud();
+    if (labeled)
+    {
+      object_indices->indices.swap(clusters_object_indices[it - cluster_indices.begin()].indices);
+      object_points->points.reserve(object_indices->indices.size());
+      for (std::vector<int>::const_iterator pit = object_indices->indices.begin (); pit != object_indices->indices.end (); pit++)
+        object_points->points.push_back(original_cloud->points[*pit]);
+      object_points->width = object_points->points.size();
+      object_points->height = 1;
+      object_points->is_dense = true;
+    }
+    else
+    {
+      // Gather all points for a cluster into a single pointcloud
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_cluster = workspace.acquireCloud(it->indices.size());
+      for (std::vector<int>::const_iterator pit = it->indices.begin (); pit != it->indices.end (); pit++)
+        cloud_cluster->points.push_back (object_clusters->points[*pit]); //*
+
+      cloud_cluster->width = cloud_cluster->points.size ();
+      cloud_cluster->height = 1;
+      cloud_cluster->is_dense = true;
+
+      // Extract every point above the 2d cluster.
+      PointCloudOperations::extractAllPointsAbovePointCloud(original_cloud, cloud_cluster, object_points, object_indices, 2,
+          prismZMin, prism_z_max);
+    }
     extracted_objects.push_back(object_points);
-
-    // logger.logError("After extract");
+    objects_indices.push_back(object_indices);
 
     boost::posix_time::ptime e1 = boost::posix_time::microsec_clock::local_time();
-    logger.logTime(s1, e1, "Extracted Object Points");
-
-    //std::ostringstream cl_file;
-    //cl_file << "2d_Z_cluster_" << i << ".pcd";
-    //if(writer_pcd) writer.write(cl_file.str(), *object_points, false);
-    // cout << "2d_Z_cluster_" << i << " has " << object_points->size() << " points" << endl;
-
-    boost::posix_time::ptime s2 = boost::posix_time::microsec_clock::local_time();
+    logStage(s1, e1, "perception_lib/object_points", "Extracted Object Points");
+  }
 
-    // RGB Values for points
-    int r,g,b;
-    cv::Mat img(cv::Size(original_cloud->width,original_cloud->height),CV_8UC3, cv::Scalar(0,0,0)); // Create an image with the size of the original cloud
+  boost::posix_time::ptime s2 = boost::posix_time::microsec_clock::local_time();
 
+  // Label every pixel with the object it belongs to. If two objects claim the same
+  // pixel, it belongs to the first one. Label 0 is the background
+  cv::Mat labels;
+  if (!objects_indices.empty())
+    labels = cv::Mat::zeros(frame_height_, frame_width_, CV_16UC1);
+  std::vector<ROI> rois(objects_indices.size());
+  for (int k = 0; k < objects_indices.size(); k++)
+  {
     // Compute the ROI (region of interest, with the segmented image)
-    int min_column = original_cloud->width;
+    int min_column = frame_width_;
     int max_column = 0;
-    int min_row = original_cloud->height;
+    int min_row = frame_height_;
     int max_row = 0;
-
-    // fill in color of extracted object points
-    for (std::vector<int>::const_iterator pit = object_indices->indices.begin(); pit != object_indices->indices.end(); pit++)
+    for (std::vector<int>::const_iterator pit = objects_indices[k]->indices.begin(); pit != objects_indices[k]->indices.end(); pit++)
     {
       int index = removed_indices_filtered->at(*pit);
-      int row = index / original_cloud->width;
-      int column = index % original_cloud->width;
+      int row = index / frame_width_;
+      int column = index % frame_width_;
 
       // Calculate the dimensions of the image
       if(column > max_column) max_column = column;
@@ -159,47 +254,118 @@ void SuturoPerception::clusterFromProjection(pcl::PointCloud<pcl::PointXYZRGB>::
       if(row < min_row) min_row = row;
       if(column < min_column) min_column = column;
 
-      img.at<cv::Vec3b>( row, column)[0] = original_cloud->points[index].b;
-      img.at<cv::Vec3b>( row, column)[1] = original_cloud->points[index].g;
-      img.at<cv::Vec3b>( row, column)[2] = original_cloud->points[index].r;
+      unsigned short &label = labels.at<unsigned short>(row, column);
+      if (label == 0)
+        label = k + 1;
     }
+    rois[k].origin.x = min_column;
+    rois[k].origin.y = min_row;
+    rois[k].width = max_column - min_column;
+    rois[k].height = max_row - min_row;
+  }
 
-    int roi_topleft_x = min_column;
-    int roi_topleft_y = min_row;
-    int roi_width = max_column - min_column;
-    int roi_height = max_row - min_row;
-
-    ROI roi;
-    roi.origin.x = roi_topleft_x;
-    roi.origin.y = roi_topleft_y;
-    roi.width = roi_width;
-    roi.height = roi_height;
-
-    cv::Mat image_roi;
-    try 
-    {
-      cv::Rect region_of_interest = cv::Rect(roi.origin.x, roi.origin.y, roi.width, roi.height);
-      image_roi = img(region_of_interest);
-    }
-    catch (...)
+  // Fill in the color of the extracted object points. Only the ROI of an object gets allocated
+  for (int k = 0; k < objects_indices.size(); k++)
+  {
+    ROI &roi = rois[k];
+    if (roi.width < 0 || roi.height < 0)
     {
       logger.logError((boost::format("Creating ROI image failed (ROI: x = %d, y = %d, w = %d, h = %d)") % roi.origin.x % roi.origin.y % roi.width % roi.height).str());
-      
       roi.origin.x = 0;
       roi.origin.y = 0;
       roi.width = 0;
       roi.height = 0;
-      cv::Rect region_of_interest = cv::Rect(roi.origin.x, roi.origin.y, roi.width, roi.height);
-      image_roi = img(region_of_interest);
     }
 
+    cv::Mat image_roi;
+    if (roi.width > 0 && roi.height > 0)
+    {
+      image_roi = cv::Mat(roi.height, roi.width, CV_8UC3, cv::Scalar(0,0,0));
+      for (std::vector<int>::const_iterator pit = objects_indices[k]->indices.begin(); pit != objects_indices[k]->indices.end(); pit++)
+      {
+        int index = removed_indices_filtered->at(*pit);
+        int row = index / frame_width_ - roi.origin.y;
+        int column = index % frame_width_ - roi.origin.x;
+        // The ROI excludes the last row and column of the object
+        if (row >= roi.height || column >= roi.width || labels.at<unsigned short>(row + roi.origin.y, column + roi.origin.x) != k + 1)
+          continue;
+
+        cv::Vec3b &pixel = image_roi.at<cv::Vec3b>(row, column);
+        pixel[0] = original_cloud->points[*pit].b;
+        pixel[1] = original_cloud->points[*pit].g;
+        pixel[2] = original_cloud->points[*pit].r;
+      }
+    }
     extracted_images.push_back(image_roi);
+
+    if (computeClusterMasks_)
+    {
+      cv::Mat mask;
+      if (roi.width > 0 && roi.height > 0)
+        mask = labels(cv::Rect(roi.origin.x, roi.origin.y, roi.width, roi.height)) == k + 1;
+      extracted_masks.push_back(mask);
+    }
     perceived_cluster_rois_.push_back(roi);
-    i++;
   }
 
-  if(writer_pcd) writer.write ("cluster_from_projection_clusters.pcd", *object_clusters, false);
+  boost::posix_time::ptime e2 = boost::posix_time::microsec_clock::local_time();
+  logStage(s2, e2, "perception_lib/object_images", "Extracted Object Images");
+}
+
+/*
+ * Fit the table plane to cloud_in.
+ * If plane tracking is enabled, the plane of the last frame will be scored against
+ * cloud_in first. When its inlier ratio is still above planeTrackingMinInlierRatio
+ * times the ratio of the last full search, the plane is only refined with a
+ * least-squares fit on its inliers. Otherwise a full RANSAC search is done.
+ * With coarsePlaneFitting, the search runs on a coarse voxel grid and the plane
+ * is refined on cloud_full, the cloud before downsampling.
+ */
+void SuturoPerception::fitTablePlane(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_full, pcl::PointIndices::Ptr inliers,
+    pcl::ModelCoefficients::Ptr coefficients)
+{
+  if(planeTracking && tracked_plane_ && cloud_in->points.size() > 0)
+  {
+    boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+
+    pcl::ModelCoefficients::Ptr tracked (new pcl::ModelCoefficients(*tracked_plane_));
+    int inlier_count = PointCloudOperations::scorePlanarModel(cloud_in, tracked, planeDistanceThreshold, inliers);
+    double inlier_ratio = (double) inlier_count / (double) cloud_in->points.size();
+
+    if(inlier_count >= 3 && inlier_ratio >= planeTrackingMinInlierRatio * tracked_inlier_ratio_)
+    {
+      PointCloudOperations::refinePlanarModel(cloud_in, inliers, tracked);
+      PointCloudOperations::scorePlanarModel(cloud_in, tracked, planeDistanceThreshold, inliers);
+      *coefficients = *tracked;
+      tracked_plane_ = tracked;
+
+      boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
+      logStage(s, e, "perception_lib/plane_tracking", "fitTablePlane() tracked");
+      return;
+    }
+    logger.logInfo((boost::format("Lost the tracked table plane (inlier ratio %s vs. %s). Searching again ...")
+          % inlier_ratio % tracked_inlier_ratio_).str());
+    inliers->indices.clear();
+  }
 
+  if(coarsePlaneFitting && cloud_full && cloud_full->points.size() > 0)
+  {
+    pcl::PointIndices::Ptr full_inliers = workspace_.acquireIndices();
+    PointCloudOperations::fitPlanarModelCoarseToFine(cloud_in, cloud_full, inliers, full_inliers, coefficients,
+        planeMaxIterations, planeDistanceThreshold, coarsePlaneLeafSize, ransacOptions());
+    logger.logInfo((boost::format("Table inlier count at full resolution: %s") % full_inliers->indices.size()).str());
+  }
+  else
+  {
+    PointCloudOperations::fitPlanarModel(cloud_in, inliers, coefficients, planeMaxIterations, planeDistanceThreshold,
+        ransacOptions());
+  }
+  if(inliers->indices.size() > 0)
+  {
+    tracked_plane_.reset(new pcl::ModelCoefficients(*coefficients));
+    tracked_inlier_ratio_ = (double) inliers->indices.size() / (double) cloud_in->points.size();
+  }
 }
 
 /*
@@ -208,108 +374,602 @@ void SuturoPerception::clusterFromProjection(pcl::PointCloud<pcl::PointXYZRGB>::
  *   - Centroid calculation
  *   - Volume calculation
  *
- * The result is a list of PerceivedObject's, which will be put into the buffer perceivedObjects.
+ * The result is a list of PerceivedObject's, which will be published as part of a
+ * SegmentationResult. If something goes wrong, the result will have no objects.
  */
 void SuturoPerception::processCloudWithProjections(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in)
 {
 
 	boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
 
-  // reset data first, in case something goes wrong 
-  mutex.lock();
-  perceivedObjects.clear();
-  mutex.unlock();
-
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>), 
-                                      cloud_filtered (new pcl::PointCloud<pcl::PointXYZRGB>), 
-                                      cloud_projected (new pcl::PointCloud<pcl::PointXYZRGB>),
-                                      objects_cloud_projected (new pcl::PointCloud<pcl::PointXYZRGB>),
-                                      cloud_plane (new pcl::PointCloud<pcl::PointXYZRGB>);
-  pcl::PCDReader reader;
-  pcl::PCDWriter writer;
+  if(sceneChangeGating && cloud_in->isOrganized() && reuseUnchangedFrame(*cloud_in, start))
+    return;
+
+  // Nothing of the last frame can be reused for a new one
+  resetStageCache();
+  stages_.input = cloud_in;
+  processStages(cloud_in, getProcessingRegion(), start);
+}
 
+/*
+ * Run the stages of the segmentation on cloud_in, restricted to region.
+ * Every stage is looked up in the stage cache first. It only runs, if the
+ * stages it reads from or its parameters changed since its last run on this frame.
+ * For a new frame, the cache is empty, so everything runs.
+ */
+void SuturoPerception::processStages(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in, const ProcessingRegion &region,
+    boost::posix_time::ptime start)
+{
+  beginFrame();
+  frame_width_ = cloud_in->width;
+  frame_height_ = cloud_in->height;
+  SegmentationResult::Ptr result(new SegmentationResult);
+  result->stamp = start;
+  result->computed_stamp = start;
+  result->frame_width = frame_width_;
+  result->frame_height = frame_height_;
+
+  // The pixel grid segmentation needs the organized cloud
+  const bool organized = organizedSegmentation && cloud_in->isOrganized();
+  StageCache::Key filter_key;
+  filter_key << organized << zAxisFilterMin << zAxisFilterMax << region.use_pixels << region.pixels.origin.x
+    << region.pixels.origin.y << region.pixels.width << region.pixels.height << region.use_box
+    << region.box_min.transpose() << region.box_max.transpose();
+  const bool filter = !stage_cache_.reuse("filter", filter_key);
+  StageCache::Key downsample_key;
+  downsample_key << stage_cache_.version("filter") << downsampleLeafSize;
+  const bool downsample = !stage_cache_.reuse("downsample", downsample_key);
+
+  if(filter)
+  {
+    stages_.region = region;
+    stages_.cloud_filtered = workspace_.acquireCloud(cloud_in->points.size());
+    stages_.object_cloud = stages_.cloud_filtered;
+    stages_.pixel_indices = workspace_.acquireIndices(cloud_in->points.size());
+  }
+  if(downsample)
+    stages_.cloud_downsampled = workspace_.acquireCloud();
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered = stages_.cloud_filtered,
+                                      cloud_downsampled = stages_.cloud_downsampled;
+  std::vector<int> &removed_indices_filtered = stages_.pixel_indices->indices;
 
   boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
 
-  // TODO Remove NaNs
+  // Everything from here on only sees the points inside of the region
+  if(organized && filter)
+  {
+    if(region.isEmpty())
+    {
+      pcl::PassThrough<pcl::PointXYZRGB> pass(true);
+      PointCloudOperations::filterZAxis(cloud_in, cloud_filtered, pass, zAxisFilterMin, zAxisFilterMax);
+      removed_indices_filtered = *pass.getIndices();
+      stages_.object_cloud = cloud_in;
+    }
+    else
+    {
+      // The cropped cloud is smaller than the frame, so the objects come out of it as well
+      PointCloudOperations::cropOrganized(cloud_in, region, zAxisFilterMin, zAxisFilterMax,
+          cloud_filtered, removed_indices_filtered);
+    }
+  }
+  else if(filter)
+  {
+    // z-filter, NaN removal and voxelizing in one pass
+    PointCloudOperations::filterAndDownsample(cloud_in, cloud_filtered, removed_indices_filtered, cloud_downsampled,
+        zAxisFilterMin, zAxisFilterMax, downsampleLeafSize, region);
+    logger.logInfo((boost::format("PointCloud: %s data points") % cloud_filtered->points.size()).str());
+  }
+  if(downsample && (organized || !filter))
+    PointCloudOperations::downsample(cloud_filtered, cloud_downsampled, downsampleLeafSize);
+  if(filter || downsample)
+  {
+    boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
+    logStage(s, e, "perception_lib/filter_downsample", "z-filter and downsampling");
+  }
+
+  segmentFilteredCloud(stages_.object_cloud, organized ? cloud_filtered : pcl::PointCloud<pcl::PointXYZRGB>::Ptr(),
+      cloud_downsampled, removed_indices_filtered, start, *result);
+  updateAutoRegion(*result, *cloud_filtered, removed_indices_filtered);
+  finishFrame(result);
+}
+
+/*
+ * Segment the last frame again. The region of the last frame is kept, if it has been
+ * chosen by autoROI. Otherwise a changed pixel ROI or crop box applies as well.
+ */
+bool SuturoPerception::reprocessLastFrame()
+{
+  if(!stageCaching || !stages_.input)
+  {
+    logger.logInfo("No frame to reprocess. Stage caching is disabled or no frame has been processed yet");
+    return false;
+  }
 
-  // Build a filter to filter on the Z Axis
-  pcl::PassThrough<pcl::PointXYZRGB> pass(true);
-  PointCloudOperations::filterZAxis(cloud_in, cloud_filtered, pass, zAxisFilterMin, zAxisFilterMax);
-  logger.logInfo((boost::format("PointCloud: %s data points") % cloud_filtered->points.size()).str());
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+  processStages(stages_.input, autoROI ? stages_.region : getProcessingRegion(), start);
+  logger.logInfo((boost::format("Reprocessed the last frame, %s stages reused")
+        % getLastResult()->reused_stages.size()).str());
+  return true;
+}
+
+/*
+ * Process a single point cloud, that is read directly from the buffer
+ * of a PointCloud2 message.
+ * The first cloud that will be copied from the message is the z-filtered one.
+ * It will also be used as the original cloud, so points beyond the z-filter
+ * don't show up in the extracted objects.
+ * With stageCaching, the whole frame is copied, so it can be processed again later.
+ */
+void SuturoPerception::processCloudWithProjections(const PointCloud2View &view)
+{
+
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+
+  if(sceneChangeGating && view.isValid() && view.isOrganized() && reuseUnchangedFrame(view, start))
+    return;
+
+  // Nothing of the last frame can be reused for a new one
+  resetStageCache();
+  if(stageCaching && view.isValid())
+  {
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr frame(new pcl::PointCloud<pcl::PointXYZRGB>);
+    frame->points.resize(view.size());
+    for (size_t i = 0; i < view.size(); i++)
+      view.getPoint(i, frame->points[i]);
+    frame->width = view.width();
+    frame->height = view.height();
+    frame->is_dense = false;
+    original_cloud_ = frame;
+    stages_.input = frame;
+    processStages(frame, getProcessingRegion(), start);
+    return;
+  }
+
+  beginFrame();
+  SegmentationResult::Ptr result(new SegmentationResult);
+  result->stamp = start;
+  result->computed_stamp = start;
+  if(!view.isValid())
+  {
+    logger.logError("PointCloud2 has no float xyz fields or is big endian. Exiting....");
+    finishFrame(result);
+    return;
+  }
+
+  frame_width_ = view.width();
+  frame_height_ = view.height();
+  result->frame_width = frame_width_;
+  result->frame_height = frame_height_;
+
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered = workspace_.acquireCloud(view.size()),
+                                      cloud_downsampled = workspace_.acquireCloud();
+  pcl::PointIndices::Ptr pixel_indices = workspace_.acquireIndices(view.size());
+  std::vector<int> &removed_indices_filtered = pixel_indices->indices;
+
+  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+
+  // Everything from here on only sees the points inside of the region
+  const ProcessingRegion region = getProcessingRegion();
+
+  if(organizedSegmentation && view.isOrganized())
+  {
+    // The pixel grid segmentation needs the organized cloud
+    if(region.isEmpty())
+    {
+      PointCloudOperations::filterZAxis(view, cloud_filtered, zAxisFilterMin, zAxisFilterMax, true);
+      // The filtered cloud keeps the layout of the message
+      removed_indices_filtered.resize(cloud_filtered->points.size());
+      for (int i = 0; i < removed_indices_filtered.size(); i++)
+        removed_indices_filtered[i] = i;
+    }
+    else
+    {
+      PointCloudOperations::cropOrganized(view, region, zAxisFilterMin, zAxisFilterMax,
+          cloud_filtered, removed_indices_filtered);
+    }
+    PointCloudOperations::downsample(cloud_filtered, cloud_downsampled, downsampleLeafSize);
+    boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
+    logStage(s, e, "perception_lib/filter_downsample", "z-filter and downsampling");
+
+    original_cloud_ = cloud_filtered;
+    segmentFilteredCloud(cloud_filtered, cloud_filtered, cloud_downsampled, removed_indices_filtered, start, *result);
+    updateAutoRegion(*result, *cloud_filtered, removed_indices_filtered);
+    finishFrame(result);
+    return;
+  }
 
-  std::vector<int> removed_indices_filtered;
-  removed_indices_filtered = *pass.getIndices();
+  PointCloudOperations::filterAndDownsample(view, cloud_filtered, removed_indices_filtered, cloud_downsampled,
+      zAxisFilterMin, zAxisFilterMax, downsampleLeafSize, region);
+  logger.logInfo((boost::format("PointCloud: %s data points") % cloud_filtered->points.size()).str());
   boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(s, e, "z-filter");
+  logStage(s, e, "perception_lib/filter_downsample", "z-filter and downsampling");
 
+  original_cloud_ = cloud_filtered;
+  segmentFilteredCloud(cloud_filtered, pcl::PointCloud<pcl::PointXYZRGB>::Ptr(), cloud_downsampled,
+      removed_indices_filtered, start, *result);
+  updateAutoRegion(*result, *cloud_filtered, removed_indices_filtered);
+  finishFrame(result);
+}
 
-  //voxelizing cloud
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_downsampled (new pcl::PointCloud<pcl::PointXYZRGB>());
-  PointCloudOperations::downsample(cloud_filtered, cloud_downsampled, downsampleLeafSize);
-  cloud_filtered = cloud_downsampled; // Use the downsampled cloud now
+/*
+ * Segment the table and the objects on it.
+ * The objects will be extracted from the points of cloud_in. Point i of
+ * cloud_in belongs to the pixel removed_indices_filtered[i] of the frame.
+ * cloud_organized is the organized z-filtered cloud, if it's available.
+ * All plane fitting happens on cloud_filtered, the downsampled cloud.
+ * Everything that is found goes into result.
+ */
+void SuturoPerception::segmentFilteredCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_organized, pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered,
+    std::vector<int> &removed_indices_filtered, boost::posix_time::ptime start, SegmentationResult &result)
+{
+  if(multiSurfaceSegmentation)
+  {
+    if(organizedSegmentation)
+      logger.logWarn("Organized segmentation is not supported for multiple support surfaces. Using RANSAC");
+    segmentSurfaces(cloud_in, cloud_filtered, removed_indices_filtered, start, result);
+    return;
+  }
 
-  // Find the biggest table plane in the scene
-  pcl::ModelCoefficients::Ptr coefficients (new pcl::ModelCoefficients);
-  pcl::PointIndices::Ptr inliers (new pcl::PointIndices);
-  PointCloudOperations::fitPlanarModel(cloud_filtered, inliers, coefficients, planeMaxIterations, planeDistanceThreshold);
-  logger.logInfo((boost::format("Table inlier count: %s") % inliers->indices.size ()).str());
+  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  pcl::PCDWriter writer;
+  const bool organized = organizedSegmentation && cloud_organized && cloud_organized->isOrganized();
+  if(organizedSegmentation && !organized)
+    logger.logWarn("Organized segmentation requested, but the input cloud is not organized. Using RANSAC");
+
+  StageCache::Key plane_key;
+  plane_key << stage_cache_.version("filter") << organized << planeDistanceThreshold;
+  if(organized)
+    plane_key << organizedPlaneMinInliers << organizedPlaneAngularThreshold;
+  else
+    plane_key << stage_cache_.version("downsample") << planeMaxIterations << planeRansacConfidence
+      << planeRansacGuided << planeNormalPrior.transpose() << planeNormalTolerance << planeTracking
+      << planeTrackingMinInlierRatio << coarsePlaneFitting << coarsePlaneLeafSize;
+  const bool plane = !stage_cache_.reuse("plane", plane_key);
+  if(plane)
+  {
+    stages_.plane_coefficients.reset(new pcl::ModelCoefficients);
+    stages_.plane_inliers = workspace_.acquireIndices();
+    if(organized)
+    {
+      // Segment the table directly on the pixel grid. The resulting region
+      // is already connected, so we can skip the clustering of the plane.
+      stages_.plane_region = workspace_.acquireCloud();
+      if(!PointCloudOperations::fitPlanarModelOrganized(cloud_organized, stages_.plane_region, stages_.plane_inliers,
+          stages_.plane_coefficients, organizedPlaneMinInliers, organizedPlaneAngularThreshold, planeDistanceThreshold))
+      {
+        logger.logError("Organized table segmentation failed. Exiting....");
+        stage_cache_.invalidate("plane");
+        return;
+      }
+    }
+    else
+    {
+      // Find the biggest table plane in the scene
+      fitTablePlane(cloud_filtered, cloud_in, stages_.plane_inliers, stages_.plane_coefficients);
+    }
+    logger.logInfo((boost::format("Table inlier count: %s") % stages_.plane_inliers->indices.size ()).str());
+  }
   // Table segmentation done
+  pcl::ModelCoefficients::Ptr coefficients = stages_.plane_coefficients;
   table_coefficients_ = coefficients;
+
+  StageCache::Key table_key;
+  table_key << stage_cache_.version("plane") << stage_cache_.version("downsample");
+  if(organized)
+    table_key << downsampleLeafSize;
+  else
+    table_key << ecObjClusterTolerance << ecMinClusterSize << ecMaxClusterSize;
+  const bool table = !stage_cache_.reuse("table cluster", table_key);
+  if(table)
+  {
+    stages_.table_cloud = workspace_.acquireCloud();
+    if(organized)
+    {
+      // The region is at full resolution. Bring it down to the resolution
+      // of the object cloud before computing hulls on it
+      PointCloudOperations::downsample(stages_.plane_region, stages_.table_cloud, downsampleLeafSize);
+      stages_.table_inliers = stages_.plane_inliers;
+    }
+    else
+    {
+      // Extract the plane as a PointCloud from the calculated inliers
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_plane = workspace_.acquireCloud();
+      PointCloudOperations::extractInliersFromPointCloud(cloud_filtered, stages_.plane_inliers, cloud_plane, false);
+
+      // Take the biggest cluster in the extracted plane. This will be
+      // most likely our desired table pointcloud
+      // NOTE: We need to transform the inliers from table_cluster_indices to inliers
+      stages_.table_inliers = workspace_.acquireIndices();
+      PointCloudOperations::extractBiggestCluster(cloud_plane, stages_.table_cloud, stages_.plane_inliers,
+          stages_.table_inliers, ecObjClusterTolerance, ecMinClusterSize, ecMaxClusterSize);
+    }
+  }
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr plane_cluster = stages_.table_cloud;
+  if(plane || table)
+  {
+    boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
+    logStage(s, e, "perception_lib/table_segmentation", "table segmentation");
+  }
   
-  // Extract the plane as a PointCloud from the calculated inliers
-  PointCloudOperations::extractInliersFromPointCloud(cloud_filtered, inliers, cloud_plane, false);
-
-  // Take the biggest cluster in the extracted plane. This will be
-  // most likely our desired table pointcloud
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr plane_cluster (new pcl::PointCloud<pcl::PointXYZRGB>);
-  pcl::PointIndices::Ptr new_inliers (new pcl::PointIndices);
-  PointCloudOperations::extractBiggestCluster(cloud_plane, plane_cluster, inliers, new_inliers,
-    ecObjClusterTolerance, ecMinClusterSize, ecMaxClusterSize);
-
-  // NOTE: We need to transform the inliers from table_cluster_indices to inliers
-  inliers = new_inliers;
-  
-  if(inliers->indices.size () == 0)
+  if(stages_.table_inliers->indices.size () == 0)
   {
     logger.logError("Second Table Inlier Set is empty. Exiting....");
+    stage_cache_.invalidate("table cluster");
     return;
   }
-  plane_cloud_ = plane_cluster; // save the reference to the segmented and clustered table plane
+  result.table_coefficients = coefficients;
+  result.plane_cloud = plane_cluster; // save the reference to the segmented and clustered table plane
+  result.surface_clouds.push_back(plane_cluster);
+  result.surface_coefficients.push_back(coefficients);
 
   // Extract all objects above
   // the table plane
-  pcl::PointIndices::Ptr object_indices (new pcl::PointIndices);
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_clusters (new pcl::PointCloud<pcl::PointXYZRGB>());
-  PointCloudOperations::extractAllPointsAbovePointCloud(cloud_filtered, plane_cluster,
-      object_clusters, object_indices, 2, prismZMin, prismZMax);
-  objects_on_plane_cloud_ = object_clusters;
+  s = boost::posix_time::microsec_clock::local_time();
+  StageCache::Key prism_key;
+  prism_key << stage_cache_.version("table cluster") << stage_cache_.version("downsample") << prismZMin << prismZMax;
+  const bool prism = !stage_cache_.reuse("prism", prism_key);
+  if(prism)
+  {
+    stages_.object_indices = workspace_.acquireIndices();
+    stages_.objects_on_plane = workspace_.acquireCloud();
+    PointCloudOperations::extractAllPointsAbovePointCloud(cloud_filtered, plane_cluster,
+        stages_.objects_on_plane, stages_.object_indices, 2, prismZMin, prismZMax);
+  }
+  result.objects_on_plane_cloud = stages_.objects_on_plane;
 
   // Project the pointcloud above the table onto the table to get a 2d representation of the objects
   // This will cause every point of an object to be at the base of the object
-  PointCloudOperations::projectToPlaneCoefficients(cloud_filtered, object_indices, coefficients, objects_cloud_projected);
-  if(writer_pcd) writer.write ("objects_cloud_projected.pcd", *objects_cloud_projected, false);
+  StageCache::Key projection_key;
+  projection_key << stage_cache_.version("prism") << stage_cache_.version("plane");
+  const bool projection = !stage_cache_.reuse("projection", projection_key);
+  if(projection)
+  {
+    stages_.objects_projected = workspace_.acquireCloud();
+    PointCloudOperations::projectToPlaneCoefficients(cloud_filtered, stages_.object_indices, coefficients,
+        stages_.objects_projected);
+    if(writer_pcd) writer.write ("objects_cloud_projected.pcd", *stages_.objects_projected, false);
+  }
+  if(prism || projection)
+  {
+    boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
+    logStage(s, e, "perception_lib/prism_extraction", "extracting points above the plane");
+  }
 
   // Take the projected points, cluster them and extract everything that's above it
   // By doing this, we should get every object on the table and a 2d image of it.
-  std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> extractedObjects;
-  perceived_cluster_rois_.clear();
-  clusterFromProjection(objects_cloud_projected, cloud_in, &removed_indices_filtered, extractedObjects, perceived_cluster_images_, perceived_cluster_rois_);
-  logger.logInfo((boost::format(" - extractedObjects Vector size %s") % extractedObjects.size()).str());
-  logger.logInfo((boost::format(" - extractedImages  Vector size %s") % perceived_cluster_images_.size()).str());
-  logger.logInfo((boost::format(" - extractedROIs  Vector size %s") % perceived_cluster_rois_.size()).str());
-    
-  // temporary list of perceived objects
-  //std::vector<PerceivedObject> tmpPerceivedObjects;
-  std::vector<PerceivedObject, Eigen::aligned_allocator<PerceivedObject> > tmpPerceivedObjects;
+  // This is clusterFromProjection, split into its stages
+  StageCache::Key clusters_key;
+  clusters_key << stage_cache_.version("projection") << stage_cache_.version("filter") << rasterObjectClustering
+    << ecObjClusterTolerance << ecObjMinClusterSize << ecObjMaxClusterSize;
+  if(!stage_cache_.reuse("object clusters", clusters_key))
+  {
+    stages_.cluster_indices.clear();
+    if(canClusterProjection(stages_.objects_projected, cloud_in))
+      clusterProjection(stages_.objects_projected, coefficients, stages_.cluster_indices);
+  }
+
+  StageCache::Key extraction_key;
+  extraction_key << stage_cache_.version("object clusters") << prismZMin << prismZMax << ecObjClusterTolerance
+    << computeClusterMasks_;
+  if(!stage_cache_.reuse("object extraction", extraction_key))
+  {
+    stages_.objects.clear();
+    stages_.images.clear();
+    stages_.masks.clear();
+    stages_.rois.clear();
+    if(!stages_.cluster_indices.empty())
+      extractClusterObjects(stages_.objects_projected, cloud_in, &removed_indices_filtered, stages_.cluster_indices,
+          stages_.objects, stages_.images, stages_.masks, stages_.rois, coefficients, prismZMax, workspace_);
+  }
+  result.cluster_images = stages_.images;
+  result.cluster_masks = stages_.masks;
+  result.cluster_rois = stages_.rois;
+  logger.logInfo((boost::format(" - extractedObjects Vector size %s") % stages_.objects.size()).str());
+  logger.logInfo((boost::format(" - extractedImages  Vector size %s") % result.cluster_images.size()).str());
+  logger.logInfo((boost::format(" - extractedROIs  Vector size %s") % result.cluster_rois.size()).str());
   
 
   // hack for collision_objects
-  collision_objects = extractedObjects;
+  collision_objects = stages_.objects;
+  StageCache::Key properties_key;
+  properties_key << stage_cache_.version("object extraction") << calculateHullVolume_;
+  if(stage_cache_.reuse("object properties", properties_key))
+  {
+    result.objects = stages_.perceived_objects;
+  }
+  else
+  {
+    addPerceivedObjects(stages_.objects, result.cluster_rois, 0, result);
+    stages_.perceived_objects = result.objects;
+  }
+
+  boost::posix_time::ptime end = boost::posix_time::microsec_clock::local_time();
+  logStage(start, end, "perception_lib/segmentation", "SEGMENTATION");
+}
+
+
+/*
+ * Segmentation for scenes with more than one support surface, like shelves or
+ * several tables. Every horizontal surface with atleast surfaceMinInliers points
+ * is fitted (see PointCloudOperations::fitSupportSurfaces) and the objects above
+ * the surfaces are extracted in parallel, one thread per surface.
+ * The prism of a surface ends below the next surface, that lies above it, so
+ * a shelf board doesn't become an object of the board below.
+ * The first surface is the biggest one. It is used as the table of the result.
+ */
+void SuturoPerception::segmentSurfaces(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_filtered, std::vector<int> &removed_indices_filtered,
+    boost::posix_time::ptime start, SegmentationResult &result)
+{
+  // Only the surfaces are cached, the objects are extracted again
+  StageCache::Key surfaces_key;
+  surfaces_key << stage_cache_.version("downsample") << surfaceMaxCount << surfaceMinInliers << surfaceMaxAngle
+    << planeMaxIterations << planeRansacConfidence << planeRansacGuided << planeNormalPrior.transpose()
+    << planeNormalTolerance << planeDistanceThreshold
+    << ecObjClusterTolerance;
+  if(!stage_cache_.reuse("support surfaces", surfaces_key))
+  {
+    boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+    stages_.surface_points = workspace_.acquireIndices();
+    stages_.surface_count = PointCloudOperations::fitSupportSurfaces(cloud_filtered, surfaceMaxCount,
+        surfaceMinInliers, surfaceMaxAngle, planeMaxIterations, planeDistanceThreshold, ecObjClusterTolerance,
+        stages_.surface_indices, stages_.surface_coefficients, *stages_.surface_points, ransacOptions());
+    boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
+    logStage(s, e, "perception_lib/support_surfaces", "support surface segmentation");
+  }
+  const int count = stages_.surface_count;
+  const std::vector<pcl::PointIndices> &surface_indices = stages_.surface_indices;
+  const std::vector<pcl::ModelCoefficients::Ptr> &surface_coefficients = stages_.surface_coefficients;
+  pcl::PointIndices::Ptr plane_points = stages_.surface_points;
+  logger.logInfo((boost::format("Found %s support surfaces") % count).str());
+  if(count == 0)
+  {
+    logger.logError("No support surface found. Exiting....");
+    return;
+  }
+  table_coefficients_ = surface_coefficients[0];
+
+  // Every point, that is not part of a plane, can belong to an object
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr candidates =
+    workspace_.acquireCloud(cloud_filtered->points.size() - plane_points->indices.size());
+  std::vector<int>::const_iterator next_plane_point = plane_points->indices.begin();
+  for (int i = 0; i < cloud_filtered->points.size(); i++)
+  {
+    if (next_plane_point != plane_points->indices.end() && *next_plane_point == i)
+    {
+      ++next_plane_point;
+      continue;
+    }
+    candidates->points.push_back(cloud_filtered->points[i]);
+  }
+  candidates->width = candidates->points.size();
+  candidates->height = 1;
+  candidates->is_dense = true;
+
+  std::vector<SurfaceObjects> surfaces(count);
+  for (int i = 0; i < count; i++)
+  {
+    surfaces[i].surface = workspace_.acquireCloud(surface_indices[i].indices.size());
+    for (int k = 0; k < surface_indices[i].indices.size(); k++)
+      surfaces[i].surface->points.push_back(cloud_filtered->points[surface_indices[i].indices[k]]);
+    surfaces[i].surface->width = surfaces[i].surface->points.size();
+    surfaces[i].surface->height = 1;
+    surfaces[i].surface->is_dense = true;
+    surfaces[i].coefficients = surface_coefficients[i];
+  }
+
+  // Cap the prism of every surface below the lowest surface, that covers it. A surface
+  // covers another one, if its bounding box, moved down onto the other plane, overlaps the other box
+  std::vector<Eigen::Vector3f> surface_min(count), surface_max(count);
+  for (int i = 0; i < count; i++)
+  {
+    Eigen::Vector4f min, max;
+    pcl::getMinMax3D(*surfaces[i].surface, min, max);
+    surface_min[i] = min.head<3>();
+    surface_max[i] = max.head<3>();
+  }
+  for (int i = 0; i < count; i++)
+  {
+    const std::vector<float> &plane = surfaces[i].coefficients->values;
+    Eigen::Vector3f normal(plane[0], plane[1], plane[2]);
+    surfaces[i].prism_z_max = prismZMax;
+    for (int j = 0; j < count; j++)
+    {
+      if (j == i)
+        continue;
+      Eigen::Vector3f center = (surface_min[j] + surface_max[j]) / 2;
+      double height = normal.dot(center) + plane[3];
+      if (height <= planeDistanceThreshold || height - planeDistanceThreshold >= surfaces[i].prism_z_max)
+        continue;
+      Eigen::Vector3f shift = normal * height;
+      Eigen::Vector3f min_j = surface_min[j] - shift;
+      Eigen::Vector3f max_j = surface_max[j] - shift;
+      if ((min_j.array() <= surface_max[i].array() + ecObjClusterTolerance).all() &&
+          (max_j.array() >= surface_min[i].array() - ecObjClusterTolerance).all())
+        surfaces[i].prism_z_max = height - planeDistanceThreshold;
+    }
+  }
+
+  // The extraction of every surface runs on its own thread with its own workspace
+  while (surface_workspaces_.size() < count)
+    surface_workspaces_.push_back(boost::shared_ptr<FrameWorkspace>(new FrameWorkspace));
+  boost::thread_group workers;
+  for (int i = 0; i < count; i++)
+  {
+    if (i == count - 1)
+      extractSurfaceObjects(candidates, cloud_in, &removed_indices_filtered, &surfaces[i],
+          surface_workspaces_[i].get()); // use the calling thread as well
+    else
+      workers.create_thread(boost::bind(&SuturoPerception::extractSurfaceObjects, this, candidates, cloud_in,
+            &removed_indices_filtered, &surfaces[i], surface_workspaces_[i].get()));
+  }
+  workers.join_all();
+
+  result.table_coefficients = surfaces[0].coefficients;
+  result.plane_cloud = surfaces[0].surface;
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr objects_on_planes = workspace_.acquireCloud();
+  collision_objects.clear();
+  for (int i = 0; i < count; i++)
+  {
+    logger.logInfo((boost::format("Surface %s: %s objects, prism height %s") % i % surfaces[i].objects.size()
+          % surfaces[i].prism_z_max).str());
+    result.surface_clouds.push_back(surfaces[i].surface);
+    result.surface_coefficients.push_back(surfaces[i].coefficients);
+    result.cluster_images.insert(result.cluster_images.end(), surfaces[i].images.begin(), surfaces[i].images.end());
+    result.cluster_masks.insert(result.cluster_masks.end(), surfaces[i].masks.begin(), surfaces[i].masks.end());
+    result.cluster_rois.insert(result.cluster_rois.end(), surfaces[i].rois.begin(), surfaces[i].rois.end());
+    *objects_on_planes += *surfaces[i].object_points;
+    collision_objects.insert(collision_objects.end(), surfaces[i].objects.begin(), surfaces[i].objects.end());
+    addPerceivedObjects(surfaces[i].objects, surfaces[i].rois, i, result);
+  }
+  result.objects_on_plane_cloud = objects_on_planes;
+
+  boost::posix_time::ptime end = boost::posix_time::microsec_clock::local_time();
+  logStage(start, end, "perception_lib/segmentation", "SEGMENTATION");
+}
+
+/*
+ * Extract the objects above surface->surface from the candidate points.
+ * Only uses the given workspace, the results go into surface.
+ */
+void SuturoPerception::extractSurfaceObjects(pcl::PointCloud<pcl::PointXYZRGB>::Ptr candidates,
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in, std::vector<int> *removed_indices_filtered,
+    SurfaceObjects *surface, FrameWorkspace *workspace)
+{
+  workspace->beginFrame();
+  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  pcl::PointIndices::Ptr object_indices = workspace->acquireIndices();
+  surface->object_points = workspace->acquireCloud();
+  PointCloudOperations::extractAllPointsAbovePointCloud(candidates, surface->surface,
+      surface->object_points, object_indices, 2, prismZMin, surface->prism_z_max);
+
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr objects_cloud_projected = workspace->acquireCloud();
+  PointCloudOperations::projectToPlaneCoefficients(candidates, object_indices, surface->coefficients,
+      objects_cloud_projected);
+  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
+  logStage(s, e, "perception_lib/prism_extraction", "extracting points above the plane");
+
+  clusterFromProjection(objects_cloud_projected, cloud_in, removed_indices_filtered, surface->objects,
+      surface->images, surface->masks, surface->rois, surface->coefficients, surface->prism_z_max, *workspace);
+  workspace->endFrame();
+  frame_stats_mutex_.lock();
+  frame_allocations_ += workspace->getLastFrameAllocations();
+  frame_stats_mutex_.unlock();
+}
+
+/*
+ * Compute the hull volume and the centroid of every extracted cluster and add it as a
+ * PerceivedObject on the support surface surface_id to the result. rois[i] is the ROI of cluster i.
+ */
+void SuturoPerception::addPerceivedObjects(const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &extracted_objects,
+    const std::vector<ROI> &rois, int surface_id, SegmentationResult &result)
+{
+  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
   int i=0;
   // Iterate over the extracted clusters and write them as a PerceivedObjects to the result list
-  for (std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr>::iterator it = extractedObjects.begin(); 
-      it != extractedObjects.end(); ++it)
+  for (std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr>::const_iterator it = extracted_objects.begin(); 
+      it != extracted_objects.end(); ++it)
   {  
     logger.logInfo((boost::format("Transform cluster %s into a message. \
                     Cluster has %s points") % i % (*it)->points.size()).str());
@@ -330,14 +990,11 @@ void SuturoPerception::processCloudWithProjections(pcl::PointCloud<pcl::PointXYZ
     
     // Calculate the volume of each cluster
     // Create a convex hull around the cluster and calculate the total volume
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr hull_points (new pcl::PointCloud<pcl::PointXYZRGB> ());
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr obj_points_from_hull (new pcl::PointCloud<pcl::PointXYZRGB> ());
-
-    pcl::ConvexHull<pcl::PointXYZRGB> hull;
-    hull.setInputCloud(*it);
-    hull.setDimension(3);
-    hull.setComputeAreaVolume(calculateHullVolume_); // This creates alot of output, but it's necessary for getTotalVolume() ....
-    hull.reconstruct (*hull_points);
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr hull_points = workspace_.acquireCloud();
+    double hull_volume = 0;
+    suturo_perception_utils::ThreadsafeHull::computeConvexHull(*it, hull_points, 3, NULL, &hull_volume);
+    if(!calculateHullVolume_)
+      hull_volume = 0;
 
     // Centroid calulcation
     Eigen::Vector4f centroid;
@@ -357,8 +1014,9 @@ void SuturoPerception::processCloudWithProjections(pcl::PointCloud<pcl::PointXYZ
     ptCentroid.y=centroid[1];
     ptCentroid.z=centroid[2];
     percObj.set_c_centroid(ptCentroid);
-    percObj.set_c_volume(hull.getTotalVolume());
-    percObj.set_c_roi(perceived_cluster_rois_[i]);
+    percObj.set_c_volume(hull_volume);
+    percObj.set_c_support_surface_id(surface_id);
+    percObj.set_c_roi(rois[i]);
     percObj.set_c_color_average_r((0 >> 16) & 0x0000ff);
     percObj.set_c_color_average_g((0 >> 8)  & 0x0000ff);
     percObj.set_c_color_average_b((0)       & 0x0000ff);
@@ -369,33 +1027,218 @@ void SuturoPerception::processCloudWithProjections(pcl::PointCloud<pcl::PointXYZ
     percObj.set_c_hue_histogram_quality(emptyHistogramQuality);
     percObj.set_pointCloud(*it);
 
-    tmpPerceivedObjects.push_back(percObj);
+    result.objects.push_back(percObj);
     i++;
   }
+  boost::posix_time::ptime e = boost::posix_time::microsec_clock::local_time();
+  logStage(s, e, "perception_lib/object_properties", "object properties");
+}
+
+/*
+ * Restrict the next frame to the region around the table of this frame.
+ * The crop box is the bounding box of the table, grown by prismZMax along the
+ * table normal (so the objects on it stay inside) and by autoROIMargin.
+ * For organized frames, the pixel ROI is the bounding rectangle of the pixels
+ * in that box, grown by autoROIPixelMargin. Without a table, the next frame
+ * is processed completely again.
+ */
+void SuturoPerception::updateAutoRegion(const SegmentationResult &result,
+    const pcl::PointCloud<pcl::PointXYZRGB> &cloud_filtered, const std::vector<int> &pixel_indices)
+{
+  if(!autoROI)
+    return;
+
+  if(!result.plane_cloud || result.plane_cloud->points.empty() || !result.table_coefficients ||
+      result.table_coefficients->values.size() < 3)
+  {
+    if(!auto_region_.isEmpty())
+      logger.logInfo("No table found, processing the whole frame again");
+    auto_region_ = ProcessingRegion();
+    return;
+  }
 
-  // Lock the buffer access to assign the recently perceived objects
-  mutex.lock();
-  perceivedObjects = tmpPerceivedObjects;
-  mutex.unlock();
+  // With several support surfaces, the box covers all of them
+  Eigen::Vector4f table_min, table_max;
+  pcl::getMinMax3D(*result.plane_cloud, table_min, table_max);
+  for (size_t i = 1; i < result.surface_clouds.size(); i++)
+  {
+    Eigen::Vector4f surface_min, surface_max;
+    pcl::getMinMax3D(*result.surface_clouds[i], surface_min, surface_max);
+    table_min = table_min.cwiseMin(surface_min);
+    table_max = table_max.cwiseMax(surface_max);
+  }
+  const std::vector<float> &c = result.table_coefficients->values;
+  Eigen::Vector3f normal(c[0], c[1], c[2]);
+  normal.normalize();
+  Eigen::Vector3f grow = normal.cwiseAbs() * prismZMax + Eigen::Vector3f::Constant(autoROIMargin);
 
-  boost::posix_time::ptime end = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(start, end, "SEGMENTATION");
+  ProcessingRegion region;
+  region.setBox(table_min.head<3>() - grow, table_max.head<3>() + grow);
+
+  if(frame_height_ > 1 && frame_width_ > 0)
+  {
+    int min_column = frame_width_;
+    int max_column = -1;
+    int min_row = frame_height_;
+    int max_row = -1;
+    for (size_t i = 0; i < cloud_filtered.points.size(); i++)
+    {
+      const pcl::PointXYZRGB &p = cloud_filtered.points[i];
+      if (!pcl::isFinite(p) ||
+          (p.getVector3fMap().array() < region.box_min.array()).any() ||
+          (p.getVector3fMap().array() > region.box_max.array()).any())
+        continue;
+      int row = pixel_indices[i] / frame_width_;
+      int column = pixel_indices[i] % frame_width_;
+      if(column < min_column) min_column = column;
+      if(column > max_column) max_column = column;
+      if(row < min_row) min_row = row;
+      if(row > max_row) max_row = row;
+    }
+    if(max_row >= 0)
+    {
+      ROI roi;
+      roi.origin.x = min_column - autoROIPixelMargin;
+      roi.origin.y = min_row - autoROIPixelMargin;
+      roi.width = max_column - min_column + 1 + 2 * autoROIPixelMargin;
+      roi.height = max_row - min_row + 1 + 2 * autoROIPixelMargin;
+      region.setPixels(roi);
+    }
+  }
+
+  auto_region_ = region;
+  logger.logInfo((boost::format("Next frame restricted to the box (%s, %s, %s) - (%s, %s, %s) and %sx%s pixels")
+        % region.box_min[0] % region.box_min[1] % region.box_min[2]
+        % region.box_max[0] % region.box_max[1] % region.box_max[2]
+        % region.pixels.width % region.pixels.height).str());
+}
+
+/*
+ * Scene change gating. The frame is compared to the last frame, that has been
+ * segmented. If less than sceneChangeMaxFraction of its sampled pixels changed,
+ * the last result is published again with the stamp of this frame.
+ * Otherwise, this frame becomes the reference for the next ones.
+ */
+template <typename FrameT>
+bool SuturoPerception::reuseUnchangedFrame(const FrameT &frame, boost::posix_time::ptime start)
+{
+  scene_change_.setDepthThreshold(sceneChangeDepthThreshold);
+  scene_change_.setColorThreshold(sceneChangeColorThreshold);
+  float changed = scene_change_.changedFraction(frame);
+  // Without a reference frame, the fraction is 1
+  if(changed > sceneChangeMaxFraction)
+  {
+    scene_change_.acceptFrame();
+    return false;
+  }
+
+  SegmentationResult::Ptr result(new SegmentationResult(*getLastResult()));
+  result->stamp = start;
+  result->reused = true;
+  // Nothing has been computed for this frame
+  result->stage_timings.clear();
+  result->allocations = 0;
+  result->reused_stages.clear();
+  MetricsRegistry::instance().increment("perception_lib/reused_frames");
+  logger.logInfo((boost::format("Frame unchanged (%s of the pixels changed), reusing the last result") % changed).str());
+  publishResult(result);
+  return true;
+}
+
+void SuturoPerception::beginFrame()
+{
+  workspace_.beginFrame();
+  stage_cache_.beginRun();
+  frame_stats_mutex_.lock();
+  frame_timings_.clear();
+  frame_allocations_ = 0;
+  frame_stats_mutex_.unlock();
 }
 
+/*
+ * End the frame in the workspace and publish its result.
+ * The workers of the frame are done, so the stats need no lock here.
+ */
+void SuturoPerception::finishFrame(SegmentationResult::Ptr result)
+{
+  workspace_.endFrame();
+  frame_allocations_ += workspace_.getLastFrameAllocations();
+  logger.logInfo((boost::format("Frame allocated %s buffers, %s buffers pooled")
+        % frame_allocations_ % workspace_.getPoolSize()).str());
+  result->stage_timings = frame_timings_;
+  result->allocations = frame_allocations_;
+  result->reused_stages = stage_cache_.getReusedStages();
+  // Without stageCaching, the intermediate results go back to the workspace
+  if(!stageCaching)
+    resetStageCache();
+  MetricsRegistry::instance().increment("perception_lib/frames");
+  MetricsRegistry::instance().increment("perception_lib/reused_stages", result->reused_stages.size());
+  MetricsRegistry::instance().increment("perception_lib/buffer_allocations", frame_allocations_);
+  publishResult(result);
+}
+
+void SuturoPerception::logStage(boost::posix_time::ptime s, boost::posix_time::ptime e,
+    const std::string &stage, const std::string &text)
+{
+  MetricsRegistry &metrics = MetricsRegistry::instance();
+  if(metrics.isEnabled())
+    metrics.recordTime(stage, s, e);
+  logger.logTime(s, e, text);
+  frame_stats_mutex_.lock();
+  frame_timings_[stage] += (e - s).total_microseconds() / 1000.0;
+  frame_stats_mutex_.unlock();
+}
+
+/*
+ * The number of threads is left out of the keys of the stage cache,
+ * because it doesn't change the plane.
+ */
+RansacOptions SuturoPerception::ransacOptions() const
+{
+  RansacOptions options;
+  options.confidence = planeRansacConfidence;
+  options.guided = planeRansacGuided;
+  options.threads = planeRansacThreads;
+  options.normal_prior = planeNormalPrior;
+  options.normal_tolerance = planeNormalTolerance;
+  return options;
+}
+
+void SuturoPerception::publishResult(SegmentationResult::ConstPtr result)
+{
+  // Only swap the pointer while holding the lock. The old result
+  // gets destroyed outside, if this was the last reference to it
+  result_mutex_.lock();
+  last_result_.swap(result);
+  result_mutex_.unlock();
+}
+
+SegmentationResult::ConstPtr SuturoPerception::getLastResult()
+{
+  result_mutex_.lock();
+  SegmentationResult::ConstPtr result = last_result_;
+  result_mutex_.unlock();
+  return result;
+}
 
 std::vector<PerceivedObject, Eigen::aligned_allocator<PerceivedObject> > SuturoPerception::getPerceivedObjects()
 {
-  return perceivedObjects;
+  return getLastResult()->objects;
 }
 
 std::vector<cv::Mat> SuturoPerception::getPerceivedClusterImages()
 {
-  return perceived_cluster_images_;
+  return getLastResult()->cluster_images;
+}
+
+std::vector<cv::Mat> SuturoPerception::getPerceivedClusterMasks()
+{
+  return getLastResult()->cluster_masks;
 }
 
 std::vector<ROI> SuturoPerception::getPerceivedClusterROIs()
 {
-  return perceived_cluster_rois_;
+  return getLastResult()->cluster_rois;
 }
 
 // vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2: 
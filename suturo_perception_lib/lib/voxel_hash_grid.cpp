@@ -0,0 +1,134 @@
+#include "voxel_hash_grid.h"
+
+#include <algorithm>
+
+using namespace suturo_perception_lib;
+
+VoxelHashGrid::VoxelHashGrid(float leaf_size)
+{
+  inverse_leaf_size_ = 1.0f / leaf_size;
+  table_.assign(1024, -1);
+  mask_ = table_.size() - 1;
+}
+
+void VoxelHashGrid::reserve(size_t voxels)
+{
+  voxels_.reserve(voxels);
+  // Keep the load factor below 0.5
+  size_t capacity = table_.size();
+  while (capacity < 2 * voxels)
+    capacity *= 2;
+  if (capacity != table_.size())
+    rehash(capacity);
+}
+
+void VoxelHashGrid::clear()
+{
+  voxels_.clear();
+  std::fill(table_.begin(), table_.end(), -1);
+}
+
+void VoxelHashGrid::addPoint(int ix, int iy, int iz, const pcl::PointXYZRGB &p)
+{
+  Voxel &v = voxels_[findOrInsert(ix, iy, iz)];
+  v.x += p.x;
+  v.y += p.y;
+  v.z += p.z;
+  v.r += p.r;
+  v.g += p.g;
+  v.b += p.b;
+  v.count++;
+}
+
+void VoxelHashGrid::merge(const VoxelHashGrid &other)
+{
+  reserve(voxels_.size() + other.voxels_.size());
+  for (size_t i = 0; i < other.voxels_.size(); i++)
+  {
+    const Voxel &o = other.voxels_[i];
+    Voxel &v = voxels_[findOrInsert(o.ix, o.iy, o.iz)];
+    v.x += o.x;
+    v.y += o.y;
+    v.z += o.z;
+    v.r += o.r;
+    v.g += o.g;
+    v.b += o.b;
+    v.count += o.count;
+  }
+}
+
+void VoxelHashGrid::getCentroids(pcl::PointCloud<pcl::PointXYZRGB> &cloud_out) const
+{
+  std::vector<Voxel> sorted(voxels_);
+  std::sort(sorted.begin(), sorted.end(), voxelLess);
+
+  cloud_out.points.resize(sorted.size());
+  for (size_t i = 0; i < sorted.size(); i++)
+  {
+    const Voxel &v = sorted[i];
+    pcl::PointXYZRGB &p = cloud_out.points[i];
+    p.x = v.x / v.count;
+    p.y = v.y / v.count;
+    p.z = v.z / v.count;
+    // Same truncation as pcl::VoxelGrid
+    uint8_t r = static_cast<int>(v.r / v.count);
+    uint8_t g = static_cast<int>(v.g / v.count);
+    uint8_t b = static_cast<int>(v.b / v.count);
+    p.rgba = ((uint32_t)r << 16 | (uint32_t)g << 8 | (uint32_t)b);
+  }
+  cloud_out.width = cloud_out.points.size();
+  cloud_out.height = 1;
+  cloud_out.is_dense = true;
+}
+
+bool VoxelHashGrid::voxelLess(const Voxel &a, const Voxel &b)
+{
+  if (a.iz != b.iz)
+    return a.iz < b.iz;
+  if (a.iy != b.iy)
+    return a.iy < b.iy;
+  return a.ix < b.ix;
+}
+
+int VoxelHashGrid::findOrInsert(int ix, int iy, int iz)
+{
+  size_t s = slot(ix, iy, iz);
+  while (table_[s] != -1)
+  {
+    const Voxel &v = voxels_[table_[s]];
+    if (v.ix == ix && v.iy == iy && v.iz == iz)
+      return table_[s];
+    s = (s + 1) & mask_;
+  }
+
+  Voxel v;
+  v.ix = ix;
+  v.iy = iy;
+  v.iz = iz;
+  v.x = v.y = v.z = 0;
+  v.r = v.g = v.b = 0;
+  v.count = 0;
+  voxels_.push_back(v);
+  table_[s] = voxels_.size() - 1;
+
+  if (2 * voxels_.size() > table_.size())
+  {
+    rehash(2 * table_.size());
+  }
+  return voxels_.size() - 1;
+}
+
+void VoxelHashGrid::rehash(size_t capacity)
+{
+  table_.assign(capacity, -1);
+  mask_ = capacity - 1;
+  for (size_t i = 0; i < voxels_.size(); i++)
+  {
+    size_t s = slot(voxels_[i].ix, voxels_[i].iy, voxels_[i].iz);
+    while (table_[s] != -1)
+      s = (s + 1) & mask_;
+    table_[s] = i;
+  }
+}
+
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
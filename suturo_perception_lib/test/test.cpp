@@ -3,6 +3,7 @@
 #include "point.h"
 #include <iostream>
 #include <sstream>
+#include <limits>
 #include <gtest/gtest.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
@@ -55,6 +56,820 @@ TEST(suturo_perception_test, box_1_test)
   SUCCEED();
 }
 
+TEST(suturo_perception_test, downsample_test)
+{
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  if (pcl::io::loadPCDFile<pcl::PointXYZRGB> ("box1.pcd", *cloud) == -1)
+  {
+    FAIL() << "Couldn't read file box1.pcd";
+  }
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_nanles (new pcl::PointCloud<pcl::PointXYZRGB>),
+                                      expected (new pcl::PointCloud<pcl::PointXYZRGB>),
+                                      downsampled (new pcl::PointCloud<pcl::PointXYZRGB>);
+  suturo_perception_lib::PointCloudOperations::removeNans(cloud, cloud_nanles);
+
+  pcl::VoxelGrid<pcl::PointXYZRGB> vg;
+  vg.setInputCloud(cloud_nanles);
+  vg.setLeafSize(0.01f, 0.01f, 0.01f);
+  vg.filter(*expected);
+
+  suturo_perception_lib::PointCloudOperations::downsample(cloud_nanles, downsampled, 0.01f);
+
+  // Same centroids and colors in the same order
+  ASSERT_EQ(expected->points.size(), downsampled->points.size());
+  for (int i = 0; i < expected->points.size(); i++)
+  {
+    ASSERT_NEAR(expected->points[i].x, downsampled->points[i].x, 1e-5);
+    ASSERT_NEAR(expected->points[i].y, downsampled->points[i].y, 1e-5);
+    ASSERT_NEAR(expected->points[i].z, downsampled->points[i].z, 1e-5);
+    ASSERT_NEAR(expected->points[i].r, downsampled->points[i].r, 1);
+    ASSERT_NEAR(expected->points[i].g, downsampled->points[i].g, 1);
+    ASSERT_NEAR(expected->points[i].b, downsampled->points[i].b, 1);
+  }
+}
+
+TEST(suturo_perception_test, euclidean_clustering_test)
+{
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  if (pcl::io::loadPCDFile<pcl::PointXYZRGB> ("box1.pcd", *cloud) == -1)
+  {
+    FAIL() << "Couldn't read file box1.pcd";
+  }
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr downsampled (new pcl::PointCloud<pcl::PointXYZRGB>);
+  suturo_perception_lib::PointCloudOperations::downsample(cloud, downsampled, 0.01f);
+
+  pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZRGB>);
+  tree->setInputCloud(downsampled);
+  std::vector<pcl::PointIndices> expected;
+  pcl::EuclideanClusterExtraction<pcl::PointXYZRGB> ec;
+  ec.setClusterTolerance(0.02);
+  ec.setMinClusterSize(50);
+  ec.setMaxClusterSize(200000);
+  ec.setSearchMethod(tree);
+  ec.setInputCloud(downsampled);
+  ec.extract(expected);
+
+  std::vector<pcl::PointIndices> clusters;
+  suturo_perception_lib::EuclideanClustering::extract(downsampled, 0.02, 50, 200000, clusters, 4);
+
+  // Same clusters with the same sorted indices, ordered by their size
+  ASSERT_EQ(expected.size(), clusters.size());
+  for (int i = 0; i < expected.size(); i++)
+  {
+    std::sort(expected[i].indices.begin(), expected[i].indices.end());
+    ASSERT_EQ(expected[i].indices.size(), clusters[i].indices.size());
+    if (i + 1 < expected.size() && expected[i].indices.size() == expected[i + 1].indices.size())
+      continue; // the order of clusters with the same size is not defined
+    ASSERT_TRUE(expected[i].indices == clusters[i].indices);
+  }
+}
+
+TEST(suturo_perception_test, raster_clustering_test)
+{
+  // Two patches on the plane z = 1, 10cm apart
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  for (int x = 0; x < 20; x++)
+  {
+    for (int y = 0; y < 10; y++)
+    {
+      pcl::PointXYZRGB p;
+      p.x = x * 0.01f + (x >= 10 ? 0.1f : 0.0f);
+      p.y = y * 0.01f;
+      p.z = 1.0f;
+      cloud->points.push_back(p);
+    }
+  }
+  pcl::ModelCoefficients::Ptr plane (new pcl::ModelCoefficients);
+  plane->values.push_back(0);
+  plane->values.push_back(0);
+  plane->values.push_back(1);
+  plane->values.push_back(-1);
+
+  std::vector<pcl::PointIndices> clusters;
+  ASSERT_TRUE(suturo_perception_lib::RasterClustering::extract(cloud, plane, 0.03, 50, 1000, clusters));
+  ASSERT_EQ(2, clusters.size());
+  ASSERT_EQ(100, clusters[0].indices.size());
+  ASSERT_EQ(100, clusters[1].indices.size());
+  std::vector<int> all(clusters[0].indices);
+  all.insert(all.end(), clusters[1].indices.begin(), clusters[1].indices.end());
+  std::sort(all.begin(), all.end());
+  for (int i = 0; i < all.size(); i++)
+    ASSERT_EQ(i, all[i]);
+
+  // A raster over 1km x 1km is too big
+  cloud->points[0].x = 1000.0f;
+  cloud->points[0].y = 1000.0f;
+  ASSERT_FALSE(suturo_perception_lib::RasterClustering::extract(cloud, plane, 0.03, 50, 1000, clusters));
+}
+
+TEST(suturo_perception_test, footprint_labeling_test)
+{
+  // Table at z = 1 seen from the origin, with two boxes standing on it
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr projected (new pcl::PointCloud<pcl::PointXYZRGB>);
+  std::vector<pcl::PointIndices> clusters(2);
+  for (int box = 0; box < 2; box++)
+  {
+    for (int x = 0; x < 10; x++)
+    {
+      for (int y = 0; y < 10; y++)
+      {
+        pcl::PointXYZRGB p;
+        p.x = box * 0.3f + x * 0.01f;
+        p.y = y * 0.01f;
+        p.z = 1.0f;
+        clusters[box].indices.push_back(projected->points.size());
+        projected->points.push_back(p);
+      }
+    }
+  }
+  for (int x = -10; x < 50; x++)
+  {
+    for (int y = -10; y < 20; y++)
+    {
+      for (int z = 0; z < 10; z++)
+      {
+        pcl::PointXYZRGB p;
+        p.x = x * 0.0107f + 0.0031f;
+        p.y = y * 0.0107f + 0.0031f;
+        p.z = 1.0f - z * 0.07f;
+        cloud->points.push_back(p);
+      }
+    }
+  }
+  pcl::ModelCoefficients::Ptr plane (new pcl::ModelCoefficients);
+  plane->values.push_back(0);
+  plane->values.push_back(0);
+  plane->values.push_back(1);
+  plane->values.push_back(-1);
+
+  std::vector<pcl::PointIndices> objects;
+  ASSERT_TRUE(suturo_perception_lib::FootprintLabeling::extract(cloud, projected, clusters, plane, 0.03, 0.02, 0.5,
+        objects));
+  ASSERT_EQ(2, objects.size());
+
+  // Same points as a prism above every cluster
+  for (int box = 0; box < 2; box++)
+  {
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cluster (new pcl::PointCloud<pcl::PointXYZRGB>);
+    pcl::copyPointCloud(*projected, clusters[box], *cluster);
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_points (new pcl::PointCloud<pcl::PointXYZRGB>);
+    pcl::PointIndices::Ptr expected (new pcl::PointIndices);
+    suturo_perception_lib::PointCloudOperations::extractAllPointsAbovePointCloud(cloud, cluster, object_points,
+        expected, 2, 0.02, 0.5);
+    std::sort(expected->indices.begin(), expected->indices.end());
+    ASSERT_TRUE(expected->indices == objects[box].indices);
+  }
+}
+
+TEST(suturo_perception_test, convex_hull_test)
+{
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  if (pcl::io::loadPCDFile<pcl::PointXYZRGB> ("box1.pcd", *cloud) == -1)
+  {
+    FAIL() << "Couldn't read file box1.pcd";
+  }
+
+  pcl::PointCloud<pcl::PointXYZRGB> expected;
+  pcl::ConvexHull<pcl::PointXYZRGB> hull;
+  hull.setInputCloud(cloud);
+  hull.setDimension(3);
+  hull.setComputeAreaVolume(true);
+  hull.reconstruct(expected);
+
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr hull_points (new pcl::PointCloud<pcl::PointXYZRGB>);
+  double area, volume;
+  suturo_perception_utils::ThreadsafeHull::computeConvexHull(cloud, hull_points, 3, &area, &volume);
+
+  ASSERT_GT(hull_points->points.size(), 3);
+  ASSERT_NEAR(hull.getTotalArea(), area, hull.getTotalArea() * 1e-3);
+  ASSERT_NEAR(hull.getTotalVolume(), volume, hull.getTotalVolume() * 1e-3);
+
+  // A table top of 30 x 30 cm, that is only half a millimeter thick. Its faces meet
+  // at very acute angles, but every point has to stay inside of the hull
+  std::vector<Eigen::Vector3f> slab;
+  for (int i = 0; i < 30; i++)
+  {
+    for (int j = 0; j < 30; j++)
+    {
+      // Jitter the grid, so the points are in general position
+      float u = std::fmod(i * 0.618034f + j * 0.414214f, 1.0f);
+      float v = std::fmod(i * 0.302776f + j * 0.732051f, 1.0f);
+      float w = std::fmod(i * 0.236068f + j * 0.645751f, 1.0f);
+      slab.push_back(Eigen::Vector3f(1.0f + i * 0.01f + 0.009f * u, -1.0f + j * 0.01f + 0.009f * v, 2.0f + 0.0005f * w));
+    }
+  }
+  std::vector<int> vertices;
+  std::vector<suturo_perception_utils::QuickHull::Face> faces;
+  ASSERT_TRUE(suturo_perception_utils::QuickHull::compute3d(slab, vertices, faces, area, volume));
+  for (int f = 0; f < faces.size(); f++)
+  {
+    Eigen::Vector3d a = slab[faces[f].v[0]].cast<double>();
+    Eigen::Vector3d normal = (slab[faces[f].v[1]].cast<double>() - a).cross(slab[faces[f].v[2]].cast<double>() - a);
+    normal.normalize();
+    for (int i = 0; i < slab.size(); i++)
+      ASSERT_LE(normal.dot(slab[i].cast<double>() - a), 1e-7);
+  }
+  ASSERT_GT(volume, 0);
+  ASSERT_LE(volume, 0.3 * 0.3 * 0.0005);
+
+  // Without any thickness, the hull is the polygon of the table top
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr plane (new pcl::PointCloud<pcl::PointXYZRGB>);
+  pcl::PointXYZRGB p;
+  for (int i = 0; i < 30; i++)
+  {
+    for (int j = 0; j < 30; j++)
+    {
+      p.x = 1.0f + i * 0.01f; p.y = -1.0f + j * 0.01f; p.z = 2.0f;
+      plane->points.push_back(p);
+    }
+  }
+  suturo_perception_utils::ThreadsafeHull::computeConvexHull(plane, hull_points, 3, &area, &volume);
+  ASSERT_EQ(4, hull_points->points.size());
+  ASSERT_NEAR(0.29 * 0.29, area, 1e-5);
+  ASSERT_EQ(0, volume);
+}
+
+TEST(suturo_perception_test, perceived_object_freeze_test)
+{
+  suturo_perception_lib::PerceivedObject obj;
+  suturo_perception_lib::ROI roi;
+  roi.origin.x = 10;
+  roi.origin.y = 20;
+  roi.width = 30;
+  roi.height = 40;
+  obj.set_c_id(7);
+  obj.set_c_roi(roi);
+  obj.set_c_recognition_label_2d("muesli");
+  ASSERT_FALSE(obj.isFrozen());
+
+  // Copies of an object in the build phase can still be annotated
+  suturo_perception_lib::PerceivedObject copy = obj;
+  obj.freeze();
+  ASSERT_TRUE(obj.isFrozen());
+  ASSERT_FALSE(copy.isFrozen());
+  copy.set_c_id(8);
+
+  ASSERT_EQ(7, obj.get_c_id());
+  ASSERT_EQ(8, copy.get_c_id());
+  ASSERT_EQ(30, obj.get_c_roi().width);
+  ASSERT_EQ(40, obj.get_c_roi().height);
+  ASSERT_STREQ("muesli", obj.get_c_recognition_label_2d().c_str());
+  ASSERT_TRUE(obj.get_c_hue_histogram() == NULL);
+}
+
+TEST(suturo_perception_test, coarse_to_fine_plane_test)
+{
+  // Tilted plane z = 1 + 0.1x with a regular +-2mm ripple and a box on top of it
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  for (int x = -100; x < 100; x++)
+  {
+    for (int y = -100; y < 100; y++)
+    {
+      pcl::PointXYZRGB p;
+      p.x = x * 0.005f;
+      p.y = y * 0.005f;
+      p.z = 1.0f + 0.1f * p.x + ((x + y + 300) % 3 - 1) * 0.002f;
+      if (x >= 0 && x < 20 && y >= 0 && y < 20)
+        p.z -= 0.1f;
+      cloud->points.push_back(p);
+    }
+  }
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr downsampled (new pcl::PointCloud<pcl::PointXYZRGB>);
+  suturo_perception_lib::PointCloudOperations::downsample(cloud, downsampled, 0.01f);
+
+  pcl::PointIndices::Ptr inliers (new pcl::PointIndices);
+  pcl::PointIndices::Ptr full_inliers (new pcl::PointIndices);
+  pcl::ModelCoefficients::Ptr coefficients (new pcl::ModelCoefficients);
+  suturo_perception_lib::PointCloudOperations::fitPlanarModelCoarseToFine(downsampled, cloud, inliers, full_inliers,
+      coefficients, 1000, 0.01, 0.04f);
+
+  ASSERT_EQ(4, coefficients->values.size());
+  Eigen::Vector3f normal(coefficients->values[0], coefficients->values[1], coefficients->values[2]);
+  Eigen::Vector3f expected(-0.1f, 0.0f, 1.0f);
+  expected.normalize();
+  ASSERT_NEAR(1.0, fabs(normal.normalized().dot(expected)), 1e-5);
+  // Everything except the box is on the table
+  ASSERT_EQ(cloud->points.size() - 400, full_inliers->indices.size());
+  ASSERT_GT(inliers->indices.size(), 0);
+  ASSERT_LT(inliers->indices.size(), downsampled->points.size());
+}
+
+TEST(suturo_perception_test, frame_workspace_test)
+{
+  suturo_perception_lib::FrameWorkspace workspace;
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr held;
+  for (int frame = 0; frame < 3; frame++)
+  {
+    workspace.beginFrame();
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr big = workspace.acquireCloud(10000);
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr small = workspace.acquireCloud();
+    pcl::PointIndices::Ptr indices = workspace.acquireIndices();
+    ASSERT_EQ(0, big->points.size());
+    ASSERT_EQ(0, small->points.size());
+    ASSERT_EQ(0, indices->indices.size());
+    // A buffer, that is still in use, is never handed out again
+    ASSERT_TRUE(big != held);
+    ASSERT_TRUE(small != held);
+    big->points.resize(10000);
+    small->points.resize(100);
+    indices->indices.resize(500);
+    // Keep one cloud like a published result does
+    held = small;
+    workspace.endFrame();
+  }
+  // Once warm, the frames don't allocate anymore
+  ASSERT_EQ(0, workspace.getLastFrameAllocations());
+  ASSERT_EQ(100, held->points.size());
+  // The held cloud and the small cloud of the next frame take turns
+  ASSERT_EQ(4, workspace.getPoolSize());
+
+  workspace.clear();
+  ASSERT_EQ(1, workspace.getPoolSize());
+}
+
+TEST(suturo_perception_test, processing_region_test)
+{
+  // Organized 40x30 frame. The point of pixel (row, column) is at (column, row, 1) cm
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  cloud->width = 40;
+  cloud->height = 30;
+  cloud->points.resize(cloud->width * cloud->height);
+  for (int row = 0; row < cloud->height; row++)
+  {
+    for (int column = 0; column < cloud->width; column++)
+    {
+      pcl::PointXYZRGB &p = cloud->points[row * cloud->width + column];
+      p.x = column * 0.01f;
+      p.y = row * 0.01f;
+      p.z = 1.0f;
+    }
+  }
+
+  suturo_perception_lib::ProcessingRegion region;
+  suturo_perception_lib::ROI roi;
+  roi.origin.x = 30;
+  roi.origin.y = 5;
+  roi.width = 20; // clipped to the frame
+  roi.height = 10;
+  region.setPixels(roi);
+  // Only the columns up to 35 are inside of the box
+  region.setBox(Eigen::Vector3f(-1, -1, -1), Eigen::Vector3f(0.355f, 1, 2));
+
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr filtered (new pcl::PointCloud<pcl::PointXYZRGB>),
+                                      downsampled (new pcl::PointCloud<pcl::PointXYZRGB>);
+  std::vector<int> indices;
+  suturo_perception_lib::PointCloudOperations::filterAndDownsample(cloud, filtered, indices, downsampled,
+      0.0, 1.5, 0.01, region);
+  ASSERT_EQ(6 * 10, filtered->points.size());
+  ASSERT_EQ(filtered->points.size(), indices.size());
+  for (int i = 0; i < indices.size(); i++)
+  {
+    // The indices are still the ones of the full frame
+    int row = indices[i] / cloud->width;
+    int column = indices[i] % cloud->width;
+    ASSERT_GE(column, 30);
+    ASSERT_LE(column, 35);
+    ASSERT_GE(row, 5);
+    ASSERT_LT(row, 15);
+    ASSERT_EQ(cloud->points[indices[i]].x, filtered->points[i].x);
+  }
+
+  // The organized crop has the size of the clipped ROI
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cropped (new pcl::PointCloud<pcl::PointXYZRGB>);
+  suturo_perception_lib::PointCloudOperations::cropOrganized(cloud, region, 0.0, 1.5, cropped, indices);
+  ASSERT_EQ(10, cropped->width);
+  ASSERT_EQ(10, cropped->height);
+  ASSERT_EQ(100, indices.size());
+  ASSERT_EQ(5 * cloud->width + 30, indices[0]);
+  ASSERT_TRUE(pcl::isFinite(cropped->points[5]));
+  ASSERT_FALSE(pcl::isFinite(cropped->points[6]));
+}
+
+TEST(suturo_perception_test, scene_change_test)
+{
+  pcl::PointCloud<pcl::PointXYZRGB> frame;
+  frame.width = 64;
+  frame.height = 48;
+  frame.points.resize(frame.width * frame.height);
+  for (int i = 0; i < frame.points.size(); i++)
+  {
+    frame.points[i].x = (i % frame.width) * 0.01f;
+    frame.points[i].y = (i / frame.width) * 0.01f;
+    frame.points[i].z = 1.0f;
+    frame.points[i].rgba = 0x00808080;
+  }
+
+  suturo_perception_lib::SceneChangeDetector detector;
+  detector.setSampleStep(4);
+  detector.setDepthThreshold(0.01);
+  detector.setColorThreshold(24);
+  // Nothing to compare to
+  ASSERT_EQ(1.0f, detector.changedFraction(frame));
+  detector.acceptFrame();
+  ASSERT_EQ(0.0f, detector.changedFraction(frame));
+
+  // Sensor noise below the thresholds
+  pcl::PointCloud<pcl::PointXYZRGB> noisy = frame;
+  for (int i = 0; i < noisy.points.size(); i++)
+  {
+    noisy.points[i].z += (i % 2) ? 0.005f : -0.005f;
+    noisy.points[i].rgba = 0x00888078;
+  }
+  ASSERT_EQ(0.0f, detector.changedFraction(noisy));
+
+  // An object in the upper left 16x16 pixels. 16 of the 16x12 samples are in there
+  pcl::PointCloud<pcl::PointXYZRGB> moved = frame;
+  for (int row = 0; row < 16; row++)
+    for (int column = 0; column < 16; column++)
+      moved.points[row * moved.width + column].z = 0.9f;
+  ASSERT_FLOAT_EQ(16.0f / 192.0f, detector.changedFraction(moved));
+
+  // Pixels, that lost their depth, and color changes count as well
+  pcl::PointCloud<pcl::PointXYZRGB> changed = frame;
+  changed.points[0].z = std::numeric_limits<float>::quiet_NaN();
+  changed.points[4].rgba = 0x00ff8080;
+  ASSERT_FLOAT_EQ(2.0f / 192.0f, detector.changedFraction(changed));
+
+  // A frame of another size can't be compared
+  pcl::PointCloud<pcl::PointXYZRGB> other = frame;
+  other.width = 48;
+  other.height = 64;
+  ASSERT_EQ(1.0f, detector.changedFraction(other));
+}
+
+TEST(suturo_perception_test, support_surfaces_test)
+{
+  // A table at z = -0.5, a shelf board above it at z = -0.2 and a wall next to them
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  pcl::PointXYZRGB p;
+  for (int i = 0; i < 40; i++)
+  {
+    for (int j = 0; j < 40; j++)
+    {
+      p.x = i * 0.01f; p.y = j * 0.01f; p.z = -0.5f;
+      cloud->points.push_back(p);
+      if (j < 30)
+      {
+        p.z = -0.2f;
+        cloud->points.push_back(p);
+      }
+    }
+  }
+  for (int j = 0; j < 30; j++)
+  {
+    for (int k = 0; k < 20; k++)
+    {
+      p.x = 0.6f; p.y = j * 0.01f; p.z = -0.45f + k * 0.01f;
+      cloud->points.push_back(p);
+    }
+  }
+  // An object on the table
+  for (int i = 0; i < 5; i++)
+  {
+    for (int j = 0; j < 5; j++)
+    {
+      p.x = 0.1f + i * 0.01f; p.y = 0.1f + j * 0.01f; p.z = -0.4f;
+      cloud->points.push_back(p);
+    }
+  }
+  cloud->width = cloud->points.size();
+  cloud->height = 1;
+
+  std::vector<pcl::PointIndices> surfaces;
+  std::vector<pcl::ModelCoefficients::Ptr> coefficients;
+  pcl::PointIndices plane_points;
+  int count = suturo_perception_lib::PointCloudOperations::fitSupportSurfaces(cloud, 4, 500, 0.1745, 1000, 0.005,
+      0.02, surfaces, coefficients, plane_points);
+
+  // The wall is removed, but it is no support surface
+  ASSERT_EQ(2, count);
+  ASSERT_EQ(1600, surfaces[0].indices.size());
+  ASSERT_EQ(1200, surfaces[1].indices.size());
+  ASSERT_EQ(1600 + 1200 + 600, plane_points.indices.size());
+  // Without a prior, the normals point to the side of the sensor of the biggest plane
+  ASSERT_NEAR(1.0, coefficients[0]->values[2], 1e-3);
+  ASSERT_NEAR(0.5, coefficients[0]->values[3], 1e-3);
+  ASSERT_NEAR(1.0, coefficients[1]->values[2], 1e-3);
+  ASSERT_NEAR(0.2, coefficients[1]->values[3], 1e-3);
+}
+
+TEST(suturo_perception_test, support_surfaces_prior_test)
+{
+  // A shelf in front of a wall, that is bigger than the boards. The upper board
+  // at z = 0.3 is above the sensor and seen from below, the lower one at z = -0.3
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  pcl::PointXYZRGB p;
+  for (int i = 0; i < 40; i++)
+  {
+    for (int j = 0; j < 40; j++)
+    {
+      p.x = 0.5f + i * 0.01f; p.y = -0.2f + j * 0.01f; p.z = 0.3f;
+      cloud->points.push_back(p);
+      if (j < 30)
+      {
+        p.z = -0.3f;
+        cloud->points.push_back(p);
+      }
+    }
+  }
+  for (int j = 0; j < 80; j++)
+  {
+    for (int k = 0; k < 50; k++)
+    {
+      p.x = 1.0f; p.y = -0.4f + j * 0.01f; p.z = -0.25f + k * 0.01f;
+      cloud->points.push_back(p);
+    }
+  }
+  cloud->width = cloud->points.size();
+  cloud->height = 1;
+
+  std::vector<pcl::PointIndices> surfaces;
+  std::vector<pcl::ModelCoefficients::Ptr> coefficients;
+  pcl::PointIndices plane_points;
+  suturo_perception_lib::RansacOptions ransac;
+  // The up axis of the robot, a few degrees off
+  ransac.normal_prior = Eigen::Vector3f(0.02f, 0.03f, 1.0f);
+  int count = suturo_perception_lib::PointCloudOperations::fitSupportSurfaces(cloud, 4, 500, 0.1745, 1000, 0.005,
+      0.02, surfaces, coefficients, plane_points, ransac);
+
+  // Both boards, the wall is never removed
+  ASSERT_EQ(2, count);
+  ASSERT_EQ(1600, surfaces[0].indices.size());
+  ASSERT_EQ(1200, surfaces[1].indices.size());
+  ASSERT_EQ(1600 + 1200, plane_points.indices.size());
+  // Both normals point up, also the one of the board seen from below
+  ASSERT_NEAR(1.0, coefficients[0]->values[2], 1e-3);
+  ASSERT_NEAR(-0.3, coefficients[0]->values[3], 1e-3);
+  ASSERT_NEAR(1.0, coefficients[1]->values[2], 1e-3);
+  ASSERT_NEAR(0.3, coefficients[1]->values[3], 1e-3);
+}
+
+TEST(suturo_perception_test, metrics_registry_test)
+{
+  suturo_perception_utils::MetricsRegistry &registry = suturo_perception_utils::MetricsRegistry::instance();
+  registry.reset();
+
+  // Nothing is recorded while the registry is disabled
+  registry.setEnabled(false);
+  registry.recordTime("test/timer", 1.0);
+  registry.increment("test/counter");
+  {
+    suturo_perception_utils::ScopedTimer timer("test/scoped");
+  }
+  suturo_perception_utils::MetricsSnapshot snapshot = registry.snapshot();
+  ASSERT_TRUE(snapshot.timers.empty());
+  ASSERT_TRUE(snapshot.counters.empty());
+
+  registry.setEnabled(true);
+  registry.recordTime("test/timer", 0.05);
+  registry.recordTime("test/timer", 0.3);
+  registry.recordTime("test/timer", 0.3);
+  registry.recordTime("test/timer", 3.0);
+  registry.recordTime("test/timer", 7000.0);
+  registry.recordTime("test/single", 0.05);
+  boost::posix_time::ptime s = boost::posix_time::microsec_clock::local_time();
+  registry.recordTime("test/span", s, s + boost::posix_time::milliseconds(2));
+  registry.increment("test/counter");
+  registry.increment("test/counter", 4);
+  {
+    suturo_perception_utils::ScopedTimer timer("test/scoped");
+    timer.stop();
+    // Only the first stop is recorded, the destructor does nothing
+    timer.stop();
+  }
+  snapshot = registry.snapshot();
+
+  const suturo_perception_utils::TimerStats &timer = snapshot.timers["test/timer"];
+  ASSERT_EQ(5, timer.count);
+  ASSERT_NEAR(7003.65, timer.sum_ms, 1e-9);
+  ASSERT_NEAR(0.05, timer.min_ms, 1e-9);
+  ASSERT_NEAR(7000.0, timer.max_ms, 1e-9);
+  // Buckets up to 0.1, 0.25, 0.5, 1, 2.5, 5 ms ... and above 5000 ms
+  ASSERT_EQ((size_t) suturo_perception_utils::MetricsRegistry::BUCKETS, timer.bucket_counts.size());
+  ASSERT_EQ(1, timer.bucket_counts[0]);
+  ASSERT_EQ(0, timer.bucket_counts[1]);
+  ASSERT_EQ(2, timer.bucket_counts[2]);
+  ASSERT_EQ(1, timer.bucket_counts[5]);
+  ASSERT_EQ(1, timer.bucket_counts[suturo_perception_utils::MetricsRegistry::BUCKETS - 1]);
+  // Upper bound of the bucket, that holds the quantile. The last bucket is bounded by max_ms
+  ASSERT_NEAR(0.1, timer.quantile(0.2), 1e-9);
+  ASSERT_NEAR(0.5, timer.quantile(0.5), 1e-9);
+  ASSERT_NEAR(5.0, timer.quantile(0.8), 1e-9);
+  ASSERT_NEAR(7000.0, timer.quantile(1.0), 1e-9);
+  // A bucket bound above max_ms is capped
+  ASSERT_NEAR(0.05, snapshot.timers["test/single"].quantile(0.5), 1e-9);
+
+  ASSERT_EQ(1, snapshot.timers["test/span"].count);
+  ASSERT_NEAR(2.0, snapshot.timers["test/span"].sum_ms, 1e-9);
+  ASSERT_EQ(1, snapshot.timers["test/span"].bucket_counts[4]);
+  ASSERT_EQ(1, snapshot.timers["test/scoped"].count);
+  ASSERT_EQ(5, snapshot.counters["test/counter"]);
+
+  std::string json = snapshot.toJSON();
+  ASSERT_NE(std::string::npos, json.find("\"test/counter\": 5"));
+  ASSERT_NE(std::string::npos, json.find("\"test/timer\": {\"count\": 5, "));
+  ASSERT_NE(std::string::npos, json.find("\"buckets\": [1, 0, 2, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1]"));
+
+  // Disabling keeps the recorded metrics, reset drops them
+  registry.setEnabled(false);
+  registry.increment("test/counter");
+  ASSERT_EQ(5, registry.snapshot().counters["test/counter"]);
+  registry.reset();
+  ASSERT_TRUE(registry.snapshot().counters.empty());
+}
+
+TEST(suturo_perception_test, stage_cache_test)
+{
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  if (pcl::io::loadPCDFile<pcl::PointXYZRGB> ("box1.pcd", *cloud) == -1)
+    FAIL() << "Couldn't read file box1.pcd";
+
+  suturo_perception_lib::SuturoPerception sp;
+  // Nothing to reprocess without caching
+  sp.processCloudWithProjections(cloud);
+  ASSERT_FALSE(sp.reprocessLastFrame());
+
+  sp.setStageCaching(true);
+  sp.processCloudWithProjections(cloud);
+  suturo_perception_lib::SegmentationResult::ConstPtr first = sp.getLastResult();
+  ASSERT_EQ(1, first->objects.size());
+  ASSERT_TRUE(first->reused_stages.empty());
+
+  // Same parameters, everything is taken over
+  ASSERT_TRUE(sp.reprocessLastFrame());
+  suturo_perception_lib::SegmentationResult::ConstPtr same = sp.getLastResult();
+  ASSERT_EQ(9, same->reused_stages.size());
+  ASSERT_EQ(1, same->objects.size());
+  ASSERT_EQ(first->objects.at(0).get_c_id(), same->objects.at(0).get_c_id());
+  ASSERT_EQ(first->plane_cloud, same->plane_cloud);
+
+  // The prism only changes the stages from the prism on
+  sp.setPrismZMax(0.4);
+  ASSERT_TRUE(sp.reprocessLastFrame());
+  suturo_perception_lib::SegmentationResult::ConstPtr prism = sp.getLastResult();
+  ASSERT_EQ(4, prism->reused_stages.size());
+  ASSERT_EQ("table cluster", prism->reused_stages.back());
+  ASSERT_EQ(first->plane_cloud, prism->plane_cloud);
+  ASSERT_NE(first->objects_on_plane_cloud, prism->objects_on_plane_cloud);
+  ASSERT_EQ(1, prism->objects.size());
+  ASSERT_FLOAT_EQ(first->objects.at(0).get_c_volume(), prism->objects.at(0).get_c_volume());
+
+  // The z-filter changes everything
+  sp.setZAxisFilterMax(1.4);
+  ASSERT_TRUE(sp.reprocessLastFrame());
+  ASSERT_TRUE(sp.getLastResult()->reused_stages.empty());
+
+  // A new frame is processed completely
+  sp.processCloudWithProjections(cloud);
+  ASSERT_TRUE(sp.getLastResult()->reused_stages.empty());
+}
+
+TEST(suturo_perception_test, soa_cloud_test)
+{
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  if (pcl::io::loadPCDFile<pcl::PointXYZRGB> ("box1.pcd", *cloud) == -1)
+    FAIL() << "Couldn't read file box1.pcd";
+
+  suturo_perception_utils::SoACloud soa(*cloud);
+  ASSERT_EQ(cloud->points.size(), soa.size());
+  pcl::PointCloud<pcl::PointXYZRGB> converted;
+  soa.toPCL(converted);
+  ASSERT_EQ(cloud->width, converted.width);
+  ASSERT_EQ(cloud->height, converted.height);
+  for (int i = 0; i < cloud->points.size(); i += 97)
+  {
+    if (pcl::isFinite(cloud->points[i]))
+      ASSERT_EQ(cloud->points[i].z, converted.points[i].z);
+    ASSERT_EQ(cloud->points[i].rgba, converted.points[i].rgba);
+  }
+
+  // Same inliers of the table as the scoring on the PointXYZRGB cloud
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr nanles (new pcl::PointCloud<pcl::PointXYZRGB>);
+  suturo_perception_lib::PointCloudOperations::removeNans(cloud, nanles);
+  pcl::PointIndices::Ptr inliers (new pcl::PointIndices);
+  pcl::ModelCoefficients::Ptr coefficients (new pcl::ModelCoefficients);
+  suturo_perception_lib::PointCloudOperations::fitPlanarModel(nanles, inliers, coefficients, 1000, 0.01);
+  ASSERT_EQ(4, coefficients->values.size());
+  pcl::PointIndices::Ptr soa_inliers (new pcl::PointIndices);
+  suturo_perception_lib::PointCloudOperations::scorePlanarModel(cloud, coefficients, 0.01, inliers);
+  suturo_perception_lib::PointCloudOperations::scorePlanarModel(soa, coefficients, 0.01, soa_inliers);
+  ASSERT_GT(inliers->indices.size(), 0);
+  ASSERT_EQ(inliers->indices, soa_inliers->indices);
+
+  // NaN points are skipped like in pcl
+  Eigen::Vector4f pcl_min, pcl_max, soa_min, soa_max;
+  pcl::getMinMax3D(*cloud, pcl_min, pcl_max);
+  ASSERT_TRUE(soa.getMinMax3D(soa_min, soa_max));
+  for (int k = 0; k < 3; k++)
+  {
+    ASSERT_EQ(pcl_min[k], soa_min[k]);
+    ASSERT_EQ(pcl_max[k], soa_max[k]);
+  }
+  Eigen::Vector4f pcl_centroid, soa_centroid;
+  ASSERT_EQ(pcl::compute3DCentroid(*cloud, pcl_centroid), soa.compute3DCentroid(soa_centroid));
+  ASSERT_LT((pcl_centroid - soa_centroid).norm(), 1e-3);
+
+  // Projected points lie on the plane and keep their color
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr projected (new pcl::PointCloud<pcl::PointXYZRGB>);
+  suturo_perception_lib::PointCloudOperations::projectToPlaneCoefficients(cloud, inliers, coefficients, projected);
+  ASSERT_EQ(inliers->indices.size(), projected->points.size());
+  for (int i = 0; i < projected->points.size(); i++)
+  {
+    const pcl::PointXYZRGB &p = projected->points[i];
+    ASSERT_NEAR(0.0, coefficients->values[0] * p.x + coefficients->values[1] * p.y
+        + coefficients->values[2] * p.z + coefficients->values[3], 1e-5);
+    ASSERT_EQ(cloud->points[inliers->indices[i]].rgba, p.rgba);
+  }
+}
+
+TEST(suturo_perception_test, plane_ransac_test)
+{
+  ASSERT_EQ(70, suturo_perception_lib::PlaneRansac::requiredIterations(0.4, 0.99, 1000));
+  ASSERT_EQ(1000, suturo_perception_lib::PlaneRansac::requiredIterations(0.4, 1.0, 1000));
+  ASSERT_EQ(1000, suturo_perception_lib::PlaneRansac::requiredIterations(0.01, 0.99, 1000));
+
+  // Plane z = 1 + 0.1x with 40% of the points, the rest is spread between the plane and the sensor
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  for (int i = 0; i < 50000; i++)
+  {
+    pcl::PointXYZRGB p;
+    p.x = (i % 250) * 0.004f;
+    p.y = (i / 250) * 0.005f;
+    if (i % 5 < 2)
+      p.z = 1.0f + 0.1f * p.x;
+    else
+      p.z = 0.3f + ((i * 7919) % 1000) * 0.0006f;
+    cloud->points.push_back(p);
+  }
+
+  pcl::PointIndices single_inliers, parallel_inliers;
+  pcl::ModelCoefficients single_coefficients, parallel_coefficients;
+  suturo_perception_lib::RansacOptions options;
+  options.threads = 1;
+  suturo_perception_lib::PlaneRansac single(options);
+  ASSERT_EQ(20000, single.fit(cloud, 1000, 0.005, single_inliers, single_coefficients));
+  ASSERT_LE(single.getIterations(), 70 + suturo_perception_lib::PlaneRansac::BATCH_SIZE);
+  Eigen::Vector3f normal(single_coefficients.values[0], single_coefficients.values[1], single_coefficients.values[2]);
+  ASSERT_NEAR(1.0, fabs(normal.dot(Eigen::Vector3f(-0.1f, 0.0f, 1.0f).normalized())), 1e-4);
+
+  // The samples don't depend on the threads
+  options.threads = 4;
+  suturo_perception_lib::PlaneRansac parallel(options);
+  parallel.fit(cloud, 1000, 0.005, parallel_inliers, parallel_coefficients);
+  ASSERT_EQ(single.getIterations(), parallel.getIterations());
+  ASSERT_EQ(single_inliers.indices, parallel_inliers.indices);
+  ASSERT_EQ(single_coefficients.values, parallel_coefficients.values);
+
+  // Without adaptive termination all samples are drawn
+  options.confidence = 1.0;
+  suturo_perception_lib::PlaneRansac exhaustive(options);
+  exhaustive.fit(cloud, 1000, 0.005, parallel_inliers, parallel_coefficients);
+  ASSERT_EQ(1000, exhaustive.getIterations());
+  ASSERT_EQ(20000, parallel_inliers.indices.size());
+}
+
+TEST(suturo_perception_test, plane_normal_prior_test)
+{
+  ASSERT_EQ(16, suturo_perception_lib::PlaneRansac::requiredIterations(0.4, 0.8, 0.99, 1000));
+
+  // Table y = 0.5 with 30% of the points, objects on it and a wall z = 2 with 45% of the points
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+  for (int i = 0; i < 40000; i++)
+  {
+    pcl::PointXYZRGB p;
+    p.x = (i % 200) * 0.005f - 0.5f;
+    p.z = 0.8f + ((i * 7919) % 1000) * 0.0008f;
+    if (i % 20 < 6)
+      p.y = 0.5f;
+    else if (i % 20 < 15)
+    {
+      p.x = ((i * 7919) % 1000) * 0.002f - 1.0f;
+      p.y = (i % 150) * 0.01f - 1.0f;
+      p.z = 2.0f;
+    }
+    else
+      p.y = 0.2f + ((i * 104729) % 1000) * 0.0003f;
+    cloud->points.push_back(p);
+  }
+
+  pcl::PointIndices inliers;
+  pcl::ModelCoefficients coefficients;
+  suturo_perception_lib::RansacOptions options;
+  suturo_perception_lib::PlaneRansac unconstrained(options);
+  ASSERT_EQ(18000, unconstrained.fit(cloud, 1000, 0.005, inliers, coefficients));
+  ASSERT_NEAR(1.0, fabs(coefficients.values[2]), 1e-4);
+
+  // The up axis of the robot, a few degrees off
+  options.normal_prior = Eigen::Vector3f(0.05f, -1.0f, 0.05f);
+  options.normal_tolerance = 0.1745;
+  suturo_perception_lib::PlaneRansac constrained(options);
+  ASSERT_GE(constrained.fit(cloud, 1000, 0.005, inliers, coefficients), 12000);
+  ASSERT_NEAR(1.0, fabs(coefficients.values[1]), 1e-4);
+  for (int i = 0; i < inliers.indices.size(); i++)
+    ASSERT_NEAR(0.5f, cloud->points[inliers.indices[i]].y, 0.005f);
+}
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
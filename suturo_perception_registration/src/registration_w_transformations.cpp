@@ -16,6 +16,7 @@
 #include <pcl/io/pcd_io.h>
 #include <pcl/filters/voxel_grid.h>
 #include <publisher_helper.h>
+#include "point_cloud_operations.h"
 
 namespace po = boost::program_options;
 using namespace boost;
@@ -59,7 +60,15 @@ class RegistrationWithTransformations
       std::cout << "Cloud received @t=" << input->header.stamp;
       pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in (new pcl::PointCloud<pcl::PointXYZRGB>());
       pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out (new pcl::PointCloud<pcl::PointXYZRGB>());
-      pcl::fromROSMsg(*input,*cloud_in);
+      // Voxelize directly from the message buffer. This way only the finite
+      // points are copied and much less points have to be transformed
+      suturo_perception_lib::PointCloud2View view = suturo_perception_lib::PointCloud2View::fromMessage(*input);
+      if(!view.isValid())
+      {
+        ROS_ERROR("PointCloud2 has no float xyz fields or is big endian");
+        return;
+      }
+      suturo_perception_lib::PointCloudOperations::downsample(view, cloud_in, 0.04f);
       ros::Time inputTime = input->header.stamp;
       std::string frame_id = input->header.frame_id;
 
@@ -93,11 +102,8 @@ class RegistrationWithTransformations
 
         (*registered_cloud_) += (*cloud_out);
 
-        // Create the filtering object
-        pcl::VoxelGrid<pcl::PointXYZRGB> sor;
-        sor.setInputCloud (registered_cloud_);
-        sor.setLeafSize (0.04f, 0.04f, 0.04f);
-        sor.filter (*registered_cloud_);
+        // Voxelize the growing registered cloud in parallel
+        suturo_perception_lib::PointCloudOperations::downsample(registered_cloud_, registered_cloud_, 0.04f);
         ph_.publish_pointcloud("/suturo/registration/registered_cloud", registered_cloud_, frame_id_to_);
       }
       catch (tf::TransformException ex){
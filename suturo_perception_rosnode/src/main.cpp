@@ -75,6 +75,10 @@ int main (int argc, char** argv)
   ROS_INFO(" / ___/ / _/   / , _// /__   / _/   / ___/ / /    _/ /  / /_/ / /    / ");
   ROS_INFO("/_/    /___/  /_/|_| \\___/  /___/  /_/    /_/    /___/  \\____/ /_/|_/  ");
                                                                        
+  bool continuous = false;
+  if(ros::param::get("/suturo_perception/continuous", continuous) && continuous)
+    spr.startContinuousProcessing();
+
   // ROS_INFO("           suturo_perception READY");
   ros::MultiThreadedSpinner spinner(2);
   spinner.spin();
@@ -27,12 +27,11 @@ typedef pcl::PointCloud<pcl::PointXYZRGB>::Ptr rgb_pc_ptr;
 void receive_cloud(const sensor_msgs::PointCloud2ConstPtr& inputCloud)
 {
 
-  rgb_pc_ptr cloud_in (new pcl::PointCloud<pcl::PointXYZRGB>());
-  pcl::fromROSMsg(*inputCloud,*cloud_in);
-  ROS_INFO("Received a new point cloud: size = %lu",cloud_in->points.size());
-  sp.setOriginalCloud(cloud_in);
+  // Read the cloud directly from the message. No need to convert it first
+  suturo_perception_lib::PointCloud2View view = suturo_perception_lib::PointCloud2View::fromMessage(*inputCloud);
+  ROS_INFO("Received a new point cloud: size = %lu",view.size());
   sp.setEcMinClusterSize(5000);
-  sp.processCloudWithProjections(cloud_in);
+  sp.processCloudWithProjections(view);
   pcl::ModelCoefficients::Ptr table_coefficients = sp.getTableCoefficients();
   std::cout << "Estimated normal of the table: ";
   std::cout << table_coefficients->values.at(0) << " ";
@@ -161,6 +161,8 @@ std::vector<suturo_perception_msgs::PerceivedObject> SuturoPerceptionKnowledgeRO
   work.reset();
   ioService.run();
   threadpool.join_all();
+  for (int i = 0; i < perceivedObjects.size(); i++)
+    perceivedObjects[i].freeze();
 
   std::vector<suturo_perception_msgs::PerceivedObject> perceivedObjs = *convertPerceivedObjects(&perceivedObjects); // TODO handle images in this method
 
@@ -233,15 +235,18 @@ void SuturoPerceptionKnowledgeROSNode::reconfigureCallback(suturo_perception_ros
 std::vector<suturo_perception_msgs::PerceivedObject> *SuturoPerceptionKnowledgeROSNode::convertPerceivedObjects(std::vector<suturo_perception_lib::PerceivedObject, Eigen::aligned_allocator<suturo_perception_lib::PerceivedObject> > *objects)
 {
   std::vector<suturo_perception_msgs::PerceivedObject> *result = new std::vector<suturo_perception_msgs::PerceivedObject>();
+  result->reserve(objects->size());
   for (std::vector<suturo_perception_lib::PerceivedObject, Eigen::aligned_allocator<suturo_perception_lib::PerceivedObject> >::iterator it = objects->begin(); it != objects->end(); ++it)
   {
-    suturo_perception_msgs::PerceivedObject *msgObj = new suturo_perception_msgs::PerceivedObject();
+    result->push_back(suturo_perception_msgs::PerceivedObject());
+    suturo_perception_msgs::PerceivedObject *msgObj = &result->back();
     msgObj->c_id = it->get_c_id();
     msgObj->c_shape = it->get_c_shape();
     msgObj->c_volume = it->get_c_volume();
-    msgObj->c_centroid.x = it->get_c_centroid().x;
-    msgObj->c_centroid.y = it->get_c_centroid().y;
-    msgObj->c_centroid.z = it->get_c_centroid().z;
+    const suturo_perception_lib::Point &centroid = it->get_c_centroid();
+    msgObj->c_centroid.x = centroid.x;
+    msgObj->c_centroid.y = centroid.y;
+    msgObj->c_centroid.z = centroid.z;
     msgObj->frame_id = "";
     msgObj->c_color_average_r = it->get_c_color_average_r();
     msgObj->c_color_average_g = it->get_c_color_average_g();
@@ -252,15 +257,17 @@ std::vector<suturo_perception_msgs::PerceivedObject> *SuturoPerceptionKnowledgeR
     msgObj->c_color_average_qh = it->get_c_color_average_qh();
     msgObj->c_color_average_qs = it->get_c_color_average_qs();
     msgObj->c_color_average_qv = it->get_c_color_average_qv();
-    msgObj->c_roi_origin.x = it->get_c_roi().origin.x;
-    msgObj->c_roi_origin.y = it->get_c_roi().origin.y;
-    msgObj->c_roi_width = it->get_c_roi().width;
-    msgObj->c_roi_height = it->get_c_roi().height;
-    msgObj->c_hue_histogram = *it->get_c_hue_histogram();
+    const suturo_perception_lib::ROI &roi = it->get_c_roi();
+    msgObj->c_roi_origin.x = roi.origin.x;
+    msgObj->c_roi_origin.y = roi.origin.y;
+    msgObj->c_roi_width = roi.width;
+    msgObj->c_roi_height = roi.height;
+    if (it->get_c_hue_histogram() != NULL)
+      msgObj->c_hue_histogram = *it->get_c_hue_histogram();
     msgObj->c_hue_histogram_quality = it->get_c_hue_histogram_quality();
     msgObj->recognition_label_2d = it->get_c_recognition_label_2d();
   
-    Cuboid c = it->get_c_cuboid();
+    const Cuboid &c = it->get_c_cuboid();
     msgObj->matched_cuboid.length1  = c.length1;
     msgObj->matched_cuboid.length2  = c.length2;
     msgObj->matched_cuboid.length3  = c.length3;
@@ -273,17 +280,13 @@ std::vector<suturo_perception_msgs::PerceivedObject> *SuturoPerceptionKnowledgeR
     msgObj->matched_cuboid.pose.orientation.y   = c.orientation.z();
     msgObj->matched_cuboid.pose.orientation.w   = c.orientation.w();
 
-    for (int i = 0; i < 308; i++) 
-    {
-      msgObj->c_vfh_estimation.push_back(it->get_c_vfhs().histogram[i]);
-    }
+    const float *histogram = it->get_c_vfhs().histogram;
+    msgObj->c_vfh_estimation.assign(histogram, histogram + 308);
     msgObj->c_svm_result = ""; //svm_classification.classifyVFHSignature308(it->get_c_vfhs());
     msgObj->c_pose = 0; //svm_classification.classifyPoseVFHSignature308(it->get_c_vfhs(), msgObj->c_svm_result);
 
     // these are not set for now
     msgObj->recognition_label_3d = "";
-    
-    result->push_back(*msgObj);
   }
   return result;
 }
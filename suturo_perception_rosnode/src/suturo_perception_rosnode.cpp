@@ -6,6 +6,7 @@ const std::string SuturoPerceptionROSNode::COLLISION_CLOUD_TOPIC = "suturo/colli
 const std::string SuturoPerceptionROSNode::IMAGE_PREFIX_TOPIC= "/suturo/cluster_image/";
 const std::string SuturoPerceptionROSNode::CROPPED_IMAGE_PREFIX_TOPIC= "/suturo/cropped_cluster_image/";
 const std::string SuturoPerceptionROSNode::HISTOGRAM_PREFIX_TOPIC= "/suturo/cluster_histogram/";
+const std::string SuturoPerceptionROSNode::METRICS_TOPIC= "/suturo/perception_metrics";
 
 namespace enc = sensor_msgs::image_encodings;
 
@@ -24,6 +25,9 @@ SuturoPerceptionROSNode::SuturoPerceptionROSNode(ros::NodeHandle& n, std::string
   visualizationPublisher(n, fi)
 {
   logger = Logger("perception_rosnode");
+  // The z axis of this frame points up. Its direction in the camera frame is the prior of the table normal
+  ros::param::param<std::string>("/suturo_perception/support_frame", supportFrame, "/base_link");
+  planeNormalPrior = false;
   clusterService = nh.advertiseService("/suturo/GetClusters", 
     &SuturoPerceptionROSNode::getClusters, this);
   
@@ -53,6 +57,10 @@ SuturoPerceptionROSNode::SuturoPerceptionROSNode(ros::NodeHandle& n, std::string
     ph.advertise<sensor_msgs::Image>(HISTOGRAM_PREFIX_TOPIC + ss.str());
   }
 
+  // Snapshots of the metrics as JSON. The timer is started by the reconfigure callback
+  metricsPublisher = nh.advertise<std_msgs::String>(METRICS_TOPIC, 1);
+  metricsPublishPeriod = 0;
+
   // Initialize dynamic reconfigure
   reconfCb = boost::bind(&SuturoPerceptionROSNode::reconfigureCallback, this, _1, _2);
   reconfSrv.setCallback(reconfCb);
@@ -66,6 +74,11 @@ SuturoPerceptionROSNode::SuturoPerceptionROSNode(ros::NodeHandle& n, std::string
   numThreads = 8;
   callback_called = false;
   fallback_enabled = false;
+  processing = false;
+  continuous_ = false;
+  frame_available_ = false;
+  segmented_available_ = false;
+  continuous_caps_ = CapabilityFlags::defaults();
 
   // set default values for color_analysis if no reconfigure callback happens
   color_analysis_lower_s = 0.2;
@@ -74,6 +87,17 @@ SuturoPerceptionROSNode::SuturoPerceptionROSNode(ros::NodeHandle& n, std::string
   color_analysis_upper_v = 0.8;
 }
 
+SuturoPerceptionROSNode::~SuturoPerceptionROSNode()
+{
+  if(continuous_)
+  {
+    worker_.interrupt();
+    capability_worker_.interrupt();
+    worker_.join();
+    capability_worker_.join();
+  }
+}
+
 /*
  * Receive callback for the /camera/depth_registered/points subscription
  */
@@ -86,52 +110,100 @@ void SuturoPerceptionROSNode::receive_image_and_cloud(const sensor_msgs::ImageCo
   {
     logger.logInfo("Receiving cloud");
     logger.logInfo("processing...");
+    processFrame(inputImage, inputCloud);
+    processing = false;
+    logger.logInfo("Cloud processed. Lock buffer and return the results");      
+  }
+  callback_called = false;
+}
+
+/*
+ * Run the segmentation on a single frame.
+ * inputImage may be a NULL pointer, if only pointcloud data is available.
+ */
+void SuturoPerceptionROSNode::processFrame(const sensor_msgs::ImageConstPtr& inputImage, 
+                                           const sensor_msgs::PointCloud2ConstPtr& inputCloud)
+{
+  if(!fallback_enabled && inputImage)
+  {
+    cv_bridge::CvImagePtr cv_ptr;
+    cv_ptr = cv_bridge::toCvCopy(inputImage, enc::BGR8);
+
+    // Make a deep copy of the passed cv::Mat and set a new
+    // boost pointer to it.
+    boost::shared_ptr<cv::Mat> img(new cv::Mat(cv_ptr->image.clone()));
+    sp.setOriginalRGBImage(img);
+  }
+
+  if(planeNormalPrior)
+    sp.setPlaneNormalPrior(lookupSupportNormal(inputCloud->header));
+  else
+    sp.setPlaneNormalPrior(Eigen::Vector3f::Zero());
+
+  // Read organized clouds directly from the message buffer.
+  // Only the z-filtered cloud will be copied
+  suturo_perception_lib::PointCloud2View view = suturo_perception_lib::PointCloud2View::fromMessage(*inputCloud);
+  if(view.isValid() && view.isOrganized())
+  {
+    logger.logInfo((boost::format("Received a new point cloud: size = %s") % view.size()).str());
+    sp.processCloudWithProjections(view);
+  }
+  else
+  {
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_in (new pcl::PointCloud<pcl::PointXYZRGB>());
     pcl::fromROSMsg(*inputCloud,*cloud_in);
 
-		// Gazebo sends us unorganized pointclouds!
-		// Reorganize them to be able to compute the ROI of the objects
-		// This workaround is only tested for gazebo 1.9!
-		if(!cloud_in->isOrganized ())
-		{
-			logger.logInfo((boost::format("Received an unorganized PointCloud: %d x %d .Convert it to an organized one ...") % cloud_in->width % cloud_in->height ).str());
-
-			pcl::PointCloud<pcl::PointXYZRGB>::Ptr org_cloud (new pcl::PointCloud<pcl::PointXYZRGB>());
-			org_cloud->width = 640;
-			org_cloud->height = 480;
-			org_cloud->is_dense = false;
-			org_cloud->points.resize(640 * 480);
-
-			for (int i = 0; i < cloud_in->points.size(); i++) {
-					pcl::PointXYZRGB result;
-					result.x = 0;
-					result.y = 0;
-					result.z = 0;
-					org_cloud->points[i]=cloud_in->points[i];
-			}
-
-			cloud_in = org_cloud;
-		}
-    if(!fallback_enabled)
+    // Gazebo sends us unorganized pointclouds!
+    // Reorganize them to be able to compute the ROI of the objects
+    // This workaround is only tested for gazebo 1.9!
+    if(!cloud_in->isOrganized ())
     {
-      cv_bridge::CvImagePtr cv_ptr;
-      cv_ptr = cv_bridge::toCvCopy(inputImage, enc::BGR8);
+      logger.logInfo((boost::format("Received an unorganized PointCloud: %d x %d .Convert it to an organized one ...") % cloud_in->width % cloud_in->height ).str());
 
-      // Make a deep copy of the passed cv::Mat and set a new
-      // boost pointer to it.
-      boost::shared_ptr<cv::Mat> img(new cv::Mat(cv_ptr->image.clone()));
-      sp.setOriginalRGBImage(img);
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr org_cloud (new pcl::PointCloud<pcl::PointXYZRGB>());
+      org_cloud->width = 640;
+      org_cloud->height = 480;
+      org_cloud->is_dense = false;
+      org_cloud->points.resize(640 * 480);
+
+      for (int i = 0; i < cloud_in->points.size(); i++) {
+          pcl::PointXYZRGB result;
+          result.x = 0;
+          result.y = 0;
+          result.z = 0;
+          org_cloud->points[i]=cloud_in->points[i];
+      }
+
+      cloud_in = org_cloud;
     }
-    
-    std::stringstream ss;
-    ss << "Received a new point cloud: size = " << cloud_in->points.size();
+
     logger.logInfo((boost::format("Received a new point cloud: size = %s") % cloud_in->points.size()).str());
     sp.setOriginalCloud(cloud_in);
     sp.processCloudWithProjections(cloud_in);
-    processing = false;
-    logger.logInfo("Cloud processed. Lock buffer and return the results");      
   }
-  callback_called = false;
+}
+
+/*
+ * The up axis of the support frame in the frame of the cloud at the time of the cloud.
+ * Returns the zero vector, if the transform is not available, so the
+ * plane search falls back to every orientation.
+ */
+Eigen::Vector3f SuturoPerceptionROSNode::lookupSupportNormal(const std_msgs::Header &header)
+{
+  const std::string cloudFrame = header.frame_id.empty() ? frameId : header.frame_id;
+  tf::StampedTransform transform;
+  try
+  {
+    tfListener.waitForTransform(cloudFrame, supportFrame, header.stamp, ros::Duration(0.1));
+    tfListener.lookupTransform(cloudFrame, supportFrame, header.stamp, transform);
+  }
+  catch(tf::TransformException &ex)
+  {
+    logger.logWarn((boost::format("No table normal prior for this frame: %s") % ex.what()).str());
+    return Eigen::Vector3f::Zero();
+  }
+  tf::Vector3 up = transform.getBasis().getColumn(2);
+  return Eigen::Vector3f(up.x(), up.y(), up.z());
 }
 
 /*
@@ -148,162 +220,474 @@ void SuturoPerceptionROSNode::fallback_receive_cloud(const sensor_msgs::PointClo
 }
 
 /*
- * Implementation of the GetClusters Service.
- *
- * This method will subscribe to the /camera/depth_registered/points topic, 
- * wait for the processing of a single point cloud, and return the result from
- * the calulations as a list of PerceivedObjects.
+ * Start the continuous processing mode.
+ * The node will stay subscribed to the sensor topics and processes the newest
+ * frame over and over again. The segmentation and the capabilities are two
+ * stages on their own threads, so the next frame is segmented while the
+ * capabilities run on the last one. GetClusters calls will be answered
+ * with the latest finished result.
  */
-bool SuturoPerceptionROSNode::getClusters(suturo_perception_msgs::GetClusters::Request &req,
-  suturo_perception_msgs::GetClusters::Response &res)
+void SuturoPerceptionROSNode::startContinuousProcessing()
 {
-  boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+  if(continuous_)
+    return;
+  continuous_ = true;
+  logger.logInfo("Starting continuous processing");
 
-  processing = true;
+  cont_image_sub_.reset(new message_filters::Subscriber<sensor_msgs::Image>(nh, colorTopic, 1));
+  cont_pc_sub_.reset(new message_filters::Subscriber<sensor_msgs::PointCloud2>(nh, pointTopic, 1));
+  cont_sync_.reset(new message_filters::Synchronizer<SyncPolicy>(SyncPolicy(10), *cont_image_sub_, *cont_pc_sub_));
+  cont_sync_->registerCallback(boost::bind(&SuturoPerceptionROSNode::receive_frame, this, _1, _2));
 
-  bool process_color;
-  bool process_shape;
-  bool process_vfh;
-  bool process_cuboid;
-  bool process_2dlabel;
+  worker_ = boost::thread(boost::bind(&SuturoPerceptionROSNode::segmentationWorker, this));
+  capability_worker_ = boost::thread(boost::bind(&SuturoPerceptionROSNode::capabilityWorker, this));
+}
 
-  // signal failed call, if request string does not match
-  /*
-  if (req.s.compare("get") != 0)
-  {
-    return false;
-  }
-  */
-  std::vector<std::string> req_parts;
-  split(req_parts, req.s, boost::algorithm::is_any_of(",()"));
-  if (req_parts.size() < 1)
-  {
-    return false;
-  }
-  if (req_parts.at(0).compare("get") != 0)
+/*
+ * Frame callback for the continuous mode. Only the newest frame is kept,
+ * older frames that haven't been picked up by the worker are dropped.
+ */
+void SuturoPerceptionROSNode::receive_frame(const sensor_msgs::ImageConstPtr& inputImage, 
+                                            const sensor_msgs::PointCloud2ConstPtr& inputCloud)
+{
+  boost::lock_guard<boost::mutex> lock(frame_mutex_);
+  if(frame_available_)
+    MetricsRegistry::instance().increment("perception_rosnode/dropped_frames");
+  latest_image_ = inputImage;
+  latest_cloud_ = inputCloud;
+  latest_frame_time_ = ros::Time::now();
+  frame_available_ = true;
+  frame_cond_.notify_one();
+}
+
+/*
+ * Fallback for the continuous mode, if only pointcloud data is available.
+ */
+void SuturoPerceptionROSNode::receive_cloud_continuous(const sensor_msgs::PointCloud2ConstPtr& inputCloud)
+{
+  sensor_msgs::ImageConstPtr nullPtr; // boost::shared_ptr NullPtr
+  receive_frame(nullPtr, inputCloud);
+}
+
+/*
+ * Segmentation stage of the continuous mode.
+ * Segments the newest frame and hands it over to the capability stage.
+ * At most one segmented frame waits for the capabilities. The next frame is
+ * only taken, once that one has been picked up, so the segmentation never runs
+ * ahead of the capabilities and always starts on the newest frame.
+ */
+void SuturoPerceptionROSNode::segmentationWorker()
+{
+  try
   {
-    return false;
+    while(ros::ok())
+    {
+      {
+        boost::unique_lock<boost::mutex> lock(segmented_mutex_);
+        while(segmented_available_)
+          segmented_cond_.wait(lock);
+      }
+
+      sensor_msgs::ImageConstPtr image;
+      sensor_msgs::PointCloud2ConstPtr cloud;
+      ros::Time received;
+      {
+        boost::unique_lock<boost::mutex> lock(frame_mutex_);
+        // wait for a new frame. Fall back to pointclouds only, if nothing arrives within 10s
+        boost::system_time timeout = boost::get_system_time() + boost::posix_time::seconds(10);
+        while(!frame_available_)
+        {
+          if(!frame_cond_.timed_wait(lock, timeout))
+            break;
+        }
+        if(!frame_available_)
+        {
+          if(!fallback_enabled)
+          {
+            logger.logWarn("No color image received. Falling back to point clouds only.");
+            cont_image_sub_->unsubscribe();
+            cont_pc_sub_->unsubscribe();
+            sub_cloud = nh.subscribe(pointTopic, 1, 
+              &SuturoPerceptionROSNode::receive_cloud_continuous, this);
+            fallback_enabled = true;
+          }
+          continue;
+        }
+        image = latest_image_;
+        cloud = latest_cloud_;
+        received = latest_frame_time_;
+        frame_available_ = false;
+      }
+
+      mutex.lock();
+      processFrame(image, cloud);
+      SegmentedFrame segmented = lastSegmentedFrame(received);
+      mutex.unlock();
+
+      {
+        boost::lock_guard<boost::mutex> lock(segmented_mutex_);
+        segmented_frame_ = segmented;
+        segmented_available_ = true;
+      }
+      segmented_cond_.notify_all();
+    }
   }
-  if (req_parts.size() == 1)
+  catch(boost::thread_interrupted&)
   {
-    process_color = true;
-    process_shape = true;
-    process_vfh = false;
-    process_cuboid = true;
-    process_2dlabel = true;
+    logger.logInfo("Continuous segmentation stopped");
   }
-  else
+}
+
+/*
+ * Capability stage of the continuous mode.
+ * Runs the currently requested capabilities on the segmented frames,
+ * fills the back buffer and swaps it with the front snapshot.
+ */
+void SuturoPerceptionROSNode::capabilityWorker()
+{
+  boost::shared_ptr<PerceptionSnapshot> back_snapshot;
+  try
   {
-    process_color = false;
-    process_shape = false;
-    process_vfh = false;
-    process_cuboid = false;
-    process_2dlabel = false;
-    BOOST_FOREACH(std::string req_part, req_parts)
+    while(ros::ok())
     {
-      if (req_part.compare("color") == 0)
+      SegmentedFrame segmented;
       {
-        process_color = true;
+        boost::unique_lock<boost::mutex> lock(segmented_mutex_);
+        while(!segmented_available_)
+          segmented_cond_.wait(lock);
+        segmented = segmented_frame_;
+        segmented_frame_ = SegmentedFrame();
+        segmented_available_ = false;
       }
-      if (req_part.compare("shape") == 0)
+      // let the segmentation start on the next frame
+      segmented_cond_.notify_all();
+
+      CapabilityFlags caps;
       {
-        process_shape = true;
+        boost::lock_guard<boost::mutex> lock(snapshot_mutex_);
+        caps = continuous_caps_;
       }
-      if (req_part.compare("vfh") == 0)
+
+      back_snapshot.reset(new PerceptionSnapshot());
+      boost::shared_ptr<const PerceptionSnapshot> front;
       {
-        process_vfh = true;
+        boost::lock_guard<boost::mutex> lock(snapshot_mutex_);
+        front = front_snapshot_;
       }
-      if (req_part.compare("cuboid") == 0)
+      if(segmented.result->reused && front && front->capabilities.covers(caps))
       {
-        process_cuboid = true;
+        // Same objects as before. Only the stamp is new, the capabilities don't run again
+        *back_snapshot = *front;
+        back_snapshot->stamp = segmented.stamp;
+        back_snapshot->reused = true;
       }
-      if (req_part.compare("2dlabel") == 0)
+      else
       {
-        process_2dlabel = true;
+        buildSnapshot(segmented, caps, *back_snapshot);
       }
+
+      // swap the buffers and wake up waiting service calls
+      {
+        boost::lock_guard<boost::mutex> lock(snapshot_mutex_);
+        front_snapshot_.swap(back_snapshot);
+      }
+      snapshot_cond_.notify_all();
     }
   }
-  message_filters::Subscriber<sensor_msgs::Image> image_sub(nh, colorTopic, 1);
-  message_filters::Subscriber<sensor_msgs::PointCloud2> pc_sub(nh, pointTopic, 1);
-  typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::PointCloud2> MySyncPolicy;
-  message_filters::Synchronizer<MySyncPolicy> sync(MySyncPolicy(10), image_sub, pc_sub);
+  catch(boost::thread_interrupted&)
+  {
+    logger.logInfo("Continuous capabilities stopped");
+  }
+}
 
-  sync.registerCallback(boost::bind(&SuturoPerceptionROSNode::receive_image_and_cloud,this, _1, _2));
+/*
+ * Wait until the front snapshot has been computed with atleast the requested capabilities
+ * and its frame has been received not earlier than max_age seconds before
+ * the request. A negative max_age accepts every snapshot.
+ * Returns false, if no such snapshot is available within 10s.
+ */
+bool SuturoPerceptionROSNode::waitForSnapshot(const CapabilityFlags &caps, double max_age,
+    boost::shared_ptr<const PerceptionSnapshot> &snapshot)
+{
+  ros::Time request_time = ros::Time::now();
+  ros::Time cancel_time = request_time + ros::Duration(10);
 
-  logger.logInfo("Waiting for processed cloud");
-  ros::Rate r(20); // 20 hz
-  // cancel service call, if no cloud is received after 10s
-  boost::posix_time::ptime cancelTime = boost::posix_time::second_clock::local_time() + boost::posix_time::seconds(10);
-  while(processing)
+  boost::unique_lock<boost::mutex> lock(snapshot_mutex_);
+  // let the worker compute the requested capabilities from now on
+  continuous_caps_.merge(caps);
+  while(ros::ok())
   {
-    if(boost::posix_time::second_clock::local_time() >= cancelTime && !callback_called)
+    snapshot = front_snapshot_;
+    if(snapshot && snapshot->capabilities.covers(caps) &&
+        (max_age < 0 || snapshot->stamp >= request_time - ros::Duration(max_age)))
+      return true;
+
+    if(ros::Time::now() >= cancel_time)
+      return false;
+    snapshot_cond_.timed_wait(lock, boost::posix_time::milliseconds(100));
+  }
+  return false;
+}
+
+/*
+ * Parse the request string of a GetClusters call.
+ * "get" selects the default capabilities, "get,color,shape" only the listed ones.
+ * "maxage(x)" sets the maximum age in seconds of a result in the continuous mode.
+ * Requests, that don't start with "get", fail. Unknown capabilities are skipped with a warning.
+ */
+bool SuturoPerceptionROSNode::parseRequest(const std::string &request, CapabilityFlags &caps, double &max_age)
+{
+  std::vector<std::string> req_parts;
+  split(req_parts, request, boost::algorithm::is_any_of(",()"));
+  // signal failed call, if request string does not match
+  if (req_parts.size() < 1 || req_parts.at(0).compare("get") != 0)
+    return false;
+
+  max_age = -1;
+  bool caps_given = false;
+  caps = CapabilityFlags();
+  for (int i = 1; i < req_parts.size(); i++)
+  {
+    const std::string &req_part = req_parts.at(i);
+    if (req_part.compare("maxage") == 0 && i + 1 < req_parts.size())
     {
-      processing = false;
-      // register normal callback just for the cloud topic and retry, if no color data is available
-      if(!fallback_enabled)
+      try
       {
-        processing = true;
-        logger.logWarn("No color image received. Falling back to point clouds only.");
-        image_sub.unsubscribe();
-        pc_sub.unsubscribe();
-        sub_cloud = nh.subscribe(pointTopic, 1, 
-          &SuturoPerceptionROSNode::fallback_receive_cloud, this);
-        fallback_enabled = true;
-        cancelTime = boost::posix_time::second_clock::local_time() + boost::posix_time::seconds(10);
+        max_age = boost::lexical_cast<double>(req_parts.at(i + 1));
       }
-      else // fallback failed as well. no data available. Abort service call.
+      catch(boost::bad_lexical_cast &)
       {
-        logger.logError("No sensor data available. Aborting.");
+        logger.logError((boost::format("Invalid maxage in request: %s") % req_parts.at(i + 1)).str());
         return false;
       }
-    } 
-    ros::spinOnce();
-    r.sleep();
+      i++;
+      continue;
+    }
+    if (req_part.empty()) // e.g. behind the closing bracket of get(color)
+      continue;
+    if (req_part.compare("color") == 0)
+      caps.color = caps_given = true;
+    else if (req_part.compare("shape") == 0)
+      caps.shape = caps_given = true;
+    else if (req_part.compare("vfh") == 0)
+      caps.vfh = caps_given = true;
+    else if (req_part.compare("cuboid") == 0)
+      caps.cuboid = caps_given = true;
+    else if (req_part.compare("2dlabel") == 0)
+      caps.label2d = caps_given = true;
+    else
+      logger.logWarn((boost::format("Skipping unknown capability in request: %s") % req_part).str());
   }
+  if (!caps_given)
+    caps = CapabilityFlags::defaults();
+  return true;
+}
 
-  std::vector<cv::Mat> perceived_cluster_images;
+/*
+ * Implementation of the GetClusters Service.
+ *
+ * This method will subscribe to the /camera/depth_registered/points topic, 
+ * wait for the processing of a single point cloud, and return the result from
+ * the calulations as a list of PerceivedObjects.
+ * In the continuous mode, the latest result of the background worker will be returned.
+ */
+bool SuturoPerceptionROSNode::getClusters(suturo_perception_msgs::GetClusters::Request &req,
+  suturo_perception_msgs::GetClusters::Response &res)
+{
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
 
-  mutex.lock();
-  perceivedObjects = sp.getPerceivedObjects();
-  perceived_cluster_images = sp.getPerceivedClusterImages();
+  CapabilityFlags caps;
+  double max_age;
+  if (!parseRequest(req.s, caps, max_age))
+  {
+    return false;
+  }
 
-  // If the image dimension is bigger then
-  // the dimension of the pointcloud, we have to adjust the ROI of every
-  // perceived object
-  if (sp.getOriginalRGBImage() != NULL)
+  boost::shared_ptr<const PerceptionSnapshot> snapshot;
+  if(continuous_)
   {
-    if(sp.getOriginalRGBImage()->cols != sp.getOriginalCloud()->width
-        && sp.getOriginalRGBImage()->rows != sp.getOriginalCloud()->height)
+    if(!waitForSnapshot(caps, max_age, snapshot))
     {
-      // std::cout << "Image dimensions differ from PC dimensions: ";
-      // std::cout << "Image " <<  sp.getOriginalRGBImage()->cols << "x" << sp.getOriginalRGBImage()->rows;
-      // std::cout << "vs. Cloud " <<  sp.getOriginalCloud()->width << "x" << sp.getOriginalCloud()->height << std::endl;
-
-      // Adjust the ROI if the image is at 1280x1024 and the pointcloud is at 640x480
-      // Adjust the ROI if the image is at 1280x960 and the pointcloud is at 640x480 (Gazebo Mode)
-      if( (sp.getOriginalRGBImage()->cols == 1280 && sp.getOriginalRGBImage()->rows == 1024) ||
-      (sp.getOriginalRGBImage()->cols == 1280 && sp.getOriginalRGBImage()->rows == 960) )
+      logger.logError("No result of the continuous processing available. Aborting.");
+      return false;
+    }
+    logger.logInfo((boost::format("Returning result of a frame received %s s ago%s")
+          % (ros::Time::now() - snapshot->stamp).toSec()
+          % (snapshot->reused ? " (unchanged frame, reused segmentation)" : "")).str());
+  }
+  else
+  {
+    processing = true;
+
+    message_filters::Subscriber<sensor_msgs::Image> image_sub(nh, colorTopic, 1);
+    message_filters::Subscriber<sensor_msgs::PointCloud2> pc_sub(nh, pointTopic, 1);
+    message_filters::Synchronizer<SyncPolicy> sync(SyncPolicy(10), image_sub, pc_sub);
+
+    sync.registerCallback(boost::bind(&SuturoPerceptionROSNode::receive_image_and_cloud,this, _1, _2));
+
+    logger.logInfo("Waiting for processed cloud");
+    ros::Rate r(20); // 20 hz
+    // cancel service call, if no cloud is received after 10s
+    boost::posix_time::ptime cancelTime = boost::posix_time::second_clock::local_time() + boost::posix_time::seconds(10);
+    while(processing)
+    {
+      if(boost::posix_time::second_clock::local_time() >= cancelTime && !callback_called)
       {
-        for (int i = 0; i < perceivedObjects.size(); i++) {
-            ROI roi = perceivedObjects.at(i).get_c_roi();
-            roi.origin.x*=2;
-            roi.origin.y*=2;
-            roi.width*=2;
-            roi.height*=2;
-            perceivedObjects.at(i).set_c_roi(roi);
+        processing = false;
+        // register normal callback just for the cloud topic and retry, if no color data is available
+        if(!fallback_enabled)
+        {
+          processing = true;
+          logger.logWarn("No color image received. Falling back to point clouds only.");
+          image_sub.unsubscribe();
+          pc_sub.unsubscribe();
+          sub_cloud = nh.subscribe(pointTopic, 1, 
+            &SuturoPerceptionROSNode::fallback_receive_cloud, this);
+          fallback_enabled = true;
+          cancelTime = boost::posix_time::second_clock::local_time() + boost::posix_time::seconds(10);
         }
-      }
+        else // fallback failed as well. no data available. Abort service call.
+        {
+          logger.logError("No sensor data available. Aborting.");
+          return false;
+        }
+      } 
+      ros::spinOnce();
+      r.sleep();
+    }
+
+    boost::shared_ptr<PerceptionSnapshot> result(new PerceptionSnapshot());
+    mutex.lock();
+    buildSnapshot(lastSegmentedFrame(ros::Time::now()), caps, *result);
+    mutex.unlock();
+    snapshot = result;
+
+    logger.logInfo("Shutting down subscriber");
+    image_sub.unsubscribe(); // shutdown subscriber, to mitigate funky behavior
+    pc_sub.unsubscribe(); // shutdown subscriber, to mitigate funky behavior
+    // sync.shutdown();
+  }
+
+  res.perceivedObjs = snapshot->objects;
+  publishSnapshot(*snapshot);
+
+  boost::posix_time::ptime end = boost::posix_time::microsec_clock::local_time();
+  MetricsRegistry::instance().recordTime("perception_rosnode/getClusters", start, end);
+
+  visualizationPublisher.publishMarkers(res.perceivedObjs);
+  visualizationPublisher.publishCuboids(res.perceivedObjs);
+
+  logger.logInfo("Service call finished. return");
+  return true;
+}
+
+SegmentedFrame SuturoPerceptionROSNode::lastSegmentedFrame(ros::Time stamp)
+{
+  SegmentedFrame frame;
+  frame.stamp = stamp;
+  frame.result = sp.getLastResult();
+  frame.image = sp.getOriginalRGBImage();
+  frame.fallback = fallback_enabled;
+  return frame;
+}
+
+/*
+ * Run the capabilities on a segmented frame and collect everything
+ * that is needed to answer and publish a GetClusters call.
+ * Only reads the frame, so it doesn't need the node mutex. The capabilities
+ * share the object matcher and the color analysis thresholds, so only one
+ * snapshot is built at a time (capability worker, service calls and the
+ * reprocessing after a reconfiguration).
+ */
+void SuturoPerceptionROSNode::buildSnapshot(const SegmentedFrame &frame, const CapabilityFlags &caps,
+    PerceptionSnapshot &snapshot)
+{
+  snapshot.stamp = frame.stamp;
+  snapshot.capabilities = caps;
+
+  // All parts of the snapshot come from the same segmentation result.
+  // The objects are copied, because the capabilities annotate them
+  suturo_perception_lib::SegmentationResult::ConstPtr result = frame.result;
+  snapshot.reused = result->reused;
+  std::vector<suturo_perception_lib::PerceivedObject, Eigen::aligned_allocator<suturo_perception_lib::PerceivedObject> > perceivedObjects = result->objects;
+  snapshot.cluster_images = result->cluster_images;
+
+  adjustROIs(perceivedObjects, frame);
+  {
+    boost::lock_guard<boost::mutex> lock(capability_mutex_);
+    runCapabilities(perceivedObjects, frame, caps);
+  }
+  // The objects are complete now and only read from here on
+  for (int i = 0; i < perceivedObjects.size(); i++)
+    perceivedObjects[i].freeze();
+
+  std::vector<suturo_perception_msgs::PerceivedObject> *converted = convertPerceivedObjects(&perceivedObjects); // TODO handle images in this method
+  snapshot.objects = *converted;
+  delete converted;
+
+  snapshot.plane_cloud = result->plane_cloud;
+  snapshot.objects_cloud = result->objects_on_plane_cloud;
+
+  if (caps.color)
+  {
+    for (int i = 0; i < perceivedObjects.size(); i++)
+    {
+      if (perceivedObjects.at(i).get_c_hue_histogram_image() != NULL)
+        snapshot.histogram_images.push_back(*(perceivedObjects.at(i).get_c_hue_histogram_image()));
       else
-      {
-        logger.logError("UNSUPPORTED MIXTURE OF IMAGE AND POINTCLOUD DIMENSIONS");
+        snapshot.histogram_images.push_back(cv::Mat());
+    }
+  }
+}
+
+/*
+ * If the image dimension is bigger then
+ * the dimension of the pointcloud, we have to adjust the ROI of every
+ * perceived object
+ */
+void SuturoPerceptionROSNode::adjustROIs(std::vector<suturo_perception_lib::PerceivedObject, Eigen::aligned_allocator<suturo_perception_lib::PerceivedObject> > &objects,
+    const SegmentedFrame &frame)
+{
+  if (frame.image == NULL)
+    return;
+
+  if(frame.image->cols != frame.result->frame_width
+      && frame.image->rows != frame.result->frame_height)
+  {
+    // std::cout << "Image dimensions differ from PC dimensions: ";
+    // std::cout << "Image " <<  sp.getOriginalRGBImage()->cols << "x" << sp.getOriginalRGBImage()->rows;
+    // std::cout << "vs. Cloud " <<  sp.getOriginalCloud()->width << "x" << sp.getOriginalCloud()->height << std::endl;
+
+    // Adjust the ROI if the image is at 1280x1024 and the pointcloud is at 640x480
+    // Adjust the ROI if the image is at 1280x960 and the pointcloud is at 640x480 (Gazebo Mode)
+    if( (frame.image->cols == 1280 && frame.image->rows == 1024) ||
+    (frame.image->cols == 1280 && frame.image->rows == 960) )
+    {
+      for (int i = 0; i < objects.size(); i++) {
+          ROI roi = objects.at(i).get_c_roi();
+          roi.origin.x*=2;
+          roi.origin.y*=2;
+          roi.width*=2;
+          roi.height*=2;
+          objects.at(i).set_c_roi(roi);
       }
     }
+    else
+    {
+      logger.logError("UNSUPPORTED MIXTURE OF IMAGE AND POINTCLOUD DIMENSIONS");
+    }
   }
-  
-  // Execution pipeline
-  // Each capability provides an enrichment for the
-  // returned PerceivedObject
+}
 
+/*
+ * Execution pipeline
+ * Each capability provides an enrichment for the
+ * returned PerceivedObject
+ */
+void SuturoPerceptionROSNode::runCapabilities(std::vector<suturo_perception_lib::PerceivedObject, Eigen::aligned_allocator<suturo_perception_lib::PerceivedObject> > &objects,
+    const SegmentedFrame &frame, const CapabilityFlags &caps)
+{
+  ScopedTimer timer("perception_rosnode/runCapabilities");
   // initialize threadpool
   boost::asio::io_service ioService;
   boost::thread_group threadpool;
@@ -318,56 +702,61 @@ bool SuturoPerceptionROSNode::getClusters(suturo_perception_msgs::GetClusters::R
       );
   }
 
-  for (int i = 0; i < perceivedObjects.size(); i++) 
+  for (int i = 0; i < objects.size(); i++) 
   {
     // Initialize Capabilities
-    ColorAnalysis ca(perceivedObjects[i]);
+    ColorAnalysis ca(objects[i]);
     ca.setLowerSThreshold(color_analysis_lower_s);
     ca.setUpperSThreshold(color_analysis_upper_s);
     ca.setLowerVThreshold(color_analysis_lower_v);
     ca.setUpperVThreshold(color_analysis_upper_v);
-    suturo_perception_shape_detection::RandomSampleConsensus sd(perceivedObjects[i]);
-    suturo_perception_vfh_estimation::VFHEstimation vfhe(perceivedObjects[i]);
-    // suturo_perception_3d_capabilities::CuboidMatcherAnnotator cma(perceivedObjects[i]);
-    // Init the cuboid matcher with the table coefficients
-    suturo_perception_3d_capabilities::CuboidMatcherAnnotator cma(perceivedObjects[i], sp.getTableCoefficients() );
+    suturo_perception_shape_detection::RandomSampleConsensus sd(objects[i]);
+    suturo_perception_vfh_estimation::VFHEstimation vfhe(objects[i]);
+    // suturo_perception_3d_capabilities::CuboidMatcherAnnotator cma(objects[i]);
+    // Init the cuboid matcher with the coefficients of the surface, that the object stands on
+    const std::vector<pcl::ModelCoefficients::Ptr> &surface_coefficients = frame.result->surface_coefficients;
+    pcl::ModelCoefficients::Ptr support_surface = frame.result->table_coefficients;
+    int surface_id = objects[i].get_c_support_surface_id();
+    if (surface_id >= 0 && surface_id < surface_coefficients.size())
+      support_surface = surface_coefficients[surface_id];
+    suturo_perception_3d_capabilities::CuboidMatcherAnnotator cma(objects[i], support_surface);
 
     // post work to threadpool
-    if (process_color)
+    if (caps.color)
     {
       ioService.post(boost::bind(&ColorAnalysis::execute, ca));
     }
-    if (process_shape)
+    if (caps.shape)
     {
       ioService.post(boost::bind(&suturo_perception_shape_detection::RandomSampleConsensus::execute, sd));
     }
-    if (process_vfh)
+    if (caps.vfh)
     {
       ioService.post(boost::bind(&suturo_perception_vfh_estimation::VFHEstimation::execute, vfhe));
     }
-    if (process_cuboid)
+    if (caps.cuboid)
     {
       ioService.post(boost::bind(&suturo_perception_3d_capabilities::CuboidMatcherAnnotator::execute, cma, true));
     }
 
     // Is 2d recognition enabled?
-    if(!recognitionDir.empty() && !fallback_enabled && process_2dlabel)
+    if(!recognitionDir.empty() && !frame.fallback && caps.label2d)
     {
-      // perceivedObjects[i].c_recognition_label_2d="";
-      suturo_perception_2d_capabilities::LabelAnnotator2D la(perceivedObjects[i], sp.getOriginalRGBImage(), object_matcher_);
+      // objects[i].c_recognition_label_2d="";
+      suturo_perception_2d_capabilities::LabelAnnotator2D la(objects[i], frame.image, object_matcher_);
       la.execute();
     }
     else
     {
       // Set an empty label
-      perceivedObjects[i].set_c_recognition_label_2d("");
+      objects[i].set_c_recognition_label_2d("");
     }
 
     // Publish the ROI-cropped images
-    if(!fallback_enabled)
+    if(!frame.fallback)
     {
       suturo_perception_2d_capabilities::ROIPublisher 
-        rp(perceivedObjects.at(i), ph,sp.getOriginalRGBImage(),frameId);
+        rp(objects.at(i), ph,frame.image,frameId);
       std::stringstream ss;
       ss << i;
       rp.setTopicName(CROPPED_IMAGE_PREFIX_TOPIC + ss.str());
@@ -380,55 +769,50 @@ bool SuturoPerceptionROSNode::getClusters(suturo_perception_msgs::GetClusters::R
   work.reset();
   ioService.run();
   threadpool.join_all();
+}
 
-  res.perceivedObjs = *convertPerceivedObjects(&perceivedObjects); // TODO handle images in this method
-
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr plane_cloud_publish = sp.getPlaneCloud();
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_cloud_publish = sp.getObjectsOnPlaneCloud();
-
-	ph.publish_pointcloud(TABLE_PLANE_TOPIC,plane_cloud_publish, frameId);
-	ph.publish_pointcloud(ALL_OBJECTS_ON_PLANE_TOPIC,object_cloud_publish, frameId);
-  logger.logInfo((boost::format(" Extracted images vector: %s vs. Extracted PointCloud Vector: %s") % perceived_cluster_images.size() % perceivedObjects.size()).str());
+/*
+ * Publish the clouds and images of a result
+ */
+void SuturoPerceptionROSNode::publishSnapshot(const PerceptionSnapshot &snapshot)
+{
+	ph.publish_pointcloud(TABLE_PLANE_TOPIC, snapshot.plane_cloud, frameId);
+	ph.publish_pointcloud(ALL_OBJECTS_ON_PLANE_TOPIC, snapshot.objects_cloud, frameId);
+  logger.logInfo((boost::format(" Extracted images vector: %s vs. Extracted PointCloud Vector: %s") % snapshot.cluster_images.size() % snapshot.objects.size()).str());
 
   // Publish the images of the clusters
-  for(int i = 0; i < perceived_cluster_images.size(); i++)
+  for(int i = 0; i < snapshot.cluster_images.size(); i++)
   {
     if (i > 6)
       continue;
     std::stringstream ss;
     ss << i;
-    ph.publish_cv_mat(IMAGE_PREFIX_TOPIC + ss.str() , perceived_cluster_images.at(i), frameId);
+    ph.publish_cv_mat(IMAGE_PREFIX_TOPIC + ss.str() , snapshot.cluster_images.at(i), frameId);
 
   }
 
   // publish histograms
-  if (process_color)
+  for (int i = 0; i < snapshot.histogram_images.size(); i++)
   {
-    for (int i = 0; i < perceivedObjects.size(); i++)
+    if (i <= 6 && !snapshot.histogram_images.at(i).empty())
     {
-      if (i <= 6 && perceivedObjects.at(i).get_c_hue_histogram_image() != NULL)
-      {
-        std::stringstream ss;
-        ss << i;
-        ph.publish_cv_mat(HISTOGRAM_PREFIX_TOPIC + ss.str(), *(perceivedObjects.at(i).get_c_hue_histogram_image()), frameId);
-      }
+      std::stringstream ss;
+      ss << i;
+      ph.publish_cv_mat(HISTOGRAM_PREFIX_TOPIC + ss.str(), snapshot.histogram_images.at(i), frameId);
     }
   }
+}
 
-  mutex.unlock();
-
-  boost::posix_time::ptime end = boost::posix_time::microsec_clock::local_time();
-  logger.logTime(start, end, "TOTAL");
-
-  logger.logInfo("Shutting down subscriber");
-  image_sub.unsubscribe(); // shutdown subscriber, to mitigate funky behavior
-  pc_sub.unsubscribe(); // shutdown subscriber, to mitigate funky behavior
-  // sync.shutdown();
-  visualizationPublisher.publishMarkers(res.perceivedObjs);
-  visualizationPublisher.publishCuboids(res.perceivedObjs);
-
-  logger.logInfo("Service call finished. return");
-  return true;
+/*
+ * Publish a snapshot of all timings and counters as JSON.
+ */
+void SuturoPerceptionROSNode::publishMetrics(const ros::TimerEvent &event)
+{
+  if(metricsPublisher.getNumSubscribers() == 0)
+    return;
+  std_msgs::String msg;
+  msg.data = MetricsRegistry::instance().snapshot().toJSON();
+  metricsPublisher.publish(msg);
 }
 
 std::string SuturoPerceptionROSNode::arff_header()
@@ -506,6 +890,8 @@ void SuturoPerceptionROSNode::reconfigureCallback(suturo_perception_rosnode::Sut
             "segmenter: downsampleLeafSize: %f \n"
             "segmenter: planeMaxIterations: %i \n"
             "segmenter: planeDistanceThreshold: %f \n"
+            "segmenter: planeTracking: %i \n"
+            "segmenter: planeTrackingMinInlierRatio: %f \n"
             "segmenter: ecClusterTolerance: %f \n"
             "segmenter: ecMinClusterSize: %i \n"
             "segmenter: ecMaxClusterSize: %i \n"
@@ -514,27 +900,70 @@ void SuturoPerceptionROSNode::reconfigureCallback(suturo_perception_rosnode::Sut
             "segmenter: ecObjClusterTolerance: %f \n"
             "segmenter: ecObjMinClusterSize: %i \n"
             "segmenter: ecObjMaxClusterSize: %i \n"
+            "segmenter: organizedSegmentation: %i \n"
+            "segmenter: organizedPlaneMinInliers: %i \n"
+            "segmenter: organizedPlaneAngularThreshold: %f \n"
+            "segmenter: rasterObjectClustering: %i \n"
+            "segmenter: coarsePlaneFitting: %i \n"
+            "segmenter: coarsePlaneLeafSize: %f \n"
+            "segmenter: autoROI: %i \n"
+            "segmenter: autoROIMargin: %f \n"
+            "segmenter: autoROIPixelMargin: %i \n"
+            "segmenter: sceneChangeGating: %i \n"
+            "segmenter: sceneChangeMaxFraction: %f \n"
+            "segmenter: sceneChangeDepthThreshold: %f \n"
+            "segmenter: sceneChangeColorThreshold: %i \n"
+            "segmenter: multiSurfaceSegmentation: %i \n"
+            "segmenter: surfaceMaxCount: %i \n"
+            "segmenter: surfaceMinInliers: %i \n"
+            "segmenter: surfaceMaxAngle: %f \n"
+            "segmenter: stageCaching: %i \n"
+            "segmenter: planeRansacConfidence: %f \n"
+            "segmenter: planeRansacGuided: %i \n"
+            "segmenter: planeRansacThreads: %i \n"
+            "segmenter: planeNormalPrior: %i \n"
+            "segmenter: planeNormalTolerance: %f \n"
             "colorAnalysis: hsvFilterLowerSThreshold: %f \n"
             "colorAnalysis: hsvFilterUpperSThreshold: %f \n"
             "colorAnalysis: hsvFilterLowerVThreshold: %f \n"
             "colorAnalysis: hsvFilterUpperVThreshold: %f \n"
-            "general: numThreads: %i \n") %
+            "general: numThreads: %i \n"
+            "general: metrics: %i \n"
+            "general: metricsPublishPeriod: %f \n") %
             config.zAxisFilterMin % config.zAxisFilterMax % config.downsampleLeafSize %
-            config.planeMaxIterations % config.planeDistanceThreshold % config.ecClusterTolerance %
+            config.planeMaxIterations % config.planeDistanceThreshold %
+            config.planeTracking % config.planeTrackingMinInlierRatio % config.ecClusterTolerance %
             config.ecMinClusterSize % config.ecMaxClusterSize % config.prismZMin % config.prismZMax %
             config.ecObjClusterTolerance % config.ecObjMinClusterSize % config.ecObjMaxClusterSize % 
+            config.organizedSegmentation % config.organizedPlaneMinInliers % config.organizedPlaneAngularThreshold %
+            config.rasterObjectClustering %
+            config.coarsePlaneFitting % config.coarsePlaneLeafSize %
+            config.autoROI % config.autoROIMargin % config.autoROIPixelMargin %
+            config.sceneChangeGating % config.sceneChangeMaxFraction % config.sceneChangeDepthThreshold % config.sceneChangeColorThreshold %
+            config.multiSurfaceSegmentation % config.surfaceMaxCount % config.surfaceMinInliers % config.surfaceMaxAngle %
+            config.stageCaching %
+            config.planeRansacConfidence % config.planeRansacGuided % config.planeRansacThreads %
+            config.planeNormalPrior % config.planeNormalTolerance %
             config.hsvFilterLowerSThreshold % config.hsvFilterUpperSThreshold % 
             config.hsvFilterLowerVThreshold % config.hsvFilterUpperVThreshold % 
-            config.numThreads).str());
+            config.numThreads % config.metrics % config.metricsPublishPeriod).str());
   /*while(processing) // wait until current processing run is completed 
   { 
     boost::this_thread::sleep(boost::posix_time::milliseconds(1));
   }*/
+  // The segmentation worker holds the node mutex for a whole frame. Updating the
+  // parameters and reprocessing the last frame under it keeps both from seeing
+  // a half updated configuration
+  PerceptionSnapshot snapshot;
+  bool reprocessed = false;
+  mutex.lock();
   sp.setZAxisFilterMin(config.zAxisFilterMin);
   sp.setZAxisFilterMax(config.zAxisFilterMax);
   sp.setDownsampleLeafSize(config.downsampleLeafSize);
   sp.setPlaneMaxIterations(config.planeMaxIterations);
   sp.setPlaneDistanceThreshold(config.planeDistanceThreshold);
+  sp.setPlaneTracking(config.planeTracking);
+  sp.setPlaneTrackingMinInlierRatio(config.planeTrackingMinInlierRatio);
   sp.setEcClusterTolerance(config.ecClusterTolerance);
   sp.setEcMinClusterSize(config.ecMinClusterSize);
   sp.setEcMaxClusterSize(config.ecMaxClusterSize);
@@ -543,10 +972,61 @@ void SuturoPerceptionROSNode::reconfigureCallback(suturo_perception_rosnode::Sut
   sp.setEcObjClusterTolerance(config.ecObjClusterTolerance);
   sp.setEcObjMinClusterSize(config.ecObjMinClusterSize);
   sp.setEcObjMaxClusterSize(config.ecObjMaxClusterSize);
-  color_analysis_lower_s = config.hsvFilterLowerSThreshold;
-  color_analysis_upper_s = config.hsvFilterUpperSThreshold;
-  color_analysis_lower_v = config.hsvFilterLowerVThreshold;
-  color_analysis_upper_v = config.hsvFilterUpperVThreshold;
+  sp.setOrganizedSegmentation(config.organizedSegmentation);
+  sp.setOrganizedPlaneMinInliers(config.organizedPlaneMinInliers);
+  sp.setOrganizedPlaneAngularThreshold(config.organizedPlaneAngularThreshold);
+  sp.setRasterObjectClustering(config.rasterObjectClustering);
+  sp.setCoarsePlaneFitting(config.coarsePlaneFitting);
+  sp.setCoarsePlaneLeafSize(config.coarsePlaneLeafSize);
+  sp.setAutoROI(config.autoROI);
+  sp.setAutoROIMargin(config.autoROIMargin);
+  sp.setAutoROIPixelMargin(config.autoROIPixelMargin);
+  sp.setSceneChangeGating(config.sceneChangeGating);
+  sp.setSceneChangeMaxFraction(config.sceneChangeMaxFraction);
+  sp.setSceneChangeDepthThreshold(config.sceneChangeDepthThreshold);
+  sp.setSceneChangeColorThreshold(config.sceneChangeColorThreshold);
+  // Results of the old parameters must not be reused
+  sp.resetSceneChange();
+  sp.setMultiSurfaceSegmentation(config.multiSurfaceSegmentation);
+  sp.setSurfaceMaxCount(config.surfaceMaxCount);
+  sp.setSurfaceMinInliers(config.surfaceMinInliers);
+  sp.setSurfaceMaxAngle(config.surfaceMaxAngle);
+  sp.setStageCaching(config.stageCaching);
+  sp.setPlaneRansacConfidence(config.planeRansacConfidence);
+  sp.setPlaneRansacGuided(config.planeRansacGuided);
+  sp.setPlaneRansacThreads(config.planeRansacThreads);
+  planeNormalPrior = config.planeNormalPrior;
+  sp.setPlaneNormalTolerance(config.planeNormalTolerance);
+  {
+    boost::lock_guard<boost::mutex> lock(capability_mutex_);
+    color_analysis_lower_s = config.hsvFilterLowerSThreshold;
+    color_analysis_upper_s = config.hsvFilterUpperSThreshold;
+    color_analysis_lower_v = config.hsvFilterLowerVThreshold;
+    color_analysis_upper_v = config.hsvFilterUpperVThreshold;
+  }
+
+  // Show the effect of the new parameters on the last frame right away.
+  // Only the stages, that depend on the changed parameters, run again
+  if(config.stageCaching)
+  {
+    reprocessed = sp.reprocessLastFrame();
+    if(reprocessed)
+      buildSnapshot(lastSegmentedFrame(ros::Time::now()), CapabilityFlags(), snapshot);
+  }
+  mutex.unlock();
+  if(reprocessed)
+    publishSnapshot(snapshot);
+
+  MetricsRegistry::instance().setEnabled(config.metrics);
+  double period = config.metrics ? config.metricsPublishPeriod : 0;
+  if(period != metricsPublishPeriod)
+  {
+    metricsPublishPeriod = period;
+    if(period > 0)
+      metricsTimer = nh.createTimer(ros::Duration(period), &SuturoPerceptionROSNode::publishMetrics, this);
+    else
+      metricsTimer.stop();
+  }
   logger.logInfo("Reconfigure successful");
 }
 
@@ -559,15 +1039,18 @@ void SuturoPerceptionROSNode::reconfigureCallback(suturo_perception_rosnode::Sut
 std::vector<suturo_perception_msgs::PerceivedObject> *SuturoPerceptionROSNode::convertPerceivedObjects(std::vector<suturo_perception_lib::PerceivedObject, Eigen::aligned_allocator<suturo_perception_lib::PerceivedObject> > *objects)
 {
   std::vector<suturo_perception_msgs::PerceivedObject> *result = new std::vector<suturo_perception_msgs::PerceivedObject>();
+  result->reserve(objects->size());
   for (std::vector<suturo_perception_lib::PerceivedObject, Eigen::aligned_allocator<suturo_perception_lib::PerceivedObject> >::iterator it = objects->begin(); it != objects->end(); ++it)
   {
-    suturo_perception_msgs::PerceivedObject *msgObj = new suturo_perception_msgs::PerceivedObject();
+    result->push_back(suturo_perception_msgs::PerceivedObject());
+    suturo_perception_msgs::PerceivedObject *msgObj = &result->back();
     msgObj->c_id = it->get_c_id();
     msgObj->c_shape = it->get_c_shape();
     msgObj->c_volume = it->get_c_volume();
-    msgObj->c_centroid.x = it->get_c_centroid().x;
-    msgObj->c_centroid.y = it->get_c_centroid().y;
-    msgObj->c_centroid.z = it->get_c_centroid().z;
+    const suturo_perception_lib::Point &centroid = it->get_c_centroid();
+    msgObj->c_centroid.x = centroid.x;
+    msgObj->c_centroid.y = centroid.y;
+    msgObj->c_centroid.z = centroid.z;
     msgObj->frame_id = frameId;
     msgObj->c_color_average_r = it->get_c_color_average_r();
     msgObj->c_color_average_g = it->get_c_color_average_g();
@@ -578,15 +1061,17 @@ std::vector<suturo_perception_msgs::PerceivedObject> *SuturoPerceptionROSNode::c
     msgObj->c_color_average_qh = it->get_c_color_average_qh();
     msgObj->c_color_average_qs = it->get_c_color_average_qs();
     msgObj->c_color_average_qv = it->get_c_color_average_qv();
-    msgObj->c_roi_origin.x = it->get_c_roi().origin.x;
-    msgObj->c_roi_origin.y = it->get_c_roi().origin.y;
-    msgObj->c_roi_width = it->get_c_roi().width;
-    msgObj->c_roi_height = it->get_c_roi().height;
-    msgObj->c_hue_histogram = *it->get_c_hue_histogram();
+    const suturo_perception_lib::ROI &roi = it->get_c_roi();
+    msgObj->c_roi_origin.x = roi.origin.x;
+    msgObj->c_roi_origin.y = roi.origin.y;
+    msgObj->c_roi_width = roi.width;
+    msgObj->c_roi_height = roi.height;
+    if (it->get_c_hue_histogram() != NULL)
+      msgObj->c_hue_histogram = *it->get_c_hue_histogram();
     msgObj->c_hue_histogram_quality = it->get_c_hue_histogram_quality();
     msgObj->recognition_label_2d = it->get_c_recognition_label_2d();
   
-    Cuboid c = it->get_c_cuboid();
+    const Cuboid &c = it->get_c_cuboid();
     msgObj->matched_cuboid.length1  = c.length1;
     msgObj->matched_cuboid.length2  = c.length2;
     msgObj->matched_cuboid.length3  = c.length3;
@@ -599,10 +1084,8 @@ std::vector<suturo_perception_msgs::PerceivedObject> *SuturoPerceptionROSNode::c
     msgObj->matched_cuboid.pose.orientation.z   = c.orientation.z();
     msgObj->matched_cuboid.pose.orientation.w   = c.orientation.w();
 
-    for (int i = 0; i < 308; i++) 
-    {
-      msgObj->c_vfh_estimation.push_back(it->get_c_vfhs().histogram[i]);
-    }
+    const float *histogram = it->get_c_vfhs().histogram;
+    msgObj->c_vfh_estimation.assign(histogram, histogram + 308);
     msgObj->c_svm_result = ""; //svm_classification.classifyVFHSignature308(it->get_c_vfhs());
     msgObj->c_pose = 0; //svm_classification.classifyPoseVFHSignature308(it->get_c_vfhs(), msgObj->c_svm_result);
 
@@ -612,8 +1095,6 @@ std::vector<suturo_perception_msgs::PerceivedObject> *SuturoPerceptionROSNode::c
     // add arff data
     msgObj->arff_header = arff_header();
     msgObj->arff = add_to_arff(*msgObj);
-    
-    result->push_back(*msgObj);
   }
   return result;
 }
@@ -3,10 +3,12 @@
 #include <boost/date_time.hpp>
 #include <boost/thread.hpp>
 #include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
 #include <dynamic_reconfigure/server.h>
 #include <suturo_perception_rosnode/SuturoPerceptionConfig.h>
 #include <pcl_ros/point_cloud.h>
 #include <sensor_msgs/PointCloud.h>
+#include <tf/transform_listener.h>
 
 #include "suturo_perception.h"
 #include "visualization_publisher.h"
@@ -28,7 +30,9 @@
 #include <message_filters/synchronizer.h>
 #include <message_filters/sync_policies/approximate_time.h>
 #include "suturo_perception_utils.h"
+#include "metrics_registry.h"
 #include <sensor_msgs/Image.h>
+#include <std_msgs/String.h>
 #include "suturo_perception_2d_capabilities/label_annotator_2d.h"
 #include "vfh_estimation.h"
 //#include "svm_classification.h"
@@ -39,10 +43,85 @@ using namespace suturo_perception_utils;
 using namespace suturo_perception_color_analysis;
 //using namespace suturo_perception_svm_classification;
 
+/*
+ * Capabilities that have been requested by a GetClusters call
+ */
+struct CapabilityFlags
+{
+  bool color;
+  bool shape;
+  bool vfh;
+  bool cuboid;
+  bool label2d;
+
+  CapabilityFlags() : color(false), shape(false), vfh(false), cuboid(false), label2d(false) {}
+
+  // Capabilities that are used for a plain "get" request
+  static CapabilityFlags defaults()
+  {
+    CapabilityFlags caps;
+    caps.color = true;
+    caps.shape = true;
+    caps.cuboid = true;
+    caps.label2d = true;
+    return caps;
+  }
+
+  // true, if every capability in other is set in this
+  bool covers(const CapabilityFlags &other) const
+  {
+    return (color || !other.color) && (shape || !other.shape) && (vfh || !other.vfh) &&
+      (cuboid || !other.cuboid) && (label2d || !other.label2d);
+  }
+
+  void merge(const CapabilityFlags &other)
+  {
+    color |= other.color;
+    shape |= other.shape;
+    vfh |= other.vfh;
+    cuboid |= other.cuboid;
+    label2d |= other.label2d;
+  }
+};
+
+/*
+ * Everything that is needed to answer a GetClusters call.
+ * In the continuous mode, these are produced by the background worker.
+ */
+struct PerceptionSnapshot
+{
+  PerceptionSnapshot() : reused(false) {}
+
+  ros::Time stamp; // time, when the processed frame has been received
+  CapabilityFlags capabilities;
+  bool reused; // the frame didn't change, the objects are the ones of an earlier frame
+  std::vector<suturo_perception_msgs::PerceivedObject> objects;
+  std::vector<cv::Mat> cluster_images;
+  std::vector<cv::Mat> histogram_images;
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr plane_cloud;
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr objects_cloud;
+};
+
+/*
+ * A segmented frame on its way from the segmentation to the capabilities.
+ * It holds everything the capabilities need, so they can run on it
+ * while the next frame is segmented.
+ */
+struct SegmentedFrame
+{
+  SegmentedFrame() : fallback(false) {}
+
+  ros::Time stamp; // time, when the frame has been received
+  suturo_perception_lib::SegmentationResult::ConstPtr result;
+  boost::shared_ptr<cv::Mat> image; // rgb image of the frame, NULL without color data
+  bool fallback; // only point clouds were available
+};
+
 class SuturoPerceptionROSNode
 {
 public:
   SuturoPerceptionROSNode(ros::NodeHandle& n, std::string pt, std::string ct, std::string fi, std::string rd);
+  ~SuturoPerceptionROSNode();
   void receive_cloud(const sensor_msgs::PointCloud2ConstPtr& inputCloud);
   void receive_image_and_cloud(const sensor_msgs::ImageConstPtr& inputImage, const sensor_msgs::PointCloud2ConstPtr& inputCloud);
   bool getClusters(suturo_perception_msgs::GetClusters::Request &req,
@@ -51,7 +130,12 @@ public:
 
   void fallback_receive_cloud(const sensor_msgs::PointCloud2ConstPtr& inputCloud);
 
+  // Keep processing the incoming frames in the background
+  void startContinuousProcessing();
+
 private:
+  typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::PointCloud2> SyncPolicy;
+
   // Declare the names of the used Topics
   static const std::string TABLE_PLANE_TOPIC;
   static const std::string ALL_OBJECTS_ON_PLANE_TOPIC;
@@ -59,6 +143,7 @@ private:
   static const std::string IMAGE_PREFIX_TOPIC;
   static const std::string CROPPED_IMAGE_PREFIX_TOPIC;
   static const std::string HISTOGRAM_PREFIX_TOPIC;
+  static const std::string METRICS_TOPIC;
 
   bool processing; // processing flag
   bool callback_called; // cloud and image received, callback is running
@@ -66,8 +151,6 @@ private:
   ros::Subscriber sub_cloud; // fallback subscriber
   ObjectMatcher object_matcher_;
   suturo_perception_lib::SuturoPerception sp;
-  //std::vector<suturo_perception_lib::PerceivedObject> perceivedObjects;
-  std::vector<suturo_perception_lib::PerceivedObject, Eigen::aligned_allocator<suturo_perception_lib::PerceivedObject> > perceivedObjects;
   ros::NodeHandle nh;
   //SVMClassification svm_classification;
   boost::signals2::mutex mutex;
@@ -83,11 +166,17 @@ private:
   std::string colorTopic;
   std::string frameId;
   std::string recognitionDir;
+  // prior of the table normal from the robot kinematics
+  tf::TransformListener tfListener;
+  std::string supportFrame;
+  bool planeNormalPrior;
   // Helper Class for Publishing Business
   PublisherHelper ph;
   // dynamic reconfigure
   dynamic_reconfigure::Server<suturo_perception_rosnode::SuturoPerceptionConfig> reconfSrv;
   dynamic_reconfigure::Server<suturo_perception_rosnode::SuturoPerceptionConfig>::CallbackType reconfCb;
+  // serializes the capability runs, that share the object matcher and the color analysis config
+  boost::mutex capability_mutex_;
   // color analysis config
   double color_analysis_lower_s;
   double color_analysis_upper_s;
@@ -99,6 +188,56 @@ private:
 
   int numThreads;
 
+  // periodic snapshots of the MetricsRegistry
+  ros::Publisher metricsPublisher;
+  ros::Timer metricsTimer;
+  double metricsPublishPeriod;
+
+  // continuous processing. The segmentation and the capabilities run on their own
+  // threads, so a frame can be segmented while the capabilities run on the last one
+  bool continuous_;
+  boost::thread worker_;
+  boost::thread capability_worker_;
+  boost::shared_ptr<message_filters::Subscriber<sensor_msgs::Image> > cont_image_sub_;
+  boost::shared_ptr<message_filters::Subscriber<sensor_msgs::PointCloud2> > cont_pc_sub_;
+  boost::shared_ptr<message_filters::Synchronizer<SyncPolicy> > cont_sync_;
+  // latest received frame, handed over to the worker
+  boost::mutex frame_mutex_;
+  boost::condition_variable frame_cond_;
+  bool frame_available_;
+  sensor_msgs::ImageConstPtr latest_image_;
+  sensor_msgs::PointCloud2ConstPtr latest_cloud_;
+  ros::Time latest_frame_time_;
+  // latest finished result
+  boost::mutex snapshot_mutex_;
+  boost::condition_variable snapshot_cond_;
+  boost::shared_ptr<const PerceptionSnapshot> front_snapshot_;
+  CapabilityFlags continuous_caps_;
+  // segmented frame, handed over to the capability worker. The segmentation
+  // only starts on the next frame, once this one has been picked up
+  boost::mutex segmented_mutex_;
+  boost::condition_variable segmented_cond_;
+  bool segmented_available_;
+  SegmentedFrame segmented_frame_;
+
+  void processFrame(const sensor_msgs::ImageConstPtr& inputImage, const sensor_msgs::PointCloud2ConstPtr& inputCloud);
+  Eigen::Vector3f lookupSupportNormal(const std_msgs::Header &header);
+  void receive_frame(const sensor_msgs::ImageConstPtr& inputImage, const sensor_msgs::PointCloud2ConstPtr& inputCloud);
+  void receive_cloud_continuous(const sensor_msgs::PointCloud2ConstPtr& inputCloud);
+  void segmentationWorker();
+  void capabilityWorker();
+  bool waitForSnapshot(const CapabilityFlags &caps, double max_age, boost::shared_ptr<const PerceptionSnapshot> &snapshot);
+  bool parseRequest(const std::string &request, CapabilityFlags &caps, double &max_age);
+  // The last segmented frame of sp. The caller has to hold the node mutex
+  SegmentedFrame lastSegmentedFrame(ros::Time stamp);
+  void buildSnapshot(const SegmentedFrame &frame, const CapabilityFlags &caps, PerceptionSnapshot &snapshot);
+  void adjustROIs(std::vector<suturo_perception_lib::PerceivedObject, Eigen::aligned_allocator<suturo_perception_lib::PerceivedObject> > &objects,
+      const SegmentedFrame &frame);
+  void runCapabilities(std::vector<suturo_perception_lib::PerceivedObject, Eigen::aligned_allocator<suturo_perception_lib::PerceivedObject> > &objects,
+      const SegmentedFrame &frame, const CapabilityFlags &caps);
+  void publishSnapshot(const PerceptionSnapshot &snapshot);
+  void publishMetrics(const ros::TimerEvent &event);
+
   std::string add_to_arff(suturo_perception_msgs::PerceivedObject obj);
   std::string arff_header();
 
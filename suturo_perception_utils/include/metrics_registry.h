@@ -0,0 +1,117 @@
+#ifndef SUTURO_PERCEPTION_METRICS_REGISTRY_H
+#define SUTURO_PERCEPTION_METRICS_REGISTRY_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/signals2/mutex.hpp>
+#include "boost/date_time/posix_time/posix_time.hpp"
+
+namespace suturo_perception_utils
+{
+  /**
+   * Latency statistics of a named timer.
+   * bucket_counts[i] counts the samples up to MetricsRegistry::BUCKET_BOUNDS[i] ms,
+   * the last bucket counts everything above the last bound.
+   */
+  struct TimerStats
+  {
+    TimerStats();
+
+    long count;
+    double sum_ms;
+    double min_ms;
+    double max_ms;
+    std::vector<long> bucket_counts;
+
+    double mean() const { return count > 0 ? sum_ms / count : 0; }
+    // Upper bound of the bucket, that holds the q-quantile (0 <= q <= 1).
+    // Samples in the last bucket are bounded by max_ms
+    double quantile(double q) const;
+  };
+
+  /**
+   * Copy of all metrics at a point in time.
+   */
+  struct MetricsSnapshot
+  {
+    boost::posix_time::ptime stamp;
+    std::map<std::string, TimerStats> timers;
+    std::map<std::string, long> counters;
+
+    std::string toJSON() const;
+  };
+
+  /**
+   * Process wide registry of named timers and counters.
+   * Every timer keeps a latency histogram with fixed buckets, so the
+   * metrics can be aggregated over any number of frames with constant memory.
+   * Names are "<module>/<what>", e.g. "point_cloud_operations/fitPlanarModel".
+   *
+   * The registry is threadsafe. When it is disabled, the timers don't read the
+   * clock and nothing is recorded, so instrumented code only pays for a flag test.
+   */
+  class MetricsRegistry
+  {
+    public:
+      static MetricsRegistry &instance();
+
+      void setEnabled(bool enabled) { enabled_ = enabled; }
+      bool isEnabled() const { return enabled_; }
+
+      // Add a sample to the timer name
+      void recordTime(const std::string &name, double ms);
+      void recordTime(const std::string &name, boost::posix_time::ptime s, boost::posix_time::ptime e);
+      // Add n to the counter name
+      void increment(const std::string &name, long n = 1);
+
+      MetricsSnapshot snapshot();
+      // Drop all samples and counts
+      void reset();
+
+      static const int BUCKETS = 16;
+      // Upper bounds in ms of all buckets but the last one
+      static const double BUCKET_BOUNDS[BUCKETS - 1];
+
+    private:
+      MetricsRegistry();
+      MetricsRegistry(const MetricsRegistry &);
+      MetricsRegistry &operator=(const MetricsRegistry &);
+
+      volatile bool enabled_;
+      boost::signals2::mutex mutex_;
+      std::map<std::string, TimerStats> timers_;
+      std::map<std::string, long> counters_;
+  };
+
+  /**
+   * Records the time from its construction to stop() or its destruction
+   * in the timer name of the MetricsRegistry. name has to outlive the timer.
+   */
+  class ScopedTimer
+  {
+    public:
+      explicit ScopedTimer(const char *name) : name_(name), running_(MetricsRegistry::instance().isEnabled())
+      {
+        if (running_)
+          start_ = boost::posix_time::microsec_clock::local_time();
+      }
+      ~ScopedTimer() { stop(); }
+
+      // Record the time up to now. Later calls and the destructor do nothing
+      void stop()
+      {
+        if (!running_)
+          return;
+        running_ = false;
+        MetricsRegistry::instance().recordTime(name_, start_, boost::posix_time::microsec_clock::local_time());
+      }
+
+    private:
+      const char *name_;
+      bool running_;
+      boost::posix_time::ptime start_;
+  };
+}
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
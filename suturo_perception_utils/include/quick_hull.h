@@ -0,0 +1,44 @@
+#ifndef QUICK_HULL_H
+#define QUICK_HULL_H
+
+#include <vector>
+#include <Eigen/Core>
+
+namespace suturo_perception_utils
+{
+  /**
+   * Convex hulls in 2d and 3d without libqhull.
+   * Everything lives on the stack of the caller, so the methods can be
+   * called concurrently from any number of threads.
+   */
+  class QuickHull
+  {
+    public:
+      // Triangle of a 3d hull. The vertices are counter-clockwise seen from outside
+      struct Face
+      {
+        int v[3];
+      };
+
+      // Convex hull of points in the plane (Andrew's monotone chain).
+      // vertices will contain the indices of the hull points in counter-clockwise order.
+      // Returns false, if all points are on a line.
+      static bool compute2d(const std::vector<Eigen::Vector2f> &points, std::vector<int> &vertices,
+          double &area);
+
+      // Convex hull of points in space (quickhull).
+      // vertices will contain the sorted indices of the hull points.
+      // Returns false, if all points are on a plane.
+      static bool compute3d(const std::vector<Eigen::Vector3f> &points, std::vector<int> &vertices,
+          std::vector<Face> &faces, double &area, double &volume);
+
+      // Convex hull of points in space, that lie (almost) on a plane. The points are
+      // projected onto their least-squares plane first, like pcl::ConvexHull does it
+      // for 2d hulls. The vertices are counter-clockwise seen from the side the plane normal points to.
+      static bool computePlanar(const std::vector<Eigen::Vector3f> &points, std::vector<int> &vertices,
+          double &area);
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
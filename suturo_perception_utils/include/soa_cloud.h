@@ -0,0 +1,84 @@
+#ifndef SUTURO_PERCEPTION_SOA_CLOUD_H
+#define SUTURO_PERCEPTION_SOA_CLOUD_H
+
+#include <vector>
+#include <stdint.h>
+#include <Eigen/Core>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+namespace suturo_perception_utils
+{
+  /**
+   * Point cloud with separate x, y, z and rgb arrays (structure of arrays).
+   * A pcl::PointXYZRGB takes 32 bytes, of which a kernel on the coordinates
+   * only reads 12. Here every kernel only streams the arrays it needs.
+   *
+   * The arrays are 16 byte aligned and padded to a multiple of LANES.
+   * The padding has NaN coordinates, so the SSE kernels run over whole
+   * registers without a scalar tail. Like in pcl, NaN points are invalid:
+   * they are never inliers and are skipped by getMinMax3D and compute3DCentroid.
+   */
+  class SoACloud
+  {
+    public:
+      typedef std::vector<float, Eigen::aligned_allocator<float> > FloatArray;
+      typedef std::vector<uint32_t, Eigen::aligned_allocator<uint32_t> > ColorArray;
+
+      // Points per SSE register
+      static const size_t LANES = 4;
+
+      SoACloud();
+      explicit SoACloud(const pcl::PointCloud<pcl::PointXYZRGB> &cloud);
+
+      // Copy the points of cloud. An organized cloud stays organized in toPCL
+      void fromPCL(const pcl::PointCloud<pcl::PointXYZRGB> &cloud);
+      // Copy the points of cloud referenced by indices
+      void fromPCL(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const std::vector<int> &indices);
+      // Write the points into cloud. The header of cloud is left untouched
+      void toPCL(pcl::PointCloud<pcl::PointXYZRGB> &cloud) const;
+
+      // Resize to size points. New points are NaN
+      void resize(size_t size);
+      size_t size() const { return size_; }
+      bool empty() const { return size_ == 0; }
+
+      // The arrays hold atleast size() elements and are aligned for _mm_load_ps
+      float *x() { return &x_[0]; }
+      float *y() { return &y_[0]; }
+      float *z() { return &z_[0]; }
+      uint32_t *rgba() { return &rgba_[0]; }
+      const float *x() const { return &x_[0]; }
+      const float *y() const { return &y_[0]; }
+      const float *z() const { return &z_[0]; }
+      const uint32_t *rgba() const { return &rgba_[0]; }
+
+      // Append the index of every point within threshold of the plane
+      // ax + by + cz + d = 0 to inliers. Returns the number of these points
+      int selectWithinDistance(const Eigen::Vector4f &plane, float threshold, std::vector<int> &inliers) const;
+      // Number of the points [begin, end) within threshold of the plane. begin has to be a multiple
+      // of LANES and end too, unless it is size()
+      size_t countWithinDistance(const Eigen::Vector4f &plane, float threshold, size_t begin, size_t end) const;
+      // Project all points onto the plane. out may be this cloud
+      void projectToPlane(const Eigen::Vector4f &plane, SoACloud &out) const;
+      // Bounding box of the valid points. Returns false, if there are none
+      bool getMinMax3D(Eigen::Vector4f &min_pt, Eigen::Vector4f &max_pt) const;
+      // Centroid of the valid points (w = 1). Returns the number of valid points
+      size_t compute3DCentroid(Eigen::Vector4f &centroid) const;
+
+    private:
+      size_t size_;
+      uint32_t width_;
+      uint32_t height_;
+      bool is_dense_;
+      FloatArray x_;
+      FloatArray y_;
+      FloatArray z_;
+      ColorArray rgba_;
+
+      size_t paddedSize() const { return x_.size(); }
+  };
+}
+
+#endif
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
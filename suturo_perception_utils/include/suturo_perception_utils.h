@@ -31,7 +31,8 @@ namespace suturo_perception_utils
       void logInfo (const std::string& s);
       void logWarn (const std::string& s);
       void logError(const std::string& s);
-      // time logging helper
+      // time logging helper. Prefer ScopedTimer or MetricsRegistry (metrics_registry.h)
+      // for timings, that are taken on every frame
       void logTime(boost::posix_time::ptime s, boost::posix_time::ptime e, std::string text);
      
   };
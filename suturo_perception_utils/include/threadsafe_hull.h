@@ -1,41 +1,83 @@
 #ifndef THREADSAFE_HULL_H
 #define THREADSAFE_HULL_H
 
+#include <iostream>
+#include <vector>
 #include <pcl/point_types.h>
-#include <boost/signals2/mutex.hpp>
-#include <pcl/surface/convex_hull.h>
+#include <pcl/point_cloud.h>
 #include <pcl/impl/point_types.hpp>
 #include <boost/shared_ptr.hpp>
+#include "quick_hull.h"
 
 namespace suturo_perception_utils
 {
 	/**
 	 * Helper class to compute a ConvexHull threadsafe.
-   * PCL calls libqhull in a non-threadsafe way.
-   * We can overcome this limitation by implementing a static
-   * method that calls the ConvexHull Calculation. During this computation, the static method will be locked with a mutex.
+   * PCL calls libqhull in a non-threadsafe way, so the hull is
+   * computed with QuickHull instead. No lock is needed and any
+   * number of threads can compute hulls at the same time.
 	 */
   class ThreadsafeHull
   {
     public:
-      
+
+      // dimension 3 gives the vertices of the hull of cloud_in. Clouds, that
+      // lie on a plane, get the hull of dimension 2 instead.
+      // dimension 2 gives the vertices of the hull of cloud_in projected on its
+      // least-squares plane, in polygon order (like pcl::ConvexHull with setDimension(2)).
+      // area and volume are optional.
       template<typename PointT>
-      static void computeConvexHull(boost::shared_ptr<pcl::PointCloud<PointT> > cloud_in, boost::shared_ptr<pcl::PointCloud<PointT> > hull_points)
+      static void computeConvexHull(boost::shared_ptr<pcl::PointCloud<PointT> > cloud_in,
+          boost::shared_ptr<pcl::PointCloud<PointT> > hull_points, int dimension = 3,
+          double *area = NULL, double *volume = NULL)
       {
-        static boost::signals2::mutex mutex;
-        mutex.lock(); // Lock this method, since libqull is NOT threadsafe
-
+        if(area) *area = 0;
+        if(volume) *volume = 0;
         if(cloud_in == NULL || cloud_in->points.size() == 0)
         {
           std::cerr << "ThreadsafeHull::computeConvexHull with empty cloud called" << std::endl;
           return;
         }
 
-        pcl::ConvexHull<PointT> hull;
-        hull.setInputCloud(cloud_in);
-        hull.setDimension(3);
-        hull.reconstruct (*hull_points);
-        mutex.unlock();
+        std::vector<Eigen::Vector3f> points;
+        std::vector<int> point_indices;
+        points.reserve(cloud_in->points.size());
+        point_indices.reserve(cloud_in->points.size());
+        for (int i = 0; i < cloud_in->points.size(); i++)
+        {
+          const PointT &p = cloud_in->points[i];
+          if (!pcl::isFinite(p))
+            continue;
+          points.push_back(Eigen::Vector3f(p.x, p.y, p.z));
+          point_indices.push_back(i);
+        }
+
+        std::vector<int> vertices;
+        double hull_area = 0, hull_volume = 0;
+        bool success = false;
+        if (dimension == 3)
+        {
+          std::vector<QuickHull::Face> faces;
+          success = QuickHull::compute3d(points, vertices, faces, hull_area, hull_volume);
+        }
+        if (!success)
+          success = QuickHull::computePlanar(points, vertices, hull_area);
+
+        hull_points->points.clear();
+        if (!success)
+        {
+          std::cerr << "ThreadsafeHull::computeConvexHull: the points are degenerated" << std::endl;
+          return;
+        }
+        hull_points->points.reserve(vertices.size());
+        for (int i = 0; i < vertices.size(); i++)
+          hull_points->points.push_back(cloud_in->points[point_indices[vertices[i]]]);
+        hull_points->header = cloud_in->header;
+        hull_points->width = hull_points->points.size();
+        hull_points->height = 1;
+        hull_points->is_dense = true;
+        if(area) *area = hull_area;
+        if(volume) *volume = hull_volume;
       }
 	};
 }
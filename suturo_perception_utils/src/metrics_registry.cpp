@@ -0,0 +1,133 @@
+#include "metrics_registry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+using namespace suturo_perception_utils;
+
+const double MetricsRegistry::BUCKET_BOUNDS[MetricsRegistry::BUCKETS - 1] =
+  { 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000 };
+
+namespace
+{
+  std::string jsonString(const std::string &s)
+  {
+    std::string out = "\"";
+    for (size_t i = 0; i < s.size(); i++)
+    {
+      if (s[i] == '"' || s[i] == '\\')
+        out += '\\';
+      out += s[i];
+    }
+    return out + "\"";
+  }
+}
+
+TimerStats::TimerStats() : count(0), sum_ms(0), min_ms(0), max_ms(0),
+  bucket_counts(MetricsRegistry::BUCKETS, 0)
+{
+}
+
+double TimerStats::quantile(double q) const
+{
+  if (count == 0)
+    return 0;
+  long rank = std::max(1L, (long) ceil(q * count));
+  long seen = 0;
+  for (int i = 0; i < MetricsRegistry::BUCKETS - 1; i++)
+  {
+    seen += bucket_counts[i];
+    if (seen >= rank)
+      return std::min(MetricsRegistry::BUCKET_BOUNDS[i], max_ms);
+  }
+  return max_ms;
+}
+
+std::string MetricsSnapshot::toJSON() const
+{
+  std::stringstream out;
+  out << "{\"stamp\": " << jsonString(boost::posix_time::to_iso_extended_string(stamp)) << ", \"timers\": {";
+  for (std::map<std::string, TimerStats>::const_iterator it = timers.begin(); it != timers.end(); ++it)
+  {
+    const TimerStats &t = it->second;
+    out << (it == timers.begin() ? "" : ", ") << jsonString(it->first) << ": {\"count\": " << t.count
+      << ", \"sum_ms\": " << t.sum_ms << ", \"min_ms\": " << t.min_ms << ", \"max_ms\": " << t.max_ms
+      << ", \"mean_ms\": " << t.mean() << ", \"p50_ms\": " << t.quantile(0.5)
+      << ", \"p99_ms\": " << t.quantile(0.99) << ", \"buckets\": [";
+    for (int i = 0; i < t.bucket_counts.size(); i++)
+      out << (i ? ", " : "") << t.bucket_counts[i];
+    out << "]}";
+  }
+  out << "}, \"counters\": {";
+  for (std::map<std::string, long>::const_iterator it = counters.begin(); it != counters.end(); ++it)
+    out << (it == counters.begin() ? "" : ", ") << jsonString(it->first) << ": " << it->second;
+  out << "}}";
+  return out.str();
+}
+
+MetricsRegistry::MetricsRegistry() : enabled_(false)
+{
+}
+
+MetricsRegistry &MetricsRegistry::instance()
+{
+  static MetricsRegistry registry;
+  return registry;
+}
+
+void MetricsRegistry::recordTime(const std::string &name, double ms)
+{
+  if (!enabled_)
+    return;
+  int bucket = 0;
+  while (bucket < BUCKETS - 1 && ms > BUCKET_BOUNDS[bucket])
+    bucket++;
+
+  mutex_.lock();
+  TimerStats &t = timers_[name];
+  if (t.count == 0 || ms < t.min_ms)
+    t.min_ms = ms;
+  if (t.count == 0 || ms > t.max_ms)
+    t.max_ms = ms;
+  t.count++;
+  t.sum_ms += ms;
+  t.bucket_counts[bucket]++;
+  mutex_.unlock();
+}
+
+void MetricsRegistry::recordTime(const std::string &name, boost::posix_time::ptime s, boost::posix_time::ptime e)
+{
+  if (!enabled_)
+    return;
+  recordTime(name, (e - s).total_microseconds() / 1000.0);
+}
+
+void MetricsRegistry::increment(const std::string &name, long n)
+{
+  if (!enabled_)
+    return;
+  mutex_.lock();
+  counters_[name] += n;
+  mutex_.unlock();
+}
+
+MetricsSnapshot MetricsRegistry::snapshot()
+{
+  MetricsSnapshot snapshot;
+  snapshot.stamp = boost::posix_time::microsec_clock::local_time();
+  mutex_.lock();
+  snapshot.timers = timers_;
+  snapshot.counters = counters_;
+  mutex_.unlock();
+  return snapshot;
+}
+
+void MetricsRegistry::reset()
+{
+  mutex_.lock();
+  timers_.clear();
+  counters_.clear();
+  mutex_.unlock();
+}
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
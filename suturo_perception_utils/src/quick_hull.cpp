@@ -0,0 +1,433 @@
+#include "quick_hull.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <stdint.h>
+#include <Eigen/Geometry>
+#include <Eigen/Eigenvalues>
+
+using namespace suturo_perception_utils;
+
+namespace
+{
+  struct SortByXY
+  {
+    const std::vector<Eigen::Vector2f> *points;
+    bool operator()(int a, int b) const
+    {
+      const Eigen::Vector2f &pa = (*points)[a];
+      const Eigen::Vector2f &pb = (*points)[b];
+      return pa.x() < pb.x() || (pa.x() == pb.x() && pa.y() < pb.y());
+    }
+  };
+
+  inline float cross2d(const Eigen::Vector2f &o, const Eigen::Vector2f &a, const Eigen::Vector2f &b)
+  {
+    return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+  }
+
+  // Face of the hull under construction
+  struct HullFace
+  {
+    int v[3];
+    Eigen::Vector3d normal;
+    double offset;
+    bool alive;
+    std::vector<int> outside; // points above this face, that are not assigned to another face
+  };
+
+  // Directed edges of the hull, mapped to the face they belong to
+  typedef std::map<int64_t, int> EdgeMap;
+
+  inline int64_t edgeKey(int a, int b, int n)
+  {
+    return (int64_t) a * n + b;
+  }
+
+  // Signed distance of p to the plane of the face, positive above it
+  inline double distance(const HullFace &f, const Eigen::Vector3f &p)
+  {
+    return f.normal.x() * p.x() + f.normal.y() * p.y() + f.normal.z() * p.z() - f.offset;
+  }
+
+  enum Side { BELOW, ON, ABOVE };
+
+  // Side of the face, that p is on. Points closer than tolerance to its plane are on it.
+  // This is the only test of the sides: the outside sets take the points above a face and
+  // the eye sees every face, that it is not below. Faces, that are coplanar with the eye,
+  // are replaced as well, so the new faces never degenerate to a line
+  inline Side side(const HullFace &f, const Eigen::Vector3f &p, double tolerance)
+  {
+    double d = distance(f, p);
+    return d > tolerance ? ABOVE : (d < -tolerance ? BELOW : ON);
+  }
+
+  int addFace(std::vector<HullFace> &faces, EdgeMap &edges, const std::vector<Eigen::Vector3f> &points,
+      int a, int b, int c)
+  {
+    HullFace f;
+    f.v[0] = a;
+    f.v[1] = b;
+    f.v[2] = c;
+    // In double precision, so neighbouring faces agree about which side a point is on
+    Eigen::Vector3d pa = points[a].cast<double>();
+    f.normal = (points[b].cast<double>() - pa).cross(points[c].cast<double>() - pa);
+    double norm = f.normal.norm();
+    if (norm > 0)
+      f.normal /= norm;
+    f.offset = f.normal.dot(pa);
+    f.alive = true;
+    faces.push_back(f);
+    int index = faces.size() - 1;
+    const int n = points.size();
+    edges[edgeKey(a, b, n)] = index;
+    edges[edgeKey(b, c, n)] = index;
+    edges[edgeKey(c, a, n)] = index;
+    return index;
+  }
+
+  void removeFace(std::vector<HullFace> &faces, EdgeMap &edges, int n, int index)
+  {
+    HullFace &f = faces[index];
+    f.alive = false;
+    for (int e = 0; e < 3; e++)
+    {
+      EdgeMap::iterator it = edges.find(edgeKey(f.v[e], f.v[(e + 1) % 3], n));
+      if (it != edges.end() && it->second == index)
+        edges.erase(it);
+    }
+    std::vector<int>().swap(f.outside);
+  }
+}
+
+bool QuickHull::compute2d(const std::vector<Eigen::Vector2f> &points, std::vector<int> &vertices,
+    double &area)
+{
+  vertices.clear();
+  area = 0;
+  const int n = points.size();
+  if (n < 3)
+    return false;
+
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++)
+    order[i] = i;
+  SortByXY by_xy;
+  by_xy.points = &points;
+  std::sort(order.begin(), order.end(), by_xy);
+
+  std::vector<int> hull(2 * n);
+  int k = 0;
+  // lower hull
+  for (int i = 0; i < n; i++)
+  {
+    while (k >= 2 && cross2d(points[hull[k - 2]], points[hull[k - 1]], points[order[i]]) <= 0)
+      k--;
+    hull[k++] = order[i];
+  }
+  // upper hull
+  for (int i = n - 2, lower = k + 1; i >= 0; i--)
+  {
+    while (k >= lower && cross2d(points[hull[k - 2]], points[hull[k - 1]], points[order[i]]) <= 0)
+      k--;
+    hull[k++] = order[i];
+  }
+  k--; // the last point is the first one
+  if (k < 3)
+    return false;
+
+  vertices.assign(hull.begin(), hull.begin() + k);
+  for (int i = 0, j = k - 1; i < k; j = i++)
+  {
+    const Eigen::Vector2f &a = points[vertices[j]];
+    const Eigen::Vector2f &b = points[vertices[i]];
+    area += (double) a.x() * b.y() - (double) b.x() * a.y();
+  }
+  area *= 0.5;
+  return true;
+}
+
+bool QuickHull::compute3d(const std::vector<Eigen::Vector3f> &points, std::vector<int> &vertices,
+    std::vector<Face> &faces, double &area, double &volume)
+{
+  vertices.clear();
+  faces.clear();
+  area = 0;
+  volume = 0;
+  const int n = points.size();
+  if (n < 4)
+    return false;
+
+  // Extreme points on every axis
+  int min_index[3] = {0, 0, 0}, max_index[3] = {0, 0, 0};
+  for (int i = 1; i < n; i++)
+  {
+    for (int a = 0; a < 3; a++)
+    {
+      if (points[i][a] < points[min_index[a]][a])
+        min_index[a] = i;
+      if (points[i][a] > points[max_index[a]][a])
+        max_index[a] = i;
+    }
+  }
+  float max_coordinate = 0;
+  for (int a = 0; a < 3; a++)
+  {
+    max_coordinate = std::max(max_coordinate, std::fabs(points[min_index[a]][a]));
+    max_coordinate = std::max(max_coordinate, std::fabs(points[max_index[a]][a]));
+  }
+  // Points, that span less than eps in some direction, are planar
+  const float eps = 1e-5f * std::max(max_coordinate, 1e-3f);
+  // The faces only tolerate the rounding of the distances. With a tolerance like eps, a point
+  // dropped within it of two faces, that meet at an acute angle (e.g. on a thin slab), could
+  // end up far outside of the faces that replace them
+  const double tolerance = 1e-14 * std::max(max_coordinate, 1e-3f);
+
+  // Initial tetrahedron: the two extreme points with the biggest distance,
+  // the point farthest from their line and the point farthest from that plane
+  int i0 = min_index[0], i1 = max_index[0];
+  for (int a = 1; a < 3; a++)
+  {
+    if ((points[max_index[a]] - points[min_index[a]]).squaredNorm() > (points[i1] - points[i0]).squaredNorm())
+    {
+      i0 = min_index[a];
+      i1 = max_index[a];
+    }
+  }
+  if ((points[i1] - points[i0]).norm() <= eps)
+    return false;
+  Eigen::Vector3f dir = (points[i1] - points[i0]).normalized();
+  int i2 = -1;
+  float best = eps;
+  for (int i = 0; i < n; i++)
+  {
+    float d = (points[i] - points[i0]).cross(dir).norm();
+    if (d > best)
+    {
+      best = d;
+      i2 = i;
+    }
+  }
+  if (i2 < 0)
+    return false;
+  Eigen::Vector3f base_normal = (points[i1] - points[i0]).cross(points[i2] - points[i0]).normalized();
+  int i3 = -1;
+  best = eps;
+  for (int i = 0; i < n; i++)
+  {
+    float d = std::fabs(base_normal.dot(points[i] - points[i0]));
+    if (d > best)
+    {
+      best = d;
+      i3 = i;
+    }
+  }
+  if (i3 < 0)
+    return false;
+
+  std::vector<HullFace> hull;
+  EdgeMap edges;
+  if (base_normal.dot(points[i3] - points[i0]) > 0)
+    std::swap(i1, i2); // the base has to face away from the apex
+  addFace(hull, edges, points, i0, i1, i2);
+  addFace(hull, edges, points, i0, i3, i1);
+  addFace(hull, edges, points, i1, i3, i2);
+  addFace(hull, edges, points, i2, i3, i0);
+  const Eigen::Vector3f inner = (points[i0] + points[i1] + points[i2] + points[i3]) / 4.0f;
+
+  // Every other point belongs to the first face it is above
+  for (int i = 0; i < n; i++)
+  {
+    if (i == i0 || i == i1 || i == i2 || i == i3)
+      continue;
+    for (int f = 0; f < 4; f++)
+    {
+      if (side(hull[f], points[i], tolerance) == ABOVE)
+      {
+        hull[f].outside.push_back(i);
+        break;
+      }
+    }
+  }
+
+  // Every face with points above it gets replaced by the cone from its
+  // farthest point to the horizon, until no point is outside the hull
+  std::vector<int> pending;
+  for (int f = 0; f < 4; f++)
+  {
+    if (!hull[f].outside.empty())
+      pending.push_back(f);
+  }
+  std::vector<int> visible_stamp;
+  std::vector<int> visible, horizon, orphans, new_faces;
+  while (!pending.empty())
+  {
+    int f = pending.back();
+    pending.pop_back();
+    if (!hull[f].alive || hull[f].outside.empty())
+      continue;
+
+    int eye = hull[f].outside[0];
+    double eye_distance = distance(hull[f], points[eye]);
+    for (int k = 1; k < hull[f].outside.size(); k++)
+    {
+      double d = distance(hull[f], points[hull[f].outside[k]]);
+      if (d > eye_distance)
+      {
+        eye_distance = d;
+        eye = hull[f].outside[k];
+      }
+    }
+    const Eigen::Vector3f &eye_point = points[eye];
+
+    // Collect the connected faces visible from the eye and the edges of the horizon.
+    // Faces, that are coplanar with the eye, count as visible
+    visible_stamp.resize(hull.size(), -1);
+    visible.clear();
+    horizon.clear();
+    visible.push_back(f);
+    visible_stamp[f] = f;
+    for (int k = 0; k < visible.size(); k++)
+    {
+      const HullFace &face = hull[visible[k]];
+      for (int e = 0; e < 3; e++)
+      {
+        int a = face.v[e];
+        int b = face.v[(e + 1) % 3];
+        EdgeMap::const_iterator neighbour = edges.find(edgeKey(b, a, n));
+        if (neighbour == edges.end())
+          continue;
+        int g = neighbour->second;
+        if (visible_stamp[g] == f)
+          continue;
+        if (side(hull[g], eye_point, tolerance) != BELOW)
+        {
+          visible_stamp[g] = f;
+          visible.push_back(g);
+        }
+        else
+        {
+          horizon.push_back(a);
+          horizon.push_back(b);
+        }
+      }
+    }
+
+    // A closed hull always keeps a horizon. Without one, the faces don't
+    // form a closed surface any more and the points are treated as planar
+    if (horizon.empty())
+      return false;
+
+    orphans.clear();
+    for (int k = 0; k < visible.size(); k++)
+    {
+      const std::vector<int> &outside = hull[visible[k]].outside;
+      for (int p = 0; p < outside.size(); p++)
+      {
+        if (outside[p] != eye)
+          orphans.push_back(outside[p]);
+      }
+      removeFace(hull, edges, n, visible[k]);
+    }
+
+    const int first_new_face = hull.size();
+    new_faces.clear();
+    for (int k = 0; k < horizon.size(); k += 2)
+      new_faces.push_back(addFace(hull, edges, points, horizon[k], horizon[k + 1], eye));
+
+    // The points of the removed faces can only be above one of the new faces,
+    // unless they were above a face, that stays, as well. Check all faces in this case
+    for (int p = 0; p < orphans.size(); p++)
+    {
+      bool assigned = false;
+      for (int k = 0; k < new_faces.size() && !assigned; k++)
+      {
+        if (side(hull[new_faces[k]], points[orphans[p]], tolerance) == ABOVE)
+        {
+          hull[new_faces[k]].outside.push_back(orphans[p]);
+          assigned = true;
+        }
+      }
+      for (int g = 0; g < first_new_face && !assigned; g++)
+      {
+        if (hull[g].alive && side(hull[g], points[orphans[p]], tolerance) == ABOVE)
+        {
+          if (hull[g].outside.empty())
+            pending.push_back(g);
+          hull[g].outside.push_back(orphans[p]);
+          assigned = true;
+        }
+      }
+    }
+    for (int k = 0; k < new_faces.size(); k++)
+    {
+      if (!hull[new_faces[k]].outside.empty())
+        pending.push_back(new_faces[k]);
+    }
+  }
+
+  std::vector<bool> is_vertex(n, false);
+  for (int f = 0; f < hull.size(); f++)
+  {
+    if (!hull[f].alive)
+      continue;
+    Face face;
+    const Eigen::Vector3f &a = points[hull[f].v[0]];
+    const Eigen::Vector3f &b = points[hull[f].v[1]];
+    const Eigen::Vector3f &c = points[hull[f].v[2]];
+    Eigen::Vector3f normal = (b - a).cross(c - a);
+    area += 0.5 * normal.norm();
+    volume += (a - inner).dot(normal) / 6.0;
+    for (int e = 0; e < 3; e++)
+    {
+      face.v[e] = hull[f].v[e];
+      is_vertex[face.v[e]] = true;
+    }
+    faces.push_back(face);
+  }
+  for (int i = 0; i < n; i++)
+  {
+    if (is_vertex[i])
+      vertices.push_back(i);
+  }
+  return true;
+}
+
+bool QuickHull::computePlanar(const std::vector<Eigen::Vector3f> &points, std::vector<int> &vertices,
+    double &area)
+{
+  vertices.clear();
+  area = 0;
+  const int n = points.size();
+  if (n < 3)
+    return false;
+
+  // Least-squares plane through the points
+  Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+  for (int i = 0; i < n; i++)
+    centroid += points[i].cast<double>();
+  centroid /= n;
+  Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+  for (int i = 0; i < n; i++)
+  {
+    Eigen::Vector3d d = points[i].cast<double>() - centroid;
+    covariance += d * d.transpose();
+  }
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+  // The eigenvalues are sorted in increasing order
+  Eigen::Vector3f normal = solver.eigenvectors().col(0).cast<float>();
+  Eigen::Vector3f u = solver.eigenvectors().col(2).cast<float>();
+  Eigen::Vector3f v = normal.cross(u);
+
+  std::vector<Eigen::Vector2f> projected(n);
+  const Eigen::Vector3f origin = centroid.cast<float>();
+  for (int i = 0; i < n; i++)
+  {
+    Eigen::Vector3f d = points[i] - origin;
+    projected[i] = Eigen::Vector2f(u.dot(d), v.dot(d));
+  }
+  return compute2d(projected, vertices, area);
+}
+
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
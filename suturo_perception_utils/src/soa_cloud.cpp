@@ -0,0 +1,382 @@
+#include "soa_cloud.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace suturo_perception_utils;
+
+namespace
+{
+  inline bool isValid(float x, float y, float z)
+  {
+    return x == x && y == y && z == z;
+  }
+
+#ifdef __SSE2__
+  // a where mask is set, b elsewhere
+  inline __m128 select(__m128 mask, __m128 a, __m128 b)
+  {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+
+  // All bits set for the points without NaN coordinates
+  inline __m128 validMask(__m128 x, __m128 y, __m128 z)
+  {
+    return _mm_and_ps(_mm_cmpord_ps(x, x), _mm_and_ps(_mm_cmpord_ps(y, y), _mm_cmpord_ps(z, z)));
+  }
+
+  inline float horizontalMin(__m128 v)
+  {
+    float f[4];
+    _mm_storeu_ps(f, v);
+    return std::min(std::min(f[0], f[1]), std::min(f[2], f[3]));
+  }
+
+  inline float horizontalMax(__m128 v)
+  {
+    float f[4];
+    _mm_storeu_ps(f, v);
+    return std::max(std::max(f[0], f[1]), std::max(f[2], f[3]));
+  }
+
+  inline float horizontalSum(__m128 v)
+  {
+    float f[4];
+    _mm_storeu_ps(f, v);
+    return (f[0] + f[1]) + (f[2] + f[3]);
+  }
+#endif
+}
+
+SoACloud::SoACloud() : size_(0), width_(0), height_(1), is_dense_(true)
+{
+  resize(0);
+}
+
+SoACloud::SoACloud(const pcl::PointCloud<pcl::PointXYZRGB> &cloud) : size_(0), width_(0), height_(1), is_dense_(true)
+{
+  fromPCL(cloud);
+}
+
+void SoACloud::resize(size_t size)
+{
+  // Keep atleast one register, so the arrays always have an element
+  size_t padded = std::max(LANES, (size + LANES - 1) / LANES * LANES);
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  x_.resize(padded);
+  y_.resize(padded);
+  z_.resize(padded);
+  rgba_.resize(padded);
+  for (size_t i = std::min(size, size_); i < padded; i++)
+  {
+    x_[i] = y_[i] = z_[i] = nan;
+    rgba_[i] = 0;
+  }
+  size_ = size;
+  width_ = size;
+  height_ = 1;
+}
+
+void SoACloud::fromPCL(const pcl::PointCloud<pcl::PointXYZRGB> &cloud)
+{
+  const pcl::PointCloud<pcl::PointXYZRGB>::VectorType &points = cloud.points;
+  resize(points.size());
+  if (cloud.width * cloud.height == size_)
+  {
+    width_ = cloud.width;
+    height_ = cloud.height;
+  }
+  is_dense_ = cloud.is_dense;
+
+  size_t i = 0;
+#ifdef __SSE2__
+  // Transpose four points at once. The xyz part of a PointXYZRGB is 16 byte aligned
+  for (; i + LANES <= size_; i += LANES)
+  {
+    __m128 x = _mm_load_ps(points[i].data);
+    __m128 y = _mm_load_ps(points[i + 1].data);
+    __m128 z = _mm_load_ps(points[i + 2].data);
+    __m128 w = _mm_load_ps(points[i + 3].data);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_store_ps(&x_[i], x);
+    _mm_store_ps(&y_[i], y);
+    _mm_store_ps(&z_[i], z);
+  }
+#endif
+  for (; i < size_; i++)
+  {
+    x_[i] = points[i].x;
+    y_[i] = points[i].y;
+    z_[i] = points[i].z;
+  }
+  for (i = 0; i < size_; i++)
+    rgba_[i] = points[i].rgba;
+}
+
+void SoACloud::fromPCL(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const std::vector<int> &indices)
+{
+  resize(indices.size());
+  is_dense_ = cloud.is_dense;
+  for (size_t i = 0; i < size_; i++)
+  {
+    const pcl::PointXYZRGB &p = cloud.points[indices[i]];
+    x_[i] = p.x;
+    y_[i] = p.y;
+    z_[i] = p.z;
+    rgba_[i] = p.rgba;
+  }
+}
+
+void SoACloud::toPCL(pcl::PointCloud<pcl::PointXYZRGB> &cloud) const
+{
+  pcl::PointCloud<pcl::PointXYZRGB>::VectorType &points = cloud.points;
+  points.resize(size_);
+  cloud.width = width_;
+  cloud.height = height_;
+  cloud.is_dense = is_dense_;
+
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128 one = _mm_set1_ps(1.0f);
+  for (; i + LANES <= size_; i += LANES)
+  {
+    __m128 x = _mm_load_ps(&x_[i]);
+    __m128 y = _mm_load_ps(&y_[i]);
+    __m128 z = _mm_load_ps(&z_[i]);
+    __m128 w = one;
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_store_ps(points[i].data, x);
+    _mm_store_ps(points[i + 1].data, y);
+    _mm_store_ps(points[i + 2].data, z);
+    _mm_store_ps(points[i + 3].data, w);
+  }
+#endif
+  for (; i < size_; i++)
+  {
+    points[i].x = x_[i];
+    points[i].y = y_[i];
+    points[i].z = z_[i];
+    points[i].data[3] = 1.0f;
+  }
+  for (i = 0; i < size_; i++)
+    points[i].rgba = rgba_[i];
+}
+
+/*
+ * Compares against the threshold scaled with the length of the normal,
+ * so the plane doesn't have to be normalized.
+ */
+int SoACloud::selectWithinDistance(const Eigen::Vector4f &plane, float threshold, std::vector<int> &inliers) const
+{
+  const float norm = plane.head<3>().norm();
+  if (norm == 0)
+    return 0;
+  const float scaled_threshold = threshold * norm;
+  const size_t before = inliers.size();
+
+#ifdef __SSE2__
+  const __m128 a = _mm_set1_ps(plane[0]);
+  const __m128 b = _mm_set1_ps(plane[1]);
+  const __m128 c = _mm_set1_ps(plane[2]);
+  const __m128 d = _mm_set1_ps(plane[3]);
+  const __m128 vthreshold = _mm_set1_ps(scaled_threshold);
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  for (size_t i = 0; i < paddedSize(); i += LANES)
+  {
+    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_load_ps(&x_[i])), _mm_mul_ps(b, _mm_load_ps(&y_[i]))),
+        _mm_add_ps(_mm_mul_ps(c, _mm_load_ps(&z_[i])), d));
+    // false for NaN, so the padding is never selected
+    int mask = _mm_movemask_ps(_mm_cmple_ps(_mm_andnot_ps(sign, distance), vthreshold));
+    if (mask == 0)
+      continue;
+    for (int k = 0; k < (int) LANES; k++)
+    {
+      if (mask & (1 << k))
+        inliers.push_back(i + k);
+    }
+  }
+#else
+  for (size_t i = 0; i < size_; i++)
+  {
+    if (fabs(plane[0] * x_[i] + plane[1] * y_[i] + plane[2] * z_[i] + plane[3]) <= scaled_threshold)
+      inliers.push_back(i);
+  }
+#endif
+  return inliers.size() - before;
+}
+
+size_t SoACloud::countWithinDistance(const Eigen::Vector4f &plane, float threshold, size_t begin, size_t end) const
+{
+  const float norm = plane.head<3>().norm();
+  if (norm == 0)
+    return 0;
+  const float scaled_threshold = threshold * norm;
+  end = std::min(end, size_);
+
+#ifdef __SSE2__
+  const __m128 a = _mm_set1_ps(plane[0]);
+  const __m128 b = _mm_set1_ps(plane[1]);
+  const __m128 c = _mm_set1_ps(plane[2]);
+  const __m128 d = _mm_set1_ps(plane[3]);
+  const __m128 vthreshold = _mm_set1_ps(scaled_threshold);
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  __m128i counts = _mm_setzero_si128();
+  // The last register may reach into the padding, which is never within the distance
+  for (size_t i = begin; i < end; i += LANES)
+  {
+    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_load_ps(&x_[i])), _mm_mul_ps(b, _mm_load_ps(&y_[i]))),
+        _mm_add_ps(_mm_mul_ps(c, _mm_load_ps(&z_[i])), d));
+    // a set mask is -1
+    counts = _mm_sub_epi32(counts, _mm_castps_si128(_mm_cmple_ps(_mm_andnot_ps(sign, distance), vthreshold)));
+  }
+  int32_t count[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(count), counts);
+  return (size_t) count[0] + count[1] + count[2] + count[3];
+#else
+  size_t count = 0;
+  for (size_t i = begin; i < end; i++)
+  {
+    if (fabs(plane[0] * x_[i] + plane[1] * y_[i] + plane[2] * z_[i] + plane[3]) <= scaled_threshold)
+      count++;
+  }
+  return count;
+#endif
+}
+
+void SoACloud::projectToPlane(const Eigen::Vector4f &plane, SoACloud &out) const
+{
+  const float norm = plane.head<3>().norm();
+  const uint32_t width = width_, height = height_;
+  const bool is_dense = is_dense_;
+  if (&out != this)
+  {
+    out.resize(size_);
+    out.rgba_ = rgba_;
+  }
+  out.width_ = width;
+  out.height_ = height;
+  out.is_dense_ = is_dense;
+  if (norm == 0)
+  {
+    if (&out != this)
+    {
+      out.x_ = x_;
+      out.y_ = y_;
+      out.z_ = z_;
+    }
+    return;
+  }
+  const float a = plane[0] / norm, b = plane[1] / norm, c = plane[2] / norm, d = plane[3] / norm;
+
+#ifdef __SSE2__
+  const __m128 va = _mm_set1_ps(a);
+  const __m128 vb = _mm_set1_ps(b);
+  const __m128 vc = _mm_set1_ps(c);
+  const __m128 vd = _mm_set1_ps(d);
+  for (size_t i = 0; i < paddedSize(); i += LANES)
+  {
+    __m128 x = _mm_load_ps(&x_[i]);
+    __m128 y = _mm_load_ps(&y_[i]);
+    __m128 z = _mm_load_ps(&z_[i]);
+    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(va, x), _mm_mul_ps(vb, y)), _mm_add_ps(_mm_mul_ps(vc, z), vd));
+    _mm_store_ps(&out.x_[i], _mm_sub_ps(x, _mm_mul_ps(va, distance)));
+    _mm_store_ps(&out.y_[i], _mm_sub_ps(y, _mm_mul_ps(vb, distance)));
+    _mm_store_ps(&out.z_[i], _mm_sub_ps(z, _mm_mul_ps(vc, distance)));
+  }
+#else
+  for (size_t i = 0; i < size_; i++)
+  {
+    float distance = a * x_[i] + b * y_[i] + c * z_[i] + d;
+    out.x_[i] = x_[i] - a * distance;
+    out.y_[i] = y_[i] - b * distance;
+    out.z_[i] = z_[i] - c * distance;
+  }
+#endif
+}
+
+bool SoACloud::getMinMax3D(Eigen::Vector4f &min_pt, Eigen::Vector4f &max_pt) const
+{
+  min_pt = Eigen::Vector4f(FLT_MAX, FLT_MAX, FLT_MAX, 0);
+  max_pt = Eigen::Vector4f(-FLT_MAX, -FLT_MAX, -FLT_MAX, 0);
+
+#ifdef __SSE2__
+  const __m128 lowest = _mm_set1_ps(-FLT_MAX);
+  const __m128 highest = _mm_set1_ps(FLT_MAX);
+  __m128 min_x = highest, min_y = highest, min_z = highest;
+  __m128 max_x = lowest, max_y = lowest, max_z = lowest;
+  for (size_t i = 0; i < paddedSize(); i += LANES)
+  {
+    __m128 x = _mm_load_ps(&x_[i]);
+    __m128 y = _mm_load_ps(&y_[i]);
+    __m128 z = _mm_load_ps(&z_[i]);
+    // invalid points get bounds, that can't change the result
+    __m128 valid = validMask(x, y, z);
+    min_x = _mm_min_ps(min_x, select(valid, x, highest));
+    min_y = _mm_min_ps(min_y, select(valid, y, highest));
+    min_z = _mm_min_ps(min_z, select(valid, z, highest));
+    max_x = _mm_max_ps(max_x, select(valid, x, lowest));
+    max_y = _mm_max_ps(max_y, select(valid, y, lowest));
+    max_z = _mm_max_ps(max_z, select(valid, z, lowest));
+  }
+  min_pt = Eigen::Vector4f(horizontalMin(min_x), horizontalMin(min_y), horizontalMin(min_z), 0);
+  max_pt = Eigen::Vector4f(horizontalMax(max_x), horizontalMax(max_y), horizontalMax(max_z), 0);
+#else
+  for (size_t i = 0; i < size_; i++)
+  {
+    if (!isValid(x_[i], y_[i], z_[i]))
+      continue;
+    Eigen::Vector4f p(x_[i], y_[i], z_[i], 0);
+    min_pt = min_pt.cwiseMin(p);
+    max_pt = max_pt.cwiseMax(p);
+  }
+#endif
+  return min_pt[0] <= max_pt[0];
+}
+
+size_t SoACloud::compute3DCentroid(Eigen::Vector4f &centroid) const
+{
+  size_t count = 0;
+  centroid = Eigen::Vector4f::Zero();
+
+#ifdef __SSE2__
+  // Four partial sums per coordinate
+  __m128 sum_x = _mm_setzero_ps(), sum_y = _mm_setzero_ps(), sum_z = _mm_setzero_ps();
+  __m128i counts = _mm_setzero_si128();
+  for (size_t i = 0; i < paddedSize(); i += LANES)
+  {
+    __m128 x = _mm_load_ps(&x_[i]);
+    __m128 y = _mm_load_ps(&y_[i]);
+    __m128 z = _mm_load_ps(&z_[i]);
+    __m128 valid = validMask(x, y, z);
+    sum_x = _mm_add_ps(sum_x, _mm_and_ps(valid, x));
+    sum_y = _mm_add_ps(sum_y, _mm_and_ps(valid, y));
+    sum_z = _mm_add_ps(sum_z, _mm_and_ps(valid, z));
+    // a set mask is -1
+    counts = _mm_sub_epi32(counts, _mm_castps_si128(valid));
+  }
+  int32_t c[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(c), counts);
+  count = (size_t) c[0] + c[1] + c[2] + c[3];
+  centroid = Eigen::Vector4f(horizontalSum(sum_x), horizontalSum(sum_y), horizontalSum(sum_z), 0);
+#else
+  for (size_t i = 0; i < size_; i++)
+  {
+    if (!isValid(x_[i], y_[i], z_[i]))
+      continue;
+    centroid += Eigen::Vector4f(x_[i], y_[i], z_[i], 0);
+    count++;
+  }
+#endif
+  if (count == 0)
+    return 0;
+  centroid /= (float) count;
+  centroid[3] = 1;
+  return count;
+}
+// vim: tabstop=2 expandtab shiftwidth=2 softtabstop=2:
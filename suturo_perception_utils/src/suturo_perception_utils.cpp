@@ -64,7 +64,7 @@ void Logger::logError(const std::string& s)
   log(ERROR, s);
 }
 
-// timelogging for profiling
+// timelogging for profiling. Only logs, the metrics need stable names (see MetricsRegistry)
 void Logger::logTime(boost::posix_time::ptime s, boost::posix_time::ptime e, std::string text)
 {
     boost::posix_time::time_duration d = e - s;